@@ -0,0 +1,111 @@
+#include "./arena.h"
+
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+Arena new_arena(size_t chunk_size) {
+    return (Arena) {
+        .current = NULL,
+        .free_chunks = NULL,
+        .chunk_size = chunk_size == 0 ? ARENA_CHUNK_SIZE : chunk_size,
+        .last = NULL,
+    };
+}
+
+// Make a chunk with room for `size` bytes the current chunk
+static void add_chunk(Arena* a, size_t size) {
+    // Reuse a released chunk if one is big enough
+    ArenaChunk** link = &a->free_chunks;
+    while (*link != NULL && (*link)->capacity < size) link = &(*link)->next;
+
+    ArenaChunk* chunk = *link;
+    if (chunk != NULL) {
+        *link = chunk->next;
+    } else {
+        size_t capacity = size > a->chunk_size ? size : a->chunk_size;
+        chunk = malloc(sizeof(ArenaChunk) + capacity);
+        if (chunk == NULL) {
+            fprintf(stderr, "Out of memory allocating %lu bytes" "\n", capacity);
+            exit(1);
+        }
+        chunk->capacity = capacity;
+    }
+
+    chunk->used = 0;
+    chunk->next = a->current;
+    a->current = chunk;
+}
+
+void* arena_alloc(Arena* a, size_t size) {
+    size = align_up(size == 0 ? 1 : size);
+    if (a->current == NULL || a->current->capacity - a->current->used < size) {
+        add_chunk(a, size);
+    }
+    void* pointer = a->current->data + a->current->used;
+    a->current->used += size;
+    a->last = pointer;
+    return pointer;
+}
+
+void* arena_calloc(Arena* a, size_t count, size_t size) {
+    void* pointer = arena_alloc(a, count * size);
+    memset(pointer, 0, count * size);
+    return pointer;
+}
+
+void* arena_grow(Arena* a, void* pointer, size_t old_size, size_t new_size) {
+    if (pointer == NULL) return arena_alloc(a, new_size);
+    if (new_size <= old_size) return pointer;
+
+    if (pointer == a->last) {
+        // Most recent allocation, extend it if its chunk has room
+        ArenaChunk* chunk = a->current;
+        size_t offset = (unsigned char*)pointer - chunk->data;
+        size_t size = align_up(new_size);
+        if (chunk->capacity - offset >= size) {
+            chunk->used = offset + size;
+            return pointer;
+        }
+    }
+
+    void* grown = arena_alloc(a, new_size);
+    memcpy(grown, pointer, old_size);
+    return grown;
+}
+
+char* arena_copy(Arena* a, const char* source, size_t length) {
+    char* copy = arena_alloc(a, length + 1);
+    memcpy(copy, source, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+void arena_reset(Arena* a) {
+    // Move used chunks to the free list
+    while (a->current != NULL) {
+        ArenaChunk* chunk = a->current;
+        a->current = chunk->next;
+        chunk->next = a->free_chunks;
+        a->free_chunks = chunk;
+    }
+    a->last = NULL;
+}
+
+static void free_chunks(ArenaChunk* chunk) {
+    while (chunk != NULL) {
+        ArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
+
+void free_arena(Arena* a) {
+    free_chunks(a->current);
+    free_chunks(a->free_chunks);
+    a->current = NULL;
+    a->free_chunks = NULL;
+    a->last = NULL;
+}
@@ -0,0 +1,64 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "../common.h"
+
+// Size of chunks requested from malloc, a bigger allocation gets a chunk of its own size
+#define ARENA_CHUNK_SIZE 4096
+
+// Block of memory allocations are carved from
+struct _ArenaChunk {
+    // Next chunk in the list this chunk belongs to (used or free)
+    struct _ArenaChunk* next;
+    // Bytes available in field 'data'
+    size_t capacity;
+    // Bytes already handed out from field 'data'
+    size_t used;
+    _Alignas(max_align_t) unsigned char data[];
+};
+
+typedef struct _ArenaChunk ArenaChunk;
+
+// Bump allocator owning all memory of one compilation
+// (scanner source copy, parser nodes, compiled program, ...)
+// Individual allocations are never freed, everything is released at once
+// by arena_reset (keeps chunks for reuse) or free_arena (returns chunks to malloc)
+struct _Arena {
+    // Chunk allocations are served from, head of the list of used chunks
+    ArenaChunk* current;
+    // Chunks released by arena_reset, reused before asking malloc for a new one
+    ArenaChunk* free_chunks;
+    // Capacity of chunks requested from malloc
+    size_t chunk_size;
+    // Most recent allocation, the only one arena_grow can extend in place
+    void* last;
+};
+
+typedef struct _Arena Arena;
+
+// Construct an empty arena, no memory is requested until the first allocation
+// A zero `chunk_size` means ARENA_CHUNK_SIZE
+Arena new_arena(size_t chunk_size);
+
+// Allocate `size` bytes aligned for any type
+// Exits the process if malloc fails
+void* arena_alloc(Arena* a, size_t size);
+
+// Allocate `count` zeroed elements of `size` bytes
+void* arena_calloc(Arena* a, size_t count, size_t size);
+
+// Resize an allocation of `old_size` bytes to `new_size` bytes
+// The most recent allocation grows in place when its chunk has room,
+// any other allocation is copied into a new one
+void* arena_grow(Arena* a, void* pointer, size_t old_size, size_t new_size);
+
+// Copy `length` characters of `source` followed by a '\0'
+char* arena_copy(Arena* a, const char* source, size_t length);
+
+// Release every allocation but keep the chunks for next allocations
+void arena_reset(Arena* a);
+
+// Release every allocation and return all chunks to malloc
+void free_arena(Arena* a);
+
+#endif
@@ -0,0 +1,218 @@
+#include "./backtrack.h"
+
+// Everything one search needs
+struct _Backtracker {
+    BacktrackScratch* scratch;
+    const Program* program;
+    const char* input;
+    size_t length;
+    // First position of the search, bit (pc, position) of the bitmap is pc * columns + position - start
+    size_t start;
+    size_t columns;
+    bool use_visited;
+    // Steps left, counted when not using the bitmap
+    size_t budget;
+};
+
+typedef struct _Backtracker Backtracker;
+
+BacktrackScratch new_backtrack_scratch(const Program* p) {
+    size_t slot_count = p->slot_count + p->register_count;
+    bool* atomic = malloc(p->length * sizeof(bool));
+    uint32_t depth = 0;
+    for (uint32_t pc = 0;pc < p->length;pc++) {
+        Instruction inst = p->instructions[pc];
+        // Entering a part depends only on the position, its OpAtomicEnd is already inside
+        atomic[pc] = depth > 0;
+        if (inst.op == OpAtomicStart) depth++;
+        if (inst.op == OpAtomicEnd) depth--;
+    }
+    return (BacktrackScratch) {
+        .program = p,
+        .stack = malloc(64 * sizeof(BacktrackFrame)),
+        .stack_count = 0,
+        .stack_capacity = 64,
+        .slots = malloc(slot_count * sizeof(size_t)),
+        .visited = NULL,
+        .visited_capacity = 0,
+        .match_slots = malloc(p->slot_count * sizeof(size_t)),
+        .atomic = atomic,
+    };
+}
+
+void free_backtrack_scratch(BacktrackScratch* s) {
+    free(s->stack);
+    free(s->slots);
+    free(s->visited);
+    free(s->match_slots);
+    free(s->atomic);
+}
+
+// Returns false when the stack can not grow, the search then gives up
+static bool push(BacktrackScratch* s, bool restore, uint32_t index, size_t position) {
+    if (s->stack_count == s->stack_capacity) {
+        BacktrackFrame* stack = realloc(s->stack, 2 * s->stack_capacity * sizeof(BacktrackFrame));
+        if (stack == NULL) return false;
+        s->stack = stack;
+        s->stack_capacity *= 2;
+    }
+    s->stack[s->stack_count++] = (BacktrackFrame){.restore = restore, .index = index, .position = position};
+    return true;
+}
+
+// Set slot `slot` to `value`, remembering the old value for when the path fails
+static bool set_slot(BacktrackScratch* s, uint32_t slot, size_t value) {
+    if (!push(s, true, slot, s->slots[slot])) return false;
+    s->slots[slot] = value;
+    return true;
+}
+
+// Whether (pc, position) was tried before, marking it tried
+static bool visit(Backtracker* b, uint32_t pc, size_t position) {
+    size_t bit = pc * b->columns + position - b->start;
+    uint64_t* word = &b->scratch->visited[bit / 64];
+    uint64_t mask = 1ull << (bit % 64);
+    if (*word & mask) return true;
+    *word |= mask;
+    return false;
+}
+
+// Drop the alternatives pushed since the stack had `height` frames, keeping the captures to undo
+static void cut(BacktrackScratch* s, size_t height) {
+    size_t kept = height;
+    for (size_t i = height;i < s->stack_count;i++) {
+        if (s->stack[i].restore) s->stack[kept++] = s->stack[i];
+    }
+    s->stack_count = kept;
+}
+
+// Whether the text of group `group` follows `position`, moving past it
+static bool match_backreference(Backtracker* b, uint32_t group, size_t* position) {
+    size_t start = b->scratch->slots[2 * group];
+    size_t end = b->scratch->slots[2 * group + 1];
+    if (start == NO_POSITION || end == NO_POSITION) return false;
+    size_t n = end - start;
+    if (n > b->length - *position || memcmp(b->input + start, b->input + *position, n) != 0) return false;
+    *position += n;
+    return true;
+}
+
+// Try every path from the start of the program at `position` in priority order
+static BacktrackResult run(Backtracker* b, size_t position, size_t* slots) {
+    BacktrackScratch* s = b->scratch;
+    const Program* p = b->program;
+    s->stack_count = 0;
+    if (!push(s, false, p->start, position)) return BacktrackGaveUp;
+
+    while (s->stack_count > 0) {
+        BacktrackFrame frame = s->stack[--s->stack_count];
+        if (frame.restore) {
+            s->slots[frame.index] = frame.position;
+            continue;
+        }
+        uint32_t pc = frame.index;
+        position = frame.position;
+        // Follow the highest priority path until it fails
+        while (true) {
+            if (b->use_visited && !s->atomic[pc]) {
+                if (visit(b, pc, position)) break;
+            } else {
+                if (b->budget == 0) return BacktrackGaveUp;
+                b->budget--;
+            }
+
+            Instruction inst = p->instructions[pc];
+            bool next = true;
+            switch (inst.op) {
+                case OpByte:
+                    next = position < b->length && (unsigned char)b->input[position] == inst.x;
+                    position++;
+                    pc++;
+                    break;
+                case OpClass:
+                    next = position < b->length && program_class_contains(p, inst.x, b->input[position]);
+                    position++;
+                    pc++;
+                    break;
+                case OpSplit:
+                    if (!push(s, false, inst.y, position)) return BacktrackGaveUp;
+                    pc = inst.x;
+                    break;
+                case OpJmp:
+                    pc = inst.x;
+                    break;
+                case OpSave:
+                    if (!set_slot(s, inst.x, position)) return BacktrackGaveUp;
+                    pc++;
+                    break;
+                case OpAssert:
+                    next = assert_holds(inst.x, b->input, b->length, position);
+                    pc++;
+                    break;
+                case OpBackref:
+                    next = match_backreference(b, inst.x, &position);
+                    pc++;
+                    break;
+                case OpAtomicStart:
+                    if (!set_slot(s, inst.x, s->stack_count)) return BacktrackGaveUp;
+                    pc++;
+                    break;
+                case OpAtomicEnd:
+                    cut(s, s->slots[inst.x]);
+                    pc++;
+                    break;
+                case OpProgress:
+                    pc = position == s->slots[inst.x] ? inst.y : pc + 1;
+                    break;
+                case OpMatch:
+                    memcpy(slots, s->slots, p->slot_count * sizeof(size_t));
+                    return BacktrackMatch;
+            }
+            if (!next) break;
+        }
+    }
+    return BacktrackNoMatch;
+}
+
+BacktrackResult backtrack_search(
+    BacktrackScratch* s, const char* input, size_t length,
+    size_t start, bool anchored, const Prefilter* prefilter, size_t budget, size_t* slots
+) {
+    const Program* p = s->program;
+    Backtracker b = (Backtracker) {
+        .scratch = s,
+        .program = p,
+        .input = input,
+        .length = length,
+        .start = start,
+        .columns = length - start + 1,
+        .use_visited = false,
+        .budget = budget == 0 ? BACKTRACK_STEP_BUDGET : budget,
+    };
+
+    // Failing from (pc, position) does not depend on the path there unless a backreference
+    // looks at captures, so the bitmap holds across all start positions
+    size_t words = ((size_t)p->length * b.columns + 63) / 64;
+    if (!p->has_backreferences && b.columns <= BACKTRACK_VISITED_MAX * 8 / p->length) {
+        if (words > s->visited_capacity) {
+            free(s->visited);
+            s->visited = malloc(words * sizeof(uint64_t));
+            // Without memory for the bitmap the search runs under the step budget
+            s->visited_capacity = s->visited == NULL ? 0 : words;
+        }
+        b.use_visited = words <= s->visited_capacity;
+        if (b.use_visited) memset(s->visited, 0, words * sizeof(uint64_t));
+    }
+    // Failed paths undo their captures, so slots are back to this after each start position
+    for (uint32_t i = 0;i < p->slot_count + p->register_count;i++) s->slots[i] = NO_POSITION;
+
+    for (size_t position = start;position <= length;position++) {
+        if (prefilter != NULL && !anchored) {
+            position = prefilter_find(prefilter, input, length, position);
+            if (position == NO_POSITION) break;
+        }
+        BacktrackResult result = run(&b, position, slots);
+        if (result != BacktrackNoMatch || anchored) return result;
+    }
+    return BacktrackNoMatch;
+}
@@ -0,0 +1,76 @@
+#ifndef BACKTRACK_H
+#define BACKTRACK_H
+
+#include "../compiler/program.h"
+#include "../prefilter/prefilter.h"
+
+// Backtracker tries the alternatives of a program one after another in priority order,
+// the first match found is the leftmost-first one
+// It runs every instruction, including backreferences and atomic parts the automata can not,
+// with an explicit stack instead of recursion
+// Without backreferences a bitmap of visited (instruction, position) pairs stops it from
+// trying a pair twice, so a search takes O(program length * input length) steps
+// With them no such bound exists and a search gives up after a budget of steps
+// Inside atomic parts a pair failing once may succeed from another start of the part, so
+// there steps are not marked but counted against the budget
+
+// Steps a search may take outside of the visited bitmap, when none is given
+#define BACKTRACK_STEP_BUDGET (1 << 26)
+
+// Largest visited bitmap of a search in bytes, longer inputs run under the step budget
+#define BACKTRACK_VISITED_MAX (64 << 20)
+
+enum _BacktrackResult {
+    BacktrackNoMatch,
+    BacktrackMatch,
+    // The step budget ran out, or the stack could not grow, before the search could tell
+    BacktrackGaveUp,
+};
+
+typedef enum _BacktrackResult BacktrackResult;
+
+// Alternative left to try or capture to undo, popped when the path being followed fails
+struct _BacktrackFrame {
+    // Put 'position' back in slot 'index' when set, otherwise try instruction 'index' at 'position'
+    bool restore;
+    uint32_t index;
+    size_t position;
+};
+
+typedef struct _BacktrackFrame BacktrackFrame;
+
+// Memory of the searches of one program, reused so searches only allocate to grow it
+// A scratch is used by one search at a time
+struct _BacktrackScratch {
+    const Program* program;
+    BacktrackFrame* stack;
+    size_t stack_count;
+    size_t stack_capacity;
+    // Capture slots then registers of the path being followed
+    size_t* slots;
+    // One bit per instruction and position
+    uint64_t* visited;
+    size_t visited_capacity;
+    // Free for the caller to receive the capture slots of a match
+    size_t* match_slots;
+    // Whether each instruction is inside an atomic part, where the bitmap is not used
+    bool* atomic;
+};
+
+typedef struct _BacktrackScratch BacktrackScratch;
+
+// Construct the scratch of searches of `p`, which must outlive it
+BacktrackScratch new_backtrack_scratch(const Program* p);
+
+void free_backtrack_scratch(BacktrackScratch* s);
+
+// Search `input` from `start` for the leftmost-first match of the program of `s`
+// Same arguments as pikevm_search, `budget` is the number of steps a search may take
+// outside of the visited bitmap (0 means BACKTRACK_STEP_BUDGET)
+// On a match fills `slots` with field 'slot_count' of the program entries
+BacktrackResult backtrack_search(
+    BacktrackScratch* s, const char* input, size_t length,
+    size_t start, bool anchored, const Prefilter* prefilter, size_t budget, size_t* slots
+);
+
+#endif
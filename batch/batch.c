@@ -0,0 +1,96 @@
+#include "./batch.h"
+
+// Arguments of one batch, shared by the tasks of a pool run
+struct _BatchRun {
+    RegexBatch* batch;
+    const char* const* inputs;
+    const size_t* lengths;
+    RegexResult* results;
+    // NULL for regex_batch_is_match
+    Match* matches;
+};
+
+typedef struct _BatchRun BatchRun;
+
+RegexBatch new_regex_batch(const Regex* r, ThreadPool* pool) {
+    size_t n = pool->worker_count;
+    RegexBatch b = (RegexBatch) {
+        .regex = r,
+        .pool = pool,
+        .workers = aligned_alloc(_Alignof(BatchWorker), n * sizeof(BatchWorker)),
+    };
+    for (size_t i = 0;i < n;i++) {
+        b.workers[i] = (BatchWorker){.scratch = new_scratch(r), .inputs = 0, .bytes = 0};
+    }
+    return b;
+}
+
+void free_regex_batch(RegexBatch* b) {
+    for (size_t i = 0;i < b->pool->worker_count;i++) free_scratch(&b->workers[i].scratch);
+    free(b->workers);
+}
+
+static void match_input(void* context, size_t worker, size_t index) {
+    BatchRun* run = context;
+    BatchWorker* w = &run->batch->workers[worker];
+    const char* input = run->inputs[index];
+    size_t length = run->lengths[index];
+    if (run->matches == NULL) {
+        run->results[index] = scratch_is_match(&w->scratch, input, length);
+    } else {
+        run->results[index] = scratch_captures(&w->scratch, input, length, &run->matches[index], 1);
+    }
+    w->inputs++;
+    w->bytes += length;
+}
+
+static void run_batch(BatchRun* run, size_t count, BatchWorkerStats* stats) {
+    RegexBatch* b = run->batch;
+    size_t n = b->pool->worker_count;
+    for (size_t i = 0;i < n;i++) {
+        b->workers[i].inputs = 0;
+        b->workers[i].bytes = 0;
+    }
+
+    PoolWorkerStats* pool_stats = stats == NULL ? NULL : malloc(n * sizeof(PoolWorkerStats));
+    pool_run(b->pool, count, match_input, run, pool_stats);
+
+    if (stats == NULL) return;
+    for (size_t i = 0;i < n;i++) {
+        stats[i] = (BatchWorkerStats) {
+            .inputs = b->workers[i].inputs,
+            .bytes = b->workers[i].bytes,
+            .steals = pool_stats[i].steals,
+            .seconds = pool_stats[i].seconds,
+        };
+    }
+    free(pool_stats);
+}
+
+void regex_batch_is_match(
+    RegexBatch* b, const char* const* inputs, const size_t* lengths, size_t count,
+    RegexResult* results, BatchWorkerStats* stats
+) {
+    BatchRun run = (BatchRun) {
+        .batch = b,
+        .inputs = inputs,
+        .lengths = lengths,
+        .results = results,
+        .matches = NULL,
+    };
+    run_batch(&run, count, stats);
+}
+
+void regex_batch_find(
+    RegexBatch* b, const char* const* inputs, const size_t* lengths, size_t count,
+    RegexResult* results, Match* matches, BatchWorkerStats* stats
+) {
+    BatchRun run = (BatchRun) {
+        .batch = b,
+        .inputs = inputs,
+        .lengths = lengths,
+        .results = results,
+        .matches = matches,
+    };
+    run_batch(&run, count, stats);
+}
@@ -0,0 +1,61 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "../regex/regex.h"
+#include "../pool/pool.h"
+
+// Matching of one compiled pattern against many inputs on a thread pool
+// The Regex is only read, each worker searches with its own Scratch so workers never take a
+// lock while matching, and the DFA states a worker builds serve it for the following batches
+
+// Search state of one worker, on its own cache lines
+struct _BatchWorker {
+    _Alignas(64) Scratch scratch;
+    // Inputs and bytes searched during the current run
+    size_t inputs;
+    size_t bytes;
+};
+
+typedef struct _BatchWorker BatchWorker;
+
+struct _RegexBatch {
+    const Regex* regex;
+    ThreadPool* pool;
+    // One per thread of the pool
+    BatchWorker* workers;
+};
+
+typedef struct _RegexBatch RegexBatch;
+
+// Counters of one worker during the last batch
+struct _BatchWorkerStats {
+    size_t inputs;
+    size_t bytes;
+    // Times the worker took inputs left to another worker
+    size_t steals;
+    double seconds;
+};
+
+typedef struct _BatchWorkerStats BatchWorkerStats;
+
+// Construct the state for matching `r` on the threads of `pool`, both must outlive it
+RegexBatch new_regex_batch(const Regex* r, ThreadPool* pool);
+
+void free_regex_batch(RegexBatch* b);
+
+// Set results[i] to the result of regex_is_match on inputs[i], of length lengths[i], for i in [0, count)
+// Counters of worker i are written to stats[i] when `stats` is not NULL,
+// it then holds as many elements as the pool has threads
+void regex_batch_is_match(
+    RegexBatch* b, const char* const* inputs, const size_t* lengths, size_t count,
+    RegexResult* results, BatchWorkerStats* stats
+);
+
+// Same as regex_batch_is_match, also setting matches[i] to the leftmost match of inputs[i]
+// when results[i] is RegexMatch
+void regex_batch_find(
+    RegexBatch* b, const char* const* inputs, const size_t* lengths, size_t count,
+    RegexResult* results, Match* matches, BatchWorkerStats* stats
+);
+
+#endif
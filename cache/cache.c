@@ -0,0 +1,173 @@
+#include "./cache.h"
+
+// FNV-1a over the pattern then the flags
+static uint64_t hash_key(const char* pattern, size_t length, uint32_t flags) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0;i < length;i++) h = (h ^ (unsigned char)pattern[i]) * 1099511628211ull;
+    h = (h ^ flags) * 1099511628211ull;
+    return h ^ (h >> 29);
+}
+
+RegexCache* new_regex_cache(size_t capacity) {
+    if (capacity == 0) capacity = CACHE_CAPACITY;
+    size_t shard_capacity = (capacity + CACHE_SHARDS - 1) / CACHE_SHARDS;
+    size_t bucket_count = 1;
+    while (bucket_count < 2 * shard_capacity) bucket_count *= 2;
+
+    RegexCache* c = malloc(sizeof(RegexCache));
+    for (size_t i = 0;i < CACHE_SHARDS;i++) {
+        CacheShard* shard = &c->shards[i];
+        pthread_rwlock_init(&shard->lock, NULL);
+        shard->buckets = calloc(bucket_count, sizeof(CacheEntry*));
+        shard->bucket_count = bucket_count;
+        shard->slots = malloc(shard_capacity * sizeof(CacheEntry*));
+        shard->count = 0;
+        shard->capacity = shard_capacity;
+        shard->hand = 0;
+        atomic_init(&shard->hits, 0);
+        atomic_init(&shard->misses, 0);
+        atomic_init(&shard->evictions, 0);
+    }
+    return c;
+}
+
+static void free_entry(CacheEntry* e) {
+    free_regex(e->regex);
+    free(e);
+}
+
+void free_regex_cache(RegexCache* c) {
+    for (size_t i = 0;i < CACHE_SHARDS;i++) {
+        CacheShard* shard = &c->shards[i];
+        for (size_t k = 0;k < shard->count;k++) free_entry(shard->slots[k]);
+        free(shard->buckets);
+        free(shard->slots);
+        pthread_rwlock_destroy(&shard->lock);
+    }
+    free(c);
+}
+
+static CacheShard* shard_of(RegexCache* c, uint64_t hash) {
+    // Low bits pick the bucket inside the shard
+    return &c->shards[(hash >> 56) % CACHE_SHARDS];
+}
+
+// Entry of the key in `shard`, NULL when missing, the shard lock must be held
+static CacheEntry* lookup(CacheShard* shard, uint64_t hash, const char* pattern, size_t length, uint32_t flags) {
+    for (CacheEntry* e = shard->buckets[hash & (shard->bucket_count - 1)];e != NULL;e = e->next) {
+        const Regex* r = e->regex;
+        if (
+            e->hash == hash && r->flags == flags && r->pattern_length == length &&
+            memcmp(r->pattern, pattern, length) == 0
+        ) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// Take a reference on `e` for the caller of regex_cache_get
+static CacheEntry* acquire(CacheEntry* e) {
+    atomic_fetch_add_explicit(&e->references, 1, memory_order_relaxed);
+    // Avoid writing a shared cache line when the bit is already set
+    if (!atomic_load_explicit(&e->referenced, memory_order_relaxed)) {
+        atomic_store_explicit(&e->referenced, true, memory_order_relaxed);
+    }
+    return e;
+}
+
+static void unlink_entry(CacheShard* shard, CacheEntry* e) {
+    CacheEntry** link = &shard->buckets[e->hash & (shard->bucket_count - 1)];
+    while (*link != e) link = &(*link)->next;
+    *link = e->next;
+}
+
+// Move the CLOCK hand to the first entry not referenced since its last pass, clearing the
+// bits it passes over, and remove that entry
+// Returns the slot it was in, the write lock must be held
+static size_t evict(CacheShard* shard) {
+    while (atomic_exchange_explicit(&shard->slots[shard->hand]->referenced, false, memory_order_relaxed)) {
+        shard->hand = (shard->hand + 1) % shard->count;
+    }
+    size_t slot = shard->hand;
+    shard->hand = (shard->hand + 1) % shard->count;
+
+    CacheEntry* e = shard->slots[slot];
+    unlink_entry(shard, e);
+    atomic_fetch_add_explicit(&shard->evictions, 1, memory_order_relaxed);
+    // The cache's own reference, callers still using the entry keep it alive
+    regex_cache_release(e);
+    return slot;
+}
+
+CacheEntry* regex_cache_get(RegexCache* c, const char* pattern, size_t length, uint32_t flags, PatternError* error) {
+    uint64_t hash = hash_key(pattern, length, flags);
+    CacheShard* shard = shard_of(c, hash);
+
+    pthread_rwlock_rdlock(&shard->lock);
+    CacheEntry* e = lookup(shard, hash, pattern, length, flags);
+    if (e != NULL) acquire(e);
+    pthread_rwlock_unlock(&shard->lock);
+    if (e != NULL) {
+        atomic_fetch_add_explicit(&shard->hits, 1, memory_order_relaxed);
+        if (error != NULL) *error = NO_PATTERN_ERROR;
+        return e;
+    }
+
+    // Compile without holding the lock, other threads may look up the shard meanwhile
+    // Invalid patterns are not cached, they are cheap to reject again
+    atomic_fetch_add_explicit(&shard->misses, 1, memory_order_relaxed);
+    Regex* regex = regex_compile(pattern, length, flags, error);
+    if (regex == NULL) return NULL;
+    CacheEntry* created = malloc(sizeof(CacheEntry));
+    if (created == NULL) {
+        free_regex(regex);
+        if (error != NULL) {
+            *error = (PatternError){.code = OutOfMemoryError, .position = 0, .span = length, .pattern = 0};
+        }
+        return NULL;
+    }
+    *created = (CacheEntry) {
+        .hash = hash,
+        .regex = regex,
+        .next = NULL,
+    };
+    // One reference for the cache, one for the caller
+    atomic_init(&created->references, 2);
+    atomic_init(&created->referenced, false);
+
+    pthread_rwlock_wrlock(&shard->lock);
+    e = lookup(shard, hash, pattern, length, flags);
+    if (e != NULL) {
+        // Another thread compiled the same pattern first
+        acquire(e);
+        pthread_rwlock_unlock(&shard->lock);
+        free_entry(created);
+        return e;
+    }
+    size_t slot = shard->count < shard->capacity ? shard->count++ : evict(shard);
+    shard->slots[slot] = created;
+    CacheEntry** bucket = &shard->buckets[hash & (shard->bucket_count - 1)];
+    created->next = *bucket;
+    *bucket = created;
+    pthread_rwlock_unlock(&shard->lock);
+    return created;
+}
+
+void regex_cache_release(CacheEntry* e) {
+    if (atomic_fetch_sub_explicit(&e->references, 1, memory_order_acq_rel) == 1) free_entry(e);
+}
+
+CacheStats regex_cache_stats(RegexCache* c) {
+    CacheStats stats = (CacheStats){.hits = 0, .misses = 0, .evictions = 0, .count = 0};
+    for (size_t i = 0;i < CACHE_SHARDS;i++) {
+        CacheShard* shard = &c->shards[i];
+        stats.hits += atomic_load_explicit(&shard->hits, memory_order_relaxed);
+        stats.misses += atomic_load_explicit(&shard->misses, memory_order_relaxed);
+        stats.evictions += atomic_load_explicit(&shard->evictions, memory_order_relaxed);
+        pthread_rwlock_rdlock(&shard->lock);
+        stats.count += shard->count;
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    return stats;
+}
@@ -0,0 +1,86 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "../regex/regex.h"
+
+// Compiled pattern cache: compiling a pattern again is a hash lookup
+// Entries are spread over shards by hash, each shard has its own lock so threads looking up
+// different patterns do not wait on each other, and lookups only take it for reading
+// A shard holding too many entries evicts one chosen by the CLOCK algorithm
+
+// Number of shards of a cache
+#define CACHE_SHARDS 16
+
+// Entries of a cache when no capacity is given
+#define CACHE_CAPACITY 1024
+
+// Cached compiled pattern, returned by regex_cache_get and given back with regex_cache_release
+struct _CacheEntry {
+    uint64_t hash;
+    // Compiled pattern, its fields 'pattern' and 'flags' are the key
+    Regex* regex;
+    // One for the cache while the entry is in it, one per regex_cache_get not released yet
+    atomic_size_t references;
+    // Set by lookups, cleared by the CLOCK hand passing by, evicted when the hand finds it clear
+    atomic_bool referenced;
+    // Next entry of the same hash table bucket
+    struct _CacheEntry* next;
+};
+
+typedef struct _CacheEntry CacheEntry;
+
+struct _CacheShard {
+    pthread_rwlock_t lock;
+    // Hash table of entries chained through field 'next', bucket_count is a power of two
+    CacheEntry** buckets;
+    size_t bucket_count;
+    // Entries in insertion slots, the CLOCK hand goes around them
+    CacheEntry** slots;
+    size_t count;
+    size_t capacity;
+    size_t hand;
+    atomic_size_t hits;
+    atomic_size_t misses;
+    atomic_size_t evictions;
+};
+
+typedef struct _CacheShard CacheShard;
+
+// Thread-safe bounded cache of compiled patterns keyed by pattern bytes and flags
+struct _RegexCache {
+    CacheShard shards[CACHE_SHARDS];
+};
+
+typedef struct _RegexCache RegexCache;
+
+// Counters of a cache, summed over its shards
+struct _CacheStats {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t count;
+};
+
+typedef struct _CacheStats CacheStats;
+
+// Construct a cache holding about `capacity` compiled patterns (0 means CACHE_CAPACITY)
+// Locks can not be copied, so a cache never moves
+RegexCache* new_regex_cache(size_t capacity);
+
+// Release every entry and the RegexCache itself, entries got from it must be released before
+void free_regex_cache(RegexCache* c);
+
+// Compiled pattern of `pattern` with `flags`, compiling it on a miss
+// The entry stays valid until given back with regex_cache_release, even when evicted meanwhile
+// Returns NULL if the pattern is invalid or memory runs out, `error` (when not NULL) tells why
+CacheEntry* regex_cache_get(RegexCache* c, const char* pattern, size_t length, uint32_t flags, PatternError* error);
+
+// Give back an entry from regex_cache_get
+void regex_cache_release(CacheEntry* e);
+
+CacheStats regex_cache_stats(RegexCache* c);
+
+#endif
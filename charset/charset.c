@@ -0,0 +1,176 @@
+#include "./charset.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#include <stdatomic.h>
+#define CHARSET_X86
+#endif
+
+const CharSet DIGIT_CHARSET = {
+    .bits = {0x03FF000000000000ull, 0, 0, 0},
+    .low_table = {0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0, 0, 0, 0, 0, 0},
+    .high_table = {0},
+};
+
+const CharSet WHITESPACE_CHARSET = {
+    .bits = {0x0000000100003E00ull, 0, 0, 0},
+    .low_table = {0x04, 0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0x01, 0x01, 0x01, 0x01, 0, 0},
+    .high_table = {0},
+};
+
+const CharSet WORD_CHARSET = {
+    .bits = {0x03FF000000000000ull, 0x07FFFFFE87FFFFFEull, 0, 0},
+    .low_table = {
+        0xA8, 0xF8, 0xF8, 0xF8, 0xF8, 0xF8, 0xF8, 0xF8,
+        0xF8, 0xF8, 0xF0, 0x50, 0x50, 0x50, 0x50, 0x70,
+    },
+    .high_table = {0},
+};
+
+CharSet new_charset(void) {
+    CharSet s;
+    memset(&s, 0, sizeof(CharSet));
+    return s;
+}
+
+static void add_char(CharSet* s, unsigned char c) {
+    s->bits[c >> 6] |= 1ull << (c & 63);
+    uint8_t* table = c < 0x80 ? s->low_table : s->high_table;
+    table[c & 0xF] |= 1 << ((c >> 4) & 7);
+}
+
+void charset_add_range(CharSet* s, unsigned char low, unsigned char high) {
+    for (unsigned c = low;c <= high;c++) add_char(s, c);
+}
+
+void charset_add_set(CharSet* s, const CharSet* other) {
+    for (int i = 0;i < 4;i++) s->bits[i] |= other->bits[i];
+    for (int i = 0;i < 16;i++) {
+        s->low_table[i] |= other->low_table[i];
+        s->high_table[i] |= other->high_table[i];
+    }
+}
+
+CharSet charset_complement(const CharSet* s) {
+    CharSet r;
+    for (int i = 0;i < 4;i++) r.bits[i] = ~s->bits[i];
+    for (int i = 0;i < 16;i++) {
+        r.low_table[i] = ~s->low_table[i];
+        r.high_table[i] = ~s->high_table[i];
+    }
+    return r;
+}
+
+bool charset_contains(const CharSet* s, unsigned char c) {
+    return (s->bits[c >> 6] >> (c & 63)) & 1;
+}
+
+uint32_t charset_count(const CharSet* s) {
+    uint32_t count = 0;
+    for (int i = 0;i < 4;i++) count += __builtin_popcountll(s->bits[i]);
+    return count;
+}
+
+// First position at or after `from` whose character belongs to `s` when `member`,
+// does not belong to it otherwise
+static size_t scan_scalar(const CharSet* s, const char* input, size_t length, size_t from, bool member) {
+    for (size_t i = from;i < length;i++) {
+        if (charset_contains(s, input[i]) == member) return i;
+    }
+    return length;
+}
+
+#ifdef CHARSET_X86
+
+// 0 without SSSE3, 1 with SSSE3, 2 with AVX2
+static int simd_level(void) {
+    // Atomic as searches of several threads may ask first at once
+    static atomic_int level = -1;
+    int known = atomic_load_explicit(&level, memory_order_relaxed);
+    if (known < 0) {
+        known = __builtin_cpu_supports("avx2") ? 2 : __builtin_cpu_supports("ssse3") ? 1 : 0;
+        atomic_store_explicit(&level, known, memory_order_relaxed);
+    }
+    return known;
+}
+
+// Each of the 16 characters of a block takes the entry of its low nibble from both tables,
+// keeps the one of the table its top bit selects, then the bit of its high nibble
+__attribute__((target("ssse3")))
+static size_t scan_ssse3(const CharSet* s, const char* input, size_t length, size_t from, bool member) {
+    const __m128i nibble = _mm_set1_epi8(0xF);
+    const __m128i low_table = _mm_loadu_si128((const __m128i*)s->low_table);
+    const __m128i high_table = _mm_loadu_si128((const __m128i*)s->high_table);
+    const __m128i bit_table = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    unsigned flip = member ? 0 : 0xFFFF;
+    size_t i = from;
+    for (;i + 16 <= length;i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(input + i));
+        __m128i low = _mm_and_si128(block, nibble);
+        __m128i high = _mm_and_si128(_mm_srli_epi16(block, 4), nibble);
+        // Characters from 0x80 are negative as signed bytes
+        __m128i upper = _mm_cmplt_epi8(block, _mm_setzero_si128());
+        __m128i entries = _mm_or_si128(
+            _mm_andnot_si128(upper, _mm_shuffle_epi8(low_table, low)),
+            _mm_and_si128(upper, _mm_shuffle_epi8(high_table, low))
+        );
+        __m128i bits = _mm_shuffle_epi8(bit_table, high);
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(entries, bits), bits)) ^ flip;
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    return scan_scalar(s, input, length, i, member);
+}
+
+// Same as scan_ssse3 on 32 characters, shuffles work within each 16 byte half so both
+// halves get a copy of the tables
+__attribute__((target("avx2")))
+static size_t scan_avx2(const CharSet* s, const char* input, size_t length, size_t from, bool member) {
+    const __m256i nibble = _mm256_set1_epi8(0xF);
+    const __m256i low_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)s->low_table));
+    const __m256i high_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)s->high_table));
+    const __m256i bit_table = _mm256_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128
+    );
+    unsigned flip = member ? 0 : 0xFFFFFFFF;
+    size_t i = from;
+    for (;i + 32 <= length;i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(input + i));
+        __m256i low = _mm256_and_si256(block, nibble);
+        __m256i high = _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble);
+        __m256i upper = _mm256_cmpgt_epi8(_mm256_setzero_si256(), block);
+        __m256i entries = _mm256_or_si256(
+            _mm256_andnot_si256(upper, _mm256_shuffle_epi8(low_table, low)),
+            _mm256_and_si256(upper, _mm256_shuffle_epi8(high_table, low))
+        );
+        __m256i bits = _mm256_shuffle_epi8(bit_table, high);
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(entries, bits), bits)) ^ flip;
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    return scan_ssse3(s, input, length, i, member);
+}
+
+#endif
+
+static size_t scan(const CharSet* s, const char* input, size_t length, size_t from, bool member) {
+    // Runs are often short, the first character alone decides many scans
+    if (from >= length) return length;
+    if (charset_contains(s, input[from]) == member) return from;
+#ifdef CHARSET_X86
+    switch (simd_level()) {
+        case 2:
+            return scan_avx2(s, input, length, from + 1, member);
+        case 1:
+            return scan_ssse3(s, input, length, from + 1, member);
+    }
+#endif
+    return scan_scalar(s, input, length, from + 1, member);
+}
+
+size_t charset_find(const CharSet* s, const char* input, size_t length, size_t from) {
+    return scan(s, input, length, from, true);
+}
+
+size_t charset_skip(const CharSet* s, const char* input, size_t length, size_t from) {
+    return scan(s, input, length, from, false);
+}
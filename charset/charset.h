@@ -0,0 +1,55 @@
+#ifndef CHARSET_H
+#define CHARSET_H
+
+#include <stdint.h>
+#include "../common.h"
+
+// Character set as a 256 bit bitmap, testing a character is one bit lookup
+// The same set is kept as two nibble tables so vectorized loops test 16 or 32 characters
+// at once: the low 4 bits of a character pick a table entry with pshufb, the high 4 bits
+// pick the bit of that entry
+
+struct _CharSet {
+    // Bit (c % 64) of word (c / 64) is set when character c belongs to the set
+    uint64_t bits[4];
+    // Entry (c & 0xF) of each table has bit ((c >> 4) & 7) set when character c belongs to
+    // the set, low_table for characters below 0x80, high_table for the others
+    uint8_t low_table[16];
+    uint8_t high_table[16];
+};
+
+typedef struct _CharSet CharSet;
+
+// Canonical sets of \d, \s and \w, shared by every program using them
+extern const CharSet DIGIT_CHARSET;
+extern const CharSet WHITESPACE_CHARSET;
+extern const CharSet WORD_CHARSET;
+
+// Construct an empty set
+CharSet new_charset(void);
+
+// Add characters `low` to `high` (included) to `s`
+void charset_add_range(CharSet* s, unsigned char low, unsigned char high);
+
+// Add every character of `other` to `s`
+void charset_add_set(CharSet* s, const CharSet* other);
+
+// Set of the characters not in `s`
+CharSet charset_complement(const CharSet* s);
+
+// Whether character `c` belongs to `s`
+bool charset_contains(const CharSet* s, unsigned char c);
+
+// Number of characters in `s`
+uint32_t charset_count(const CharSet* s);
+
+// Position of the first character of `input` at or after `from` belonging to `s`,
+// `length` when there is none
+// Uses AVX2 when the processor has it, SSSE3 otherwise, one character at a time without either
+size_t charset_find(const CharSet* s, const char* input, size_t length, size_t from);
+
+// Position of the first character of `input` at or after `from` not belonging to `s`,
+// `length` when there is none, so the run of characters of `s` starting at `from` ends there
+size_t charset_skip(const CharSet* s, const char* input, size_t length, size_t from);
+
+#endif
@@ -0,0 +1,505 @@
+#include "./compiler.h"
+
+static uint32_t emit(Compiler* c, Opcode op, uint32_t x, uint32_t y) {
+    Program* p = &c->program;
+    if (p->length == c->instruction_capacity) {
+        if (p->length == PROGRAM_MAX_INSTRUCTIONS) {
+            // The program is dropped, compile_node stops and later instructions are not kept
+            if (c->error.code == NoError) {
+                c->error = (PatternError) {
+                    .code = PatternTooLargeError, .position = 0, .span = c->ast->source_length, .pattern = 0,
+                };
+            }
+            return p->length - 1;
+        }
+        uint32_t capacity = c->instruction_capacity == 0 ? 32 : 2 * c->instruction_capacity;
+        p->instructions = arena_grow(
+            c->arena, p->instructions,
+            c->instruction_capacity * sizeof(Instruction), capacity * sizeof(Instruction)
+        );
+        c->instruction_capacity = capacity;
+    }
+    p->instructions[p->length] = (Instruction){.op = op, .x = x, .y = y};
+    return p->length++;
+}
+
+static void push_range(Compiler* c, unsigned char low, unsigned char high) {
+    Program* p = &c->program;
+    if (p->range_count == c->range_capacity) {
+        uint32_t capacity = c->range_capacity == 0 ? 32 : 2 * c->range_capacity;
+        p->ranges = arena_grow(
+            c->arena, p->ranges,
+            c->range_capacity * sizeof(ClassRange), capacity * sizeof(ClassRange)
+        );
+        c->range_capacity = capacity;
+    }
+    p->ranges[p->range_count++] = (ClassRange){.low = low, .high = high};
+}
+
+static int compare_ranges(const void* a, const void* b) {
+    const ClassRange* x = a;
+    const ClassRange* y = b;
+    if (x->low != y->low) return x->low - y->low;
+    return x->high - y->high;
+}
+
+// Add a class made of `count` ranges in any order, complemented when `negated`
+// Returns the class number
+static uint32_t add_class(Compiler* c, const ClassRange* ranges, uint32_t count, bool negated) {
+    ClassRange* input = arena_alloc(c->arena, count * sizeof(ClassRange));
+    memcpy(input, ranges, count * sizeof(ClassRange));
+    qsort(input, count, sizeof(ClassRange), compare_ranges);
+
+    // Merge overlapping and adjacent ranges, at most 128 remain
+    ClassRange sorted[128];
+    uint32_t sorted_count = 0;
+    for (uint32_t i = 0;i < count;i++) {
+        ClassRange r = input[i];
+        if (sorted_count > 0 && r.low <= sorted[sorted_count - 1].high + 1) {
+            if (r.high > sorted[sorted_count - 1].high) sorted[sorted_count - 1].high = r.high;
+        } else {
+            sorted[sorted_count++] = r;
+        }
+    }
+
+    Program* p = &c->program;
+    uint32_t start = p->range_count;
+    if (negated) {
+        unsigned next = 0;
+        for (uint32_t i = 0;i < sorted_count;i++) {
+            if (sorted[i].low > next) push_range(c, next, sorted[i].low - 1);
+            next = sorted[i].high + 1;
+        }
+        if (next <= 255) push_range(c, next, 255);
+    } else {
+        for (uint32_t i = 0;i < sorted_count;i++) push_range(c, sorted[i].low, sorted[i].high);
+    }
+
+    if (p->class_count == c->class_capacity) {
+        uint32_t capacity = c->class_capacity == 0 ? 8 : 2 * c->class_capacity;
+        p->classes = arena_grow(
+            c->arena, p->classes,
+            c->class_capacity * sizeof(ProgramClass), capacity * sizeof(ProgramClass)
+        );
+        c->class_capacity = capacity;
+    }
+    CharSet set = new_charset();
+    for (uint32_t i = start;i < p->range_count;i++) charset_add_range(&set, p->ranges[i].low, p->ranges[i].high);
+    p->classes[p->class_count] = (ProgramClass){.start = start, .count = p->range_count - start, .set = set};
+    return p->class_count++;
+}
+
+// Emit a class instruction, or a byte instruction when the class has a single character
+static void emit_class(Compiler* c, const ClassRange* ranges, uint32_t count, bool negated) {
+    if (!negated && count == 1 && ranges[0].low == ranges[0].high) {
+        emit(c, OpByte, ranges[0].low, 0);
+        return;
+    }
+    emit(c, OpClass, add_class(c, ranges, count, negated), 0);
+}
+
+static const ClassRange DIGIT_RANGES[] = {{'0', '9'}};
+static const ClassRange WHITESPACE_RANGES[] = {{'\t', '\r'}, {' ', ' '}};
+static const ClassRange WORD_RANGES[] = {{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}};
+static const ClassRange NEWLINE_RANGES[] = {{'\n', '\n'}};
+
+// Every \d, \s and \w of a program (or their negations) is one class with the canonical set
+static void emit_slash_class(Compiler* c, TokenType t) {
+    SlashClass kind;
+    bool negated;
+    switch (t) {
+        case DigitClass:
+        case NonDigitClass:
+            kind = SlashDigit;
+            negated = t == NonDigitClass;
+            break;
+        case WhitespaceClass:
+        case NonWhitespaceClass:
+            kind = SlashWhitespace;
+            negated = t == NonWhitespaceClass;
+            break;
+        case WordCharacterClass:
+        case NonWordCharacterClass:
+        default:
+            kind = SlashWord;
+            negated = t == NonWordCharacterClass;
+            break;
+    }
+
+    uint32_t* class = &c->slash_classes[kind][negated];
+    if (*class == COMPILER_NO_CLASS) {
+        static const ClassRange* const RANGES[] = {DIGIT_RANGES, WHITESPACE_RANGES, WORD_RANGES};
+        static const uint32_t COUNTS[] = {1, 2, 4};
+        static const CharSet* const SETS[] = {&DIGIT_CHARSET, &WHITESPACE_CHARSET, &WORD_CHARSET};
+        *class = add_class(c, RANGES[kind], COUNTS[kind], negated);
+        c->program.classes[*class].set = negated ? charset_complement(SETS[kind]) : *SETS[kind];
+    }
+    emit(c, OpClass, *class, 0);
+}
+
+static void compile_node(Compiler* c, NodeIndex index);
+
+// Whether node `index` can match the empty string
+static bool can_be_empty(const Ast* ast, NodeIndex index) {
+    const Node* node = &ast->nodes[index];
+    switch (node->type) {
+        case EmptyNode:
+        case AssertNode:
+        case BackreferenceNode:
+            return true;
+        case LiteralNode:
+            return node->literal.length == 0;
+        case GroupNode:
+            return can_be_empty(ast, node->first_child);
+        case RepeatNode:
+            return node->repeat.min == 0 || can_be_empty(ast, node->first_child);
+        case ConcatenationNode:
+            for (NodeIndex child = node->first_child;child != NO_NODE;child = ast->nodes[child].next_sibling) {
+                if (!can_be_empty(ast, child)) return false;
+            }
+            return true;
+        case AlternationNode:
+            for (NodeIndex child = node->first_child;child != NO_NODE;child = ast->nodes[child].next_sibling) {
+                if (can_be_empty(ast, child)) return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+static bool has_backreferences(const Ast* ast) {
+    for (uint32_t i = 0;i < ast->node_count;i++) {
+        if (ast->nodes[i].type == BackreferenceNode) return true;
+    }
+    return false;
+}
+
+// Slot of a new register, registers follow the capture slots
+static uint32_t new_register(Compiler* c) {
+    return c->program.slot_count + c->program.register_count++;
+}
+
+// x{min,max}, greedy or lazy
+static void compile_counted_repeat(Compiler* c, const Node* node, bool greedy) {
+    uint32_t min = node->repeat.min;
+    uint32_t max = node->repeat.max;
+    NodeIndex child = node->first_child;
+    // Backreferences and atomic parts rule out the visited set of the backtracker, which
+    // otherwise ends loops over empty iterations, so the loop checks it made progress
+    bool unmarked = c->guard_empty_loops || c->atomic_depth > 0;
+    bool guard = max == REPEAT_INFINITY && unmarked && can_be_empty(c->ast, child);
+
+    if (max == REPEAT_INFINITY && min > 0 && !guard) {
+        // x{min,} is min - 1 copies of x followed by x+
+        for (uint32_t i = 1;i < min;i++) compile_node(c, child);
+        uint32_t loop = c->program.length;
+        compile_node(c, child);
+        uint32_t exit = c->program.length + 1;
+        if (greedy) emit(c, OpSplit, loop, exit);
+        else emit(c, OpSplit, exit, loop);
+        return;
+    }
+
+    for (uint32_t i = 0;i < min;i++) compile_node(c, child);
+
+    if (max == REPEAT_INFINITY) {
+        // x*, or with a guard L: split B, X; B: save r; x; progress r, X; jmp L; X:
+        uint32_t split = emit(c, OpSplit, 0, 0);
+        uint32_t r = guard ? new_register(c) : 0;
+        if (guard) emit(c, OpSave, r, 0);
+        compile_node(c, child);
+        uint32_t progress = guard ? emit(c, OpProgress, r, 0) : 0;
+        emit(c, OpJmp, split, 0);
+        uint32_t exit = c->program.length;
+        if (guard) c->program.instructions[progress].y = exit;
+        Instruction* inst = &c->program.instructions[split];
+        inst->x = greedy ? split + 1 : exit;
+        inst->y = greedy ? exit : split + 1;
+        return;
+    }
+
+    // max - min nested optional copies, x{0,3} is (x(x(x)?)?)?
+    uint32_t optional = max - min;
+    uint32_t* splits = arena_alloc(c->arena, (optional + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0;i < optional;i++) {
+        splits[i] = emit(c, OpSplit, 0, 0);
+        compile_node(c, child);
+    }
+    uint32_t exit = c->program.length;
+    for (uint32_t i = 0;i < optional;i++) {
+        Instruction* inst = &c->program.instructions[splits[i]];
+        inst->x = greedy ? splits[i] + 1 : exit;
+        inst->y = greedy ? exit : splits[i] + 1;
+    }
+}
+
+static void compile_repeat(Compiler* c, const Node* node) {
+    if (node->repeat.kind != PossessiveRepeat) {
+        compile_counted_repeat(c, node, node->repeat.kind == GreedyRepeat);
+        return;
+    }
+
+    // x{min,max}+ is the greedy repetition inside an atomic part,
+    // once it matched it keeps its longest match and is never backtracked into
+    uint32_t r = new_register(c);
+    c->program.needs_backtracking = true;
+    emit(c, OpAtomicStart, r, 0);
+    c->atomic_depth++;
+    compile_counted_repeat(c, node, true);
+    c->atomic_depth--;
+    emit(c, OpAtomicEnd, r, 0);
+}
+
+static void compile_alternation(Compiler* c, const Node* node) {
+    // Each branch but the last is preceded by a split to the next branch
+    // and followed by a jump past the last branch
+    uint32_t jumps_count = 0;
+    for (NodeIndex b = node->first_child;b != NO_NODE;b = c->ast->nodes[b].next_sibling) jumps_count++;
+    uint32_t* jumps = arena_alloc(c->arena, jumps_count * sizeof(uint32_t));
+
+    jumps_count = 0;
+    for (NodeIndex b = node->first_child;b != NO_NODE;b = c->ast->nodes[b].next_sibling) {
+        if (c->ast->nodes[b].next_sibling == NO_NODE) {
+            compile_node(c, b);
+            break;
+        }
+        uint32_t split = emit(c, OpSplit, 0, 0);
+        compile_node(c, b);
+        jumps[jumps_count++] = emit(c, OpJmp, 0, 0);
+        c->program.instructions[split].x = split + 1;
+        c->program.instructions[split].y = c->program.length;
+    }
+    for (uint32_t i = 0;i < jumps_count;i++) c->program.instructions[jumps[i]].x = c->program.length;
+}
+
+// Children of a concatenation from the last one to the first
+static void compile_reversed_concatenation(Compiler* c, const Node* node) {
+    uint32_t count = 0;
+    for (NodeIndex child = node->first_child;child != NO_NODE;child = c->ast->nodes[child].next_sibling) count++;
+    NodeIndex* children = arena_alloc(c->arena, count * sizeof(NodeIndex));
+
+    count = 0;
+    for (NodeIndex child = node->first_child;child != NO_NODE;child = c->ast->nodes[child].next_sibling) {
+        children[count++] = child;
+    }
+    while (count > 0) compile_node(c, children[--count]);
+}
+
+static void compile_node(Compiler* c, NodeIndex index) {
+    if (c->error.code != NoError) return;
+    const Node* node = &c->ast->nodes[index];
+    switch (node->type) {
+        case EmptyNode:
+            break;
+
+        case LiteralNode:
+            for (uint32_t i = 0;i < node->literal.length;i++) {
+                uint32_t k = c->reverse ? node->literal.length - 1 - i : i;
+                emit(c, OpByte, (unsigned char)c->ast->bytes[node->literal.start + k], 0);
+            }
+            break;
+
+        case DotNode:
+            emit_class(c, NEWLINE_RANGES, 1, true);
+            break;
+
+        case ClassNode:
+            emit_class(c, c->ast->ranges + node->class.start, node->class.count, node->class.negated);
+            break;
+
+        case SlashClassNode:
+            emit_slash_class(c, node->token);
+            break;
+
+        case AssertNode:
+            // Read backwards the start of the input is where the reversed input ends
+            switch (node->token) {
+                case StartAnchor:
+                    emit(c, OpAssert, c->reverse ? AssertEndText : AssertStartText, 0);
+                    break;
+                case EndAnchor:
+                    emit(c, OpAssert, c->reverse ? AssertStartText : AssertEndText, 0);
+                    break;
+                case WordBoundaryAnchor:
+                    emit(c, OpAssert, AssertWordBoundary, 0);
+                    break;
+                default:
+                    emit(c, OpAssert, AssertNotWordBoundary, 0);
+                    break;
+            }
+            break;
+
+        case BackreferenceNode:
+            emit(c, OpBackref, node->group, 0);
+            c->program.needs_backtracking = true;
+            c->program.has_backreferences = true;
+            break;
+
+        case GroupNode:
+            if (c->reverse) {
+                compile_node(c, node->first_child);
+                break;
+            }
+            emit(c, OpSave, 2 * node->group, 0);
+            compile_node(c, node->first_child);
+            emit(c, OpSave, 2 * node->group + 1, 0);
+            break;
+
+        case RepeatNode:
+            compile_repeat(c, node);
+            break;
+
+        case ConcatenationNode:
+            if (c->reverse) {
+                compile_reversed_concatenation(c, node);
+                break;
+            }
+            for (NodeIndex child = node->first_child;child != NO_NODE;child = c->ast->nodes[child].next_sibling) {
+                compile_node(c, child);
+            }
+            break;
+
+        case AlternationNode:
+            compile_alternation(c, node);
+            break;
+    }
+}
+
+// Split characters into classes: two characters share a class when every instruction
+// consuming one also consumes the other, and they agree on being \w when \b or \B is used
+static void compute_byte_classes(Program* p) {
+    // boundaries[c] when c starts a new class
+    bool boundaries[257] = {false};
+    bool uses_word_boundary = false;
+    for (uint32_t pc = 0;pc < p->length;pc++) {
+        Instruction inst = p->instructions[pc];
+        if (inst.op == OpByte) {
+            boundaries[inst.x] = true;
+            boundaries[inst.x + 1] = true;
+        } else if (inst.op == OpClass) {
+            const ProgramClass* k = &p->classes[inst.x];
+            for (uint32_t i = 0;i < k->count;i++) {
+                boundaries[p->ranges[k->start + i].low] = true;
+                boundaries[p->ranges[k->start + i].high + 1] = true;
+            }
+        } else if (inst.op == OpAssert) {
+            uses_word_boundary = uses_word_boundary ||
+                inst.x == AssertWordBoundary || inst.x == AssertNotWordBoundary;
+        }
+    }
+    if (uses_word_boundary) {
+        for (uint32_t c = 1;c < 256;c++) {
+            if (is_word_char(c) != is_word_char(c - 1)) boundaries[c] = true;
+        }
+    }
+
+    uint32_t class = 0;
+    for (uint32_t c = 0;c < 256;c++) {
+        if (c > 0 && boundaries[c]) class++;
+        p->byte_classes[c] = class;
+    }
+    p->byte_class_count = class + 1;
+}
+
+static Compiler new_compiler(Arena* arena, const Ast* ast) {
+    Compiler c = (Compiler) {
+        .arena = arena,
+        .ast = ast,
+        .program = (Program) {
+            .instructions = NULL,
+            .length = 0,
+            .classes = NULL,
+            .class_count = 0,
+            .ranges = NULL,
+            .range_count = 0,
+            .start = 0,
+            .start_unanchored = 0,
+            .slot_count = 2 * (ast->group_count + 1),
+            .register_count = 0,
+            .needs_backtracking = false,
+            .has_backreferences = false,
+            .pattern_count = 1,
+            .all_matches = false,
+            .reverse = false,
+        },
+        .instruction_capacity = 0,
+        .class_capacity = 0,
+        .range_capacity = 0,
+        .guard_empty_loops = has_backreferences(ast),
+        .atomic_depth = 0,
+        .reverse = false,
+        .error = NO_PATTERN_ERROR,
+    };
+    for (int kind = 0;kind < 3;kind++) {
+        c.slash_classes[kind][0] = COMPILER_NO_CLASS;
+        c.slash_classes[kind][1] = COMPILER_NO_CLASS;
+    }
+    return c;
+}
+
+// Unanchored prefix, lazily skip any character: L0: any; L1: split L2, L0
+// Skipping a character leads back to L1, so a DFA skipping characters stays in one state
+static void emit_unanchored_prefix(Compiler* c) {
+    static const ClassRange ANY_RANGES[] = {{0, 255}};
+    emit(c, OpClass, add_class(c, ANY_RANGES, 1, false), 0);
+    c->program.start_unanchored = emit(c, OpSplit, 2, 0);
+}
+
+Program compile_program(Arena* arena, const Ast* ast, PatternError* error) {
+    Compiler c = new_compiler(arena, ast);
+    emit_unanchored_prefix(&c);
+
+    c.program.start = emit(&c, OpSave, 0, 0);
+    compile_node(&c, ast->root);
+    emit(&c, OpSave, 1, 0);
+    emit(&c, OpMatch, 0, 0);
+    // Jumps of a dropped program may point anywhere, it is not read
+    if (c.error.code == NoError) compute_byte_classes(&c.program);
+    *error = c.error;
+    return c.program;
+}
+
+Program compile_program_reverse(Arena* arena, const Ast* ast) {
+    Compiler c = new_compiler(arena, ast);
+    c.reverse = true;
+    c.program.slot_count = 0;
+    c.program.reverse = true;
+    emit_unanchored_prefix(&c);
+
+    c.program.start = c.program.length;
+    compile_node(&c, ast->root);
+    emit(&c, OpMatch, 0, 0);
+    compute_byte_classes(&c.program);
+    return c.program;
+}
+
+Program compile_program_set(Arena* arena, const Ast* asts, uint32_t count, PatternError* error) {
+    Compiler c = new_compiler(arena, &asts[0]);
+    c.program.slot_count = 0;
+    c.program.pattern_count = count;
+    c.program.all_matches = true;
+    emit_unanchored_prefix(&c);
+
+    // start: split P0, L1; P0: pattern 0; match 0; L1: split P1, L2; ... the last pattern has no split
+    c.program.start = c.program.length;
+    for (uint32_t i = 0;i < count;i++) {
+        c.ast = &asts[i];
+        uint32_t split = i + 1 < count ? emit(&c, OpSplit, c.program.length + 1, 0) : 0;
+        compile_node(&c, asts[i].root);
+        if (c.program.needs_backtracking && c.error.code == NoError) {
+            c.error = (PatternError) {
+                .code = BacktrackingInSetError, .position = 0, .span = asts[i].source_length, .pattern = 0,
+            };
+        }
+        if (c.error.code != NoError) {
+            c.error.pattern = i;
+            break;
+        }
+        emit(&c, OpMatch, i, 0);
+        if (i + 1 < count) c.program.instructions[split].y = c.program.length;
+    }
+    if (c.error.code == NoError) compute_byte_classes(&c.program);
+    *error = c.error;
+    return c.program;
+}
@@ -0,0 +1,62 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "./program.h"
+
+// Largest number of instructions a program may have, counted repetitions like (x{1000}){1000} exceed it
+#define PROGRAM_MAX_INSTRUCTIONS (1 << 20)
+
+// Value of field 'slash_classes' of the Compiler before the class is added
+#define COMPILER_NO_CLASS UINT32_MAX
+
+// Kinds of slash classes, \D is a negated SlashDigit
+enum _SlashClass {
+    SlashDigit,
+    SlashWhitespace,
+    SlashWord,
+};
+
+typedef enum _SlashClass SlashClass;
+
+// Compiler data structure
+struct _Compiler {
+    Arena* arena;
+    const Ast* ast;
+    // Program being built, all arrays come from field 'arena'
+    Program program;
+    uint32_t instruction_capacity;
+    uint32_t class_capacity;
+    uint32_t range_capacity;
+    // Pattern has backreferences, loops whose body can match empty get an OpProgress check
+    bool guard_empty_loops;
+    // Possessive repetitions being compiled, loops inside them get the check too
+    uint32_t atomic_depth;
+    // Compiling the reversed program, see field 'reverse' of Program
+    bool reverse;
+    // Class number of each slash class, negated or not, COMPILER_NO_CLASS until first used
+    uint32_t slash_classes[3][2];
+    // First error, compilation stops at it
+    PatternError error;
+};
+
+typedef struct _Compiler Compiler;
+
+// Translate a syntax tree into a program, all memory comes from `arena`
+// Backreferences and possessive quantifiers give a program with field 'needs_backtracking' set
+// Fills `error`, with code PatternTooLargeError when the program would be too large and the
+// program must not be used then
+Program compile_program(Arena* arena, const Ast* ast, PatternError* error);
+
+// Translate a syntax tree into a program matching the reversed input, with field 'reverse' set
+// The program has no capture slots, \A and \Z trade places
+// The tree must have no backreference and no possessive quantifier, and compile with compile_program
+Program compile_program_reverse(Arena* arena, const Ast* ast);
+
+// Translate `count` (at least one) syntax trees into one program matching any of them,
+// OpMatch of the pattern number i ends tree i
+// The program has no capture slots and field 'all_matches' is set
+// Fills `error`, with code BacktrackingInSetError when a pattern has a backreference or a
+// possessive quantifier and field 'pattern' the number of the pattern
+Program compile_program_set(Arena* arena, const Ast* asts, uint32_t count, PatternError* error);
+
+#endif
@@ -0,0 +1,172 @@
+#include "./program.h"
+
+bool program_class_contains(const Program* p, uint32_t class, unsigned char c) {
+    return (p->classes[class].set.bits[c >> 6] >> (c & 63)) & 1;
+}
+
+bool is_word_char(unsigned char c) {
+    return (WORD_CHARSET.bits[c >> 6] >> (c & 63)) & 1;
+}
+
+bool assert_holds(uint32_t kind, const char* input, size_t length, size_t position) {
+    switch (kind) {
+        case AssertStartText:
+            return position == 0;
+        case AssertEndText:
+            return position == length;
+        default: {
+            bool word_before = position > 0 && is_word_char(input[position - 1]);
+            bool word_after = position < length && is_word_char(input[position]);
+            return (word_before != word_after) == (kind == AssertWordBoundary);
+        }
+    }
+}
+
+bool program_is_valid(const Program* p) {
+    if (p->length == 0 || p->start >= p->length || p->start_unanchored >= p->length) return false;
+    if (p->byte_class_count == 0 || p->byte_class_count > 256 || p->pattern_count == 0) return false;
+    // Each register is made for an instruction using it
+    if (p->register_count > p->length) return false;
+    for (uint32_t c = 0;c < 256;c++) {
+        if (p->byte_classes[c] >= p->byte_class_count) return false;
+    }
+    for (uint32_t i = 0;i < p->range_count;i++) {
+        if (p->ranges[i].low > p->ranges[i].high) return false;
+    }
+    for (uint32_t i = 0;i < p->class_count;i++) {
+        const ProgramClass* k = &p->classes[i];
+        if (k->start > p->range_count || k->count > p->range_count - k->start) return false;
+        CharSet set = new_charset();
+        for (uint32_t r = k->start;r < k->start + k->count;r++) charset_add_range(&set, p->ranges[r].low, p->ranges[r].high);
+        if (memcmp(&set, &k->set, sizeof(CharSet)) != 0) return false;
+    }
+
+    size_t registers = (size_t)p->slot_count + p->register_count;
+    bool backtracking = false;
+    bool backreferences = false;
+    for (uint32_t pc = 0;pc < p->length;pc++) {
+        Instruction inst = p->instructions[pc];
+        // Every instruction but jumps and matches goes on to the next one
+        bool next = inst.op != OpSplit && inst.op != OpJmp && inst.op != OpMatch;
+        if (next && pc + 1 >= p->length) return false;
+        bool valid;
+        switch (inst.op) {
+            case OpByte:
+                valid = inst.x < 256;
+                break;
+            case OpClass:
+                valid = inst.x < p->class_count;
+                break;
+            case OpSplit:
+                valid = inst.x < p->length && inst.y < p->length;
+                break;
+            case OpJmp:
+                valid = inst.x < p->length;
+                break;
+            case OpSave:
+                // Loops of the backtracker also save positions to registers
+                valid = inst.x < registers;
+                break;
+            case OpAssert:
+                valid = inst.x <= AssertNotWordBoundary;
+                break;
+            case OpMatch:
+                valid = inst.x < p->pattern_count;
+                break;
+            case OpBackref:
+                valid = 2 * (size_t)inst.x + 1 < p->slot_count;
+                backtracking = true;
+                backreferences = true;
+                break;
+            case OpAtomicStart:
+            case OpAtomicEnd:
+                valid = inst.x < registers;
+                backtracking = true;
+                break;
+            case OpProgress:
+                valid = inst.x < registers && inst.y < p->length;
+                backtracking = true;
+                break;
+            default:
+                valid = false;
+                break;
+        }
+        if (!valid) return false;
+    }
+    return backtracking == p->needs_backtracking && backreferences == p->has_backreferences;
+}
+
+static const char* assert_kind_name(uint32_t kind) {
+    switch (kind) {
+        case AssertStartText:
+            return "\\A";
+        case AssertEndText:
+            return "\\Z";
+        case AssertWordBoundary:
+            return "\\b";
+        case AssertNotWordBoundary:
+            return "\\B";
+    }
+    return "UNKNOWN";
+}
+
+static void print_char(unsigned char c) {
+    if (c >= 0x21 && c <= 0x7E) printf("%c", c);
+    else printf("\\x%02X", c);
+}
+
+void print_program(const Program* p) {
+    printf("%u byte classes, %u instructions" "\n", p->byte_class_count, p->length);
+    for (uint32_t pc = 0;pc < p->length;pc++) {
+        Instruction inst = p->instructions[pc];
+        printf("%4u%s ", pc, pc == p->start ? "*" : " ");
+        switch (inst.op) {
+            case OpByte:
+                printf("byte ");
+                print_char(inst.x);
+                break;
+            case OpClass:
+                printf("class %u [", inst.x);
+                const ProgramClass* k = &p->classes[inst.x];
+                for (uint32_t i = 0;i < k->count;i++) {
+                    ClassRange r = p->ranges[k->start + i];
+                    printf(" ");
+                    print_char(r.low);
+                    if (r.high != r.low) {
+                        printf("-");
+                        print_char(r.high);
+                    }
+                }
+                printf(" ]");
+                break;
+            case OpSplit:
+                printf("split %u, %u", inst.x, inst.y);
+                break;
+            case OpJmp:
+                printf("jmp %u", inst.x);
+                break;
+            case OpSave:
+                printf("save %u", inst.x);
+                break;
+            case OpAssert:
+                printf("assert %s", assert_kind_name(inst.x));
+                break;
+            case OpMatch:
+                printf("match %u", inst.x);
+                break;
+            case OpBackref:
+                printf("backref %u", inst.x);
+                break;
+            case OpAtomicStart:
+                printf("atomic %u", inst.x);
+                break;
+            case OpAtomicEnd:
+                printf("atomic_end %u", inst.x);
+                break;
+            case OpProgress:
+                printf("progress %u, %u", inst.x, inst.y);
+                break;
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,125 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <stdint.h>
+#include "../parser/parser.h"
+#include "../charset/charset.h"
+
+// Value of a capture slot whose group did not take part in the match
+#define NO_POSITION SIZE_MAX
+
+enum _Opcode {
+    // Consume the character in field 'x'
+    OpByte,
+    // Consume a character of class number 'x'
+    OpClass,
+    // Continue at both 'x' and 'y', 'x' has priority
+    OpSplit,
+    // Continue at 'x'
+    OpJmp,
+    // Record current position in capture slot 'x'
+    OpSave,
+    // Continue only if the zero-width assertion 'x' holds at current position
+    OpAssert,
+    // Input matched pattern number 'x' (always 0 outside of pattern sets)
+    OpMatch,
+    // Consume the text captured by group 'x', fail when the group is not set
+    OpBackref,
+    // Start an atomic part, record the backtracking stack height in slot 'x'
+    OpAtomicStart,
+    // End the atomic part started with slot 'x', alternatives left inside it are dropped
+    OpAtomicEnd,
+    // Continue at 'y' when the position did not move since slot 'x' was saved, otherwise at the
+    // next instruction, a loop iteration matching empty leaves the loop
+    OpProgress,
+};
+
+typedef enum _Opcode Opcode;
+
+enum _AssertKind {
+    // \A
+    AssertStartText,
+    // \Z
+    AssertEndText,
+    // \b
+    AssertWordBoundary,
+    // \B
+    AssertNotWordBoundary,
+};
+
+typedef enum _AssertKind AssertKind;
+
+struct _Instruction {
+    Opcode op;
+    uint32_t x;
+    uint32_t y;
+};
+
+typedef struct _Instruction Instruction;
+
+// Set of characters, slice of field 'ranges' of the Program
+// Ranges are sorted, disjoint and not adjacent
+struct _ProgramClass {
+    uint32_t start;
+    uint32_t count;
+    // Same characters as a bitmap, what engines test characters against
+    CharSet set;
+};
+
+typedef struct _ProgramClass ProgramClass;
+
+// Instructions of an automaton matching a pattern (a Thompson NFA)
+// Everything refers to other parts by index, so a program can be moved or copied freely
+struct _Program {
+    Instruction* instructions;
+    uint32_t length;
+    ProgramClass* classes;
+    uint32_t class_count;
+    ClassRange* ranges;
+    uint32_t range_count;
+    // First instruction of a match starting exactly at the search start
+    uint32_t start;
+    // First instruction of a match starting anywhere, a lazy loop over any character leading to 'start'
+    uint32_t start_unanchored;
+    // Two slots (start and end) per capture group, group 0 being the whole match
+    uint32_t slot_count;
+    // Slots after the capture slots used by OpAtomicStart and OpProgress, only the backtracker has them
+    uint32_t register_count;
+    // Uses OpBackref, OpAtomicStart, OpAtomicEnd or OpProgress, which only the backtracker runs
+    bool needs_backtracking;
+    bool has_backreferences;
+    // Number of patterns compiled together, each one ending at its own OpMatch
+    uint32_t pattern_count;
+    // A match does not cut lower priority threads, every pattern matching somewhere is found
+    // Set for pattern sets, which report which patterns match rather than where
+    bool all_matches;
+    // Compiled from the pattern read backwards, it matches the reversed input
+    // A match does not cut lower priority threads either: searched backwards from where a
+    // match ends, the longest match of the reversed program is where the leftmost one starts
+    bool reverse;
+    // Characters no instruction tells apart share a byte class,
+    // automata have one transition per class instead of one per character
+    uint8_t byte_classes[256];
+    uint32_t byte_class_count;
+};
+
+typedef struct _Program Program;
+
+// Whether character `c` belongs to class number `class` of program `p`
+bool program_class_contains(const Program* p, uint32_t class, unsigned char c);
+
+// Whether `c` is a \w character
+bool is_word_char(unsigned char c);
+
+// Whether zero-width assertion `kind` holds at `position` of `input`
+bool assert_holds(uint32_t kind, const char* input, size_t length, size_t position);
+
+// Whether every index in `p` is in bounds and every class set agrees with its ranges, so
+// engines can run it without reading outside its arrays
+// Programs read back with regex_deserialize are checked with it, compiled ones always pass
+bool program_is_valid(const Program* p);
+
+// Print instructions one per line
+void print_program(const Program* p);
+
+#endif
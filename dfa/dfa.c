@@ -0,0 +1,753 @@
+#include "./dfa.h"
+
+// Transition taken at the end of input
+#define END_OF_INPUT 256
+
+DfaCache new_dfa_cache(const Program* p, const Prefilter* prefilter, size_t size) {
+    // Nothing to search with the empty reverse program of a pattern needing the backtracker
+    if (p->length == 0) return (DfaCache){.program = p, .prefilter = prefilter, .stride = 1};
+    if (size == 0) size = DFA_CACHE_SIZE;
+
+    uint32_t flags_mask = 0;
+    for (uint32_t pc = 0;pc < p->length;pc++) {
+        Instruction inst = p->instructions[pc];
+        if (inst.op != OpAssert) continue;
+        if (inst.x == AssertStartText) flags_mask |= DFA_AT_START;
+        else if (inst.x == AssertWordBoundary || inst.x == AssertNotWordBoundary) flags_mask |= DFA_AFTER_WORD;
+    }
+
+    // One column per byte class, the last one for the end of input
+    uint32_t stride = p->byte_class_count + 1;
+    // Three quarters of the memory go to states, the rest to their roots
+    size_t state_bytes = stride * sizeof(uint32_t) + sizeof(DfaState) + 2 * sizeof(uint32_t);
+    size_t state_capacity = (size / 4 * 3) / state_bytes;
+    if (state_capacity < 4) state_capacity = 4;
+    size_t roots_capacity = size / 4 / sizeof(uint32_t);
+    // Any single state must fit
+    if (roots_capacity < 2 * (size_t)p->length) roots_capacity = 2 * (size_t)p->length;
+    uint32_t table_size = 1;
+    while (table_size < 2 * state_capacity) table_size *= 2;
+
+    DfaCache c = (DfaCache) {
+        .program = p,
+        .flags_mask = flags_mask,
+        .stride = stride,
+        .prefilter = prefilter,
+        .states = malloc(state_capacity * sizeof(DfaState)),
+        .state_count = 0,
+        .state_capacity = state_capacity,
+        .transitions = malloc(state_capacity * stride * sizeof(uint32_t)),
+        .roots = malloc(roots_capacity * sizeof(uint32_t)),
+        .roots_count = 0,
+        .roots_capacity = roots_capacity,
+        .table = malloc(table_size * sizeof(uint32_t)),
+        .table_mask = table_size - 1,
+        .loops = malloc(DFA_MAX_LOOPS * sizeof(DfaLoop)),
+        .loop_count = 0,
+        .sparse = malloc(p->length * sizeof(uint32_t)),
+        .dense = malloc(p->length * sizeof(uint32_t)),
+        .stack = malloc(p->length * sizeof(uint32_t)),
+        // Set programs add the threads of the unanchored start after those of the closure
+        .next_roots = malloc(2 * (size_t)p->length * sizeof(uint32_t)),
+        .start_step_index = NULL,
+        .start_steps = NULL,
+        .start_steps_count = 0,
+        .start_steps_capacity = 0,
+        .clears = 0,
+        .chars_since_clear = 0,
+    };
+    if (p->all_matches) {
+        c.start_step_index = malloc(4 * stride * sizeof(DfaStartStep));
+        for (uint32_t i = 0;i < 4 * stride;i++) c.start_step_index[i].count = DFA_UNKNOWN;
+    }
+    return c;
+}
+
+void free_dfa_cache(DfaCache* c) {
+    free(c->states);
+    free(c->transitions);
+    free(c->roots);
+    free(c->table);
+    free(c->loops);
+    free(c->sparse);
+    free(c->dense);
+    free(c->stack);
+    free(c->next_roots);
+    free(c->start_step_index);
+    free(c->start_steps);
+}
+
+static uint32_t hash_state(const uint32_t* roots, uint32_t count, uint32_t flags) {
+    uint32_t h = 2166136261u ^ flags;
+    for (uint32_t i = 0;i < count;i++) h = (h ^ roots[i]) * 16777619u;
+    return h ^ (h >> 15);
+}
+
+// Drop every state, only the dead state remains
+static void clear_cache(DfaCache* c) {
+    memset(c->table, 0xFF, (c->table_mask + 1) * sizeof(uint32_t));
+    for (size_t i = 0;i < 8;i++) c->start_states[i] = DFA_UNKNOWN;
+    c->roots_count = 0;
+    c->loop_count = 0;
+    c->states[DFA_DEAD] = (DfaState){.roots_start = 0, .roots_count = 0, .flags = 0, .loop = DFA_NO_LOOP};
+    for (uint32_t i = 0;i < c->stride;i++) c->transitions[i] = DFA_DEAD;
+    c->state_count = 1;
+}
+
+// Find or add the state made of `roots` and `flags`
+// Returns DFA_UNKNOWN when the cache is full
+static uint32_t add_state(DfaCache* c, const uint32_t* roots, uint32_t count, uint32_t flags) {
+    if (count == 0) return DFA_DEAD;
+    flags &= c->flags_mask;
+    if (count == 1 && roots[0] == c->program->start_unanchored) flags |= DFA_UNANCHORED_START;
+
+    uint32_t slot = hash_state(roots, count, flags) & c->table_mask;
+    for (;c->table[slot] != DFA_UNKNOWN;slot = (slot + 1) & c->table_mask) {
+        const DfaState* s = &c->states[c->table[slot]];
+        if (
+            s->flags == flags && s->roots_count == count &&
+            memcmp(c->roots + s->roots_start, roots, count * sizeof(uint32_t)) == 0
+        ) {
+            return c->table[slot];
+        }
+    }
+
+    if (c->state_count == c->state_capacity || c->roots_count + count > c->roots_capacity) {
+        return DFA_UNKNOWN;
+    }
+    uint32_t id = c->state_count++;
+    c->states[id] = (DfaState) {
+        .roots_start = c->roots_count, .roots_count = count, .flags = flags, .loop = DFA_UNKNOWN,
+    };
+    memcpy(c->roots + c->roots_count, roots, count * sizeof(uint32_t));
+    c->roots_count += count;
+    uint32_t* row = c->transitions + (size_t)id * c->stride;
+    for (uint32_t i = 0;i < c->stride;i++) row[i] = DFA_UNKNOWN;
+    c->table[slot] = id;
+    return id;
+}
+
+static bool dfa_assert_holds(uint32_t kind, uint32_t flags, int next) {
+    switch (kind) {
+        case AssertStartText:
+            return flags & DFA_AT_START;
+        case AssertEndText:
+            return next == END_OF_INPUT;
+        default: {
+            bool word_before = flags & DFA_AFTER_WORD;
+            bool word_after = next != END_OF_INPUT && is_word_char(next);
+            return (word_before != word_after) == (kind == AssertWordBoundary);
+        }
+    }
+}
+
+static int compare_roots(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Column of the transition on `next` in a row of the table
+static uint32_t column(const DfaCache* c, int next) {
+    return next == END_OF_INPUT ? c->stride - 1 : c->program->byte_classes[next];
+}
+
+// Progress of the closure computing one transition
+struct _Closure {
+    // Program counters visited, in field 'dense' of the cache
+    uint32_t visited;
+    // Roots of the next state found, in field 'next_roots' of the cache
+    uint32_t count;
+    bool matched;
+    // Whether a match cut the remaining threads
+    bool cut;
+};
+
+typedef struct _Closure Closure;
+
+// Follow empty transitions from `root` in priority order for a state with `flags`,
+// adding the threads stepping over `next` to the roots of the next state
+static void follow(DfaCache* c, uint32_t root, uint32_t flags, int next, Closure* k) {
+    const Program* p = c->program;
+    uint32_t top = 0;
+    c->stack[top++] = root;
+    while (top > 0 && !k->cut) {
+        uint32_t pc = c->stack[--top];
+        while (true) {
+            uint32_t i = c->sparse[pc];
+            if (i < k->visited && c->dense[i] == pc) break;
+            c->sparse[pc] = k->visited;
+            c->dense[k->visited++] = pc;
+
+            Instruction inst = p->instructions[pc];
+            if (inst.op == OpJmp) {
+                pc = inst.x;
+            } else if (inst.op == OpSplit) {
+                c->stack[top++] = inst.y;
+                pc = inst.x;
+            } else if (inst.op == OpSave) {
+                pc++;
+            } else if (inst.op == OpAssert) {
+                if (!dfa_assert_holds(inst.x, flags, next)) break;
+                pc++;
+            } else if (inst.op == OpMatch && p->all_matches) {
+                // Kept as a root so later states remember which patterns matched
+                k->matched = true;
+                c->next_roots[k->count++] = pc;
+                break;
+            } else if (inst.op == OpMatch) {
+                // Reversed programs look for the longest match, lower priority threads go on
+                k->matched = true;
+                k->cut = !p->reverse;
+                break;
+            } else {
+                bool step = next != END_OF_INPUT && (
+                    inst.op == OpByte ? next == (int)inst.x : program_class_contains(p, inst.x, next)
+                );
+                if (step) c->next_roots[k->count++] = pc + 1;
+                break;
+            }
+        }
+    }
+}
+
+// Threads the unanchored start of a set program leads to over `next` with `flags`
+// The start reaches the first instruction of every pattern, so it is followed once per
+// column and flags instead of once per transition
+static DfaStartStep start_step(DfaCache* c, uint32_t flags, int next) {
+    DfaStartStep* step = &c->start_step_index[(flags & (DFA_AT_START | DFA_AFTER_WORD)) * c->stride + column(c, next)];
+    if (step->count != DFA_UNKNOWN) return *step;
+
+    Closure k = (Closure){.visited = 0, .count = 0, .matched = false, .cut = false};
+    follow(c, c->program->start_unanchored, flags, next, &k);
+    if (c->start_steps_count + k.count > c->start_steps_capacity) {
+        c->start_steps_capacity = 2 * (c->start_steps_count + k.count);
+        c->start_steps = realloc(c->start_steps, c->start_steps_capacity * sizeof(uint32_t));
+    }
+    if (k.count > 0) memcpy(c->start_steps + c->start_steps_count, c->next_roots, k.count * sizeof(uint32_t));
+    *step = (DfaStartStep){.start = c->start_steps_count, .count = k.count, .matched = k.matched};
+    c->start_steps_count += k.count;
+    return *step;
+}
+
+// Compute the roots of the state following the threads `roots` of a state with `flags`
+// on character `next` (or END_OF_INPUT) into field 'next_roots', returns how many there are
+// Follows empty transitions from the roots in priority order, stopping at the first match
+// since lower priority threads can not win over it, then steps over `next`
+// Set programs go on past matches and keep their OpMatch as roots
+// `matched` tells whether a match ends right before `next`
+static uint32_t step_roots(
+    DfaCache* c, const uint32_t* roots, uint32_t count, uint32_t flags, int next, bool* matched
+) {
+    const Program* p = c->program;
+
+    // Roots of set programs are sorted and the unanchored start, a root of nearly every
+    // state, comes first since no instruction before it is a root
+    bool from_start = p->all_matches && count > 0 && roots[0] == p->start_unanchored;
+    DfaStartStep start = {.start = 0, .count = 0, .matched = false};
+    if (from_start) start = start_step(c, flags, next);
+
+    Closure k = (Closure){.visited = 0, .count = 0, .matched = false, .cut = false};
+    for (uint32_t r = from_start ? 1 : 0;r < count && !k.cut;r++) {
+        follow(c, roots[r], flags, next, &k);
+    }
+
+    uint32_t next_count = k.count;
+    *matched = k.matched;
+    if (p->all_matches) {
+        if (start.count > 0) {
+            memcpy(c->next_roots + next_count, c->start_steps + start.start, start.count * sizeof(uint32_t));
+            next_count += start.count;
+        }
+        *matched = *matched || start.matched;
+
+        // Priorities do not matter when every match counts, sorted roots make fewer states
+        qsort(c->next_roots, next_count, sizeof(uint32_t), compare_roots);
+        uint32_t unique = 0;
+        for (uint32_t i = 0;i < next_count;i++) {
+            if (unique == 0 || c->next_roots[unique - 1] != c->next_roots[i]) c->next_roots[unique++] = c->next_roots[i];
+        }
+        next_count = unique;
+    }
+    return next_count;
+}
+
+// Flags of the state following character `next`
+static uint32_t next_flags(int next) {
+    return next != END_OF_INPUT && is_word_char(next) ? DFA_AFTER_WORD : 0;
+}
+
+// Compute the transition of state `s` on character `next` (or END_OF_INPUT)
+// Any character of the same byte class leads to the same state
+// Returns DFA_UNKNOWN when the cache is full
+static uint32_t compute_transition(DfaCache* c, uint32_t s, int next) {
+    const DfaState* state = &c->states[s];
+    bool matched;
+    uint32_t count = step_roots(c, c->roots + state->roots_start, state->roots_count, state->flags, next, &matched);
+
+    uint32_t target = add_state(c, c->next_roots, count, next_flags(next));
+    if (target == DFA_UNKNOWN) return DFA_UNKNOWN;
+    target |= matched ? DFA_MATCH_FLAG : 0;
+    c->transitions[(size_t)s * c->stride + column(c, next)] = target;
+    return target;
+}
+
+// Clear the cache keeping only state `s`, returns its new number
+static uint32_t restart(DfaCache* c, uint32_t s) {
+    DfaState state = c->states[s];
+    // Work space of the closure is free between transitions
+    memcpy(c->next_roots, c->roots + state.roots_start, state.roots_count * sizeof(uint32_t));
+    clear_cache(c);
+    c->clears++;
+    return add_state(c, c->next_roots, state.roots_count, state.flags);
+}
+
+// Whether a search clearing the cache again should rather give up
+static bool thrashing(const DfaCache* c) {
+    return
+        c->clears >= DFA_MAX_CLEARS &&
+        c->chars_since_clear < DFA_MIN_CHARS_PER_STATE * (size_t)c->state_count;
+}
+
+// Transition of `*s` on `next`, computing it when unknown
+// Clears the cache when full, which renumbers `*s`
+// Returns DFA_UNKNOWN when the search must give up
+static uint32_t next_state(DfaCache* c, uint32_t* s, int next) {
+    uint32_t t = c->transitions[(size_t)*s * c->stride + column(c, next)];
+    if (t != DFA_UNKNOWN) return t;
+    t = compute_transition(c, *s, next);
+    if (t != DFA_UNKNOWN) return t;
+
+    if (thrashing(c)) return DFA_UNKNOWN;
+    *s = restart(c, *s);
+    if (*s == DFA_UNKNOWN) return DFA_UNKNOWN;
+    return compute_transition(c, *s, next);
+}
+
+// Find the characters state `s` goes back to itself on without a match, see field 'loop' of DfaState
+// Columns whose transition is not known yet are stepped over without adding states
+static uint32_t find_loop(DfaCache* c, uint32_t s) {
+    DfaState* state = &c->states[s];
+    state->loop = DFA_NO_LOOP;
+    if (c->loop_count == DFA_MAX_LOOPS) return DFA_NO_LOOP;
+
+    const uint8_t* classes = c->program->byte_classes;
+    const uint32_t* row = c->transitions + (size_t)s * c->stride;
+    const uint32_t* roots = c->roots + state->roots_start;
+    // Per column: 0 unknown, 1 loops, 2 leaves
+    uint8_t loops[256] = {0};
+    CharSet set = new_charset();
+    for (uint32_t next = 0;next < 256;next++) {
+        uint32_t k = classes[next];
+        if (loops[k] == 0 && row[k] != DFA_UNKNOWN) {
+            loops[k] = row[k] == s ? 1 : 2;
+        } else if (loops[k] == 0) {
+            // Same roots and flags make the same state
+            bool matched;
+            uint32_t count = step_roots(c, roots, state->roots_count, state->flags, next, &matched);
+            bool same =
+                !matched && count == state->roots_count &&
+                (next_flags(next) & c->flags_mask) == (state->flags & c->flags_mask) &&
+                memcmp(c->next_roots, roots, count * sizeof(uint32_t)) == 0;
+            loops[k] = same ? 1 : 2;
+        }
+        if (loops[k] == 1) charset_add_range(&set, next, next);
+    }
+
+    c->loops[c->loop_count] = (DfaLoop){.set = set, .scans = 0, .skipped = 0};
+    state->loop = c->loop_count++;
+    return state->loop;
+}
+
+// State `s` went back to itself on character `i` of `input`, returns the last position
+// of the run of characters it does the same on
+static size_t skip_loop(DfaCache* c, uint32_t s, const char* input, size_t length, size_t i) {
+    uint32_t index = c->states[s].loop;
+    if (index == DFA_UNKNOWN) index = find_loop(c, s);
+    if (index == DFA_NO_LOOP) return i;
+
+    DfaLoop* loop = &c->loops[index];
+    size_t end = charset_skip(&loop->set, input, length, i + 1);
+    if (loop->scans < DFA_LOOP_TRIAL) {
+        loop->scans++;
+        loop->skipped += end - (i + 1);
+        if (loop->scans == DFA_LOOP_TRIAL && loop->skipped < DFA_MIN_LOOP_RUN * DFA_LOOP_TRIAL) {
+            c->states[s].loop = DFA_NO_LOOP;
+        }
+    }
+    return end - 1;
+}
+
+// Flags of a state at `start` of `input` when reading forwards
+static uint32_t start_flags(const char* input, size_t start) {
+    uint32_t flags = 0;
+    if (start == 0) flags |= DFA_AT_START;
+    if (start > 0 && is_word_char(input[start - 1])) flags |= DFA_AFTER_WORD;
+    return flags;
+}
+
+// Start state of a search from a position with `flags`
+static uint32_t start_state(DfaCache* c, uint32_t flags, bool anchored) {
+    flags &= c->flags_mask;
+
+    uint32_t index = (anchored ? 4 : 0) | flags;
+    if (c->start_states[index] != DFA_UNKNOWN) return c->start_states[index];
+
+    uint32_t root = anchored ? c->program->start : c->program->start_unanchored;
+    uint32_t s = add_state(c, &root, 1, flags);
+    if (s == DFA_UNKNOWN) {
+        clear_cache(c);
+        s = add_state(c, &root, 1, flags);
+    }
+    c->start_states[index] = s;
+    return s;
+}
+
+DfaSnapshot dfa_cache_snapshot(const DfaCache* c) {
+    DfaSnapshot snapshot = (DfaSnapshot) {
+        .stride = c->stride,
+        .states = c->states,
+        .state_count = c->state_count,
+        .transitions = c->transitions,
+        .roots = c->roots,
+        .roots_count = c->roots_count,
+        .loops = c->loops,
+        .loop_count = c->loop_count,
+    };
+    memcpy(snapshot.start_states, c->start_states, sizeof(snapshot.start_states));
+    return snapshot;
+}
+
+// Whether `snapshot` fits in `c` and every index in it is in bounds
+static bool snapshot_is_valid(const DfaCache* c, const DfaSnapshot* snapshot) {
+    if (snapshot->stride != c->stride || snapshot->state_count > c->state_capacity) return false;
+    if (snapshot->roots_count > c->roots_capacity || snapshot->loop_count > DFA_MAX_LOOPS) return false;
+    if (snapshot->state_count == 0) return snapshot->roots_count == 0 && snapshot->loop_count == 0;
+    if (snapshot->states[DFA_DEAD].roots_count != 0) return false;
+
+    for (uint32_t s = 0;s < snapshot->state_count;s++) {
+        const DfaState* state = &snapshot->states[s];
+        if (state->roots_start > snapshot->roots_count) return false;
+        if (state->roots_count > snapshot->roots_count - state->roots_start) return false;
+        if (state->flags > (DFA_AT_START | DFA_AFTER_WORD | DFA_UNANCHORED_START)) return false;
+        bool loop = state->loop == DFA_UNKNOWN || state->loop == DFA_NO_LOOP || state->loop < snapshot->loop_count;
+        if (!loop) return false;
+    }
+    for (uint32_t i = 0;i < snapshot->roots_count;i++) {
+        if (snapshot->roots[i] >= c->program->length) return false;
+    }
+    for (size_t i = 0;i < (size_t)snapshot->state_count * c->stride;i++) {
+        uint32_t t = snapshot->transitions[i];
+        if (t != DFA_UNKNOWN && (t & ~DFA_MATCH_FLAG) >= snapshot->state_count) return false;
+    }
+    for (uint32_t i = 0;i < 8;i++) {
+        uint32_t s = snapshot->start_states[i];
+        if (s != DFA_UNKNOWN && s >= snapshot->state_count) return false;
+    }
+    return true;
+}
+
+bool dfa_cache_restore(DfaCache* c, const DfaSnapshot* snapshot) {
+    c->state_count = 0;
+    if (!snapshot_is_valid(c, snapshot)) return false;
+    if (snapshot->state_count == 0) return true;
+
+    clear_cache(c);
+    memcpy(c->states, snapshot->states, snapshot->state_count * sizeof(DfaState));
+    memcpy(c->transitions, snapshot->transitions, (size_t)snapshot->state_count * c->stride * sizeof(uint32_t));
+    memcpy(c->roots, snapshot->roots, snapshot->roots_count * sizeof(uint32_t));
+    memcpy(c->loops, snapshot->loops, snapshot->loop_count * sizeof(DfaLoop));
+    memcpy(c->start_states, snapshot->start_states, sizeof(c->start_states));
+    c->state_count = snapshot->state_count;
+    c->roots_count = snapshot->roots_count;
+    c->loop_count = snapshot->loop_count;
+
+    // The dead state is never looked up
+    for (uint32_t s = 1;s < c->state_count;s++) {
+        const DfaState* state = &c->states[s];
+        uint32_t slot = hash_state(c->roots + state->roots_start, state->roots_count, state->flags) & c->table_mask;
+        while (c->table[slot] != DFA_UNKNOWN) slot = (slot + 1) & c->table_mask;
+        c->table[slot] = s;
+    }
+    return true;
+}
+
+bool dfa_cache_fill(DfaCache* c) {
+    const Program* p = c->program;
+    if (p->length == 0) return true;
+    if (c->state_count == 0) clear_cache(c);
+
+    // Start states of every anchoring and flags the program tells apart
+    for (uint32_t index = 0;index < 8;index++) {
+        uint32_t flags = index & (DFA_AT_START | DFA_AFTER_WORD);
+        if ((flags & ~c->flags_mask) != 0 || c->start_states[index] != DFA_UNKNOWN) continue;
+        uint32_t root = index & 4 ? p->start : p->start_unanchored;
+        uint32_t s = add_state(c, &root, 1, flags);
+        if (s == DFA_UNKNOWN) return false;
+        c->start_states[index] = s;
+    }
+
+    // Any character of a column leads to the same state
+    int representative[257];
+    for (int next = 255;next >= 0;next--) representative[p->byte_classes[next]] = next;
+    representative[c->stride - 1] = END_OF_INPUT;
+    // States are added at the end, so the loop reaches them all
+    for (uint32_t s = 1;s < c->state_count;s++) {
+        for (uint32_t k = 0;k < c->stride;k++) {
+            if (c->transitions[(size_t)s * c->stride + k] != DFA_UNKNOWN) continue;
+            if (compute_transition(c, s, representative[k]) == DFA_UNKNOWN) return false;
+        }
+    }
+    return true;
+}
+
+DfaResult dfa_search(
+    DfaCache* c, const char* input, size_t length,
+    size_t start, bool anchored, bool earliest, size_t* end
+) {
+    if (c->state_count == 0) clear_cache(c);
+    c->clears = 0;
+    c->chars_since_clear = 0;
+
+    const unsigned char* text = (const unsigned char*)input;
+    const uint8_t* classes = c->program->byte_classes;
+    uint32_t s = start_state(c, start_flags(input, start), anchored);
+    bool matched = false;
+    // Where the cache was last cleared by this search
+    size_t clear_position = start;
+
+    size_t i = start;
+    for (;i < length;i++) {
+        if (c->prefilter != NULL && !matched && (c->states[s].flags & DFA_UNANCHORED_START)) {
+            // No thread is running, the next match starts with a literal of the prefilter
+            size_t candidate = prefilter_find(c->prefilter, input, length, i);
+            if (candidate == NO_POSITION) return DfaNoMatch;
+            if (candidate != i) {
+                i = candidate;
+                s = start_state(c, start_flags(input, i), false);
+            }
+        }
+        uint32_t t = c->transitions[(size_t)s * c->stride + classes[text[i]]];
+        if (t == DFA_UNKNOWN) {
+            size_t clears = c->clears;
+            c->chars_since_clear = i - clear_position;
+            t = next_state(c, &s, text[i]);
+            if (t == DFA_UNKNOWN) return DfaGaveUp;
+            if (c->clears != clears) clear_position = i;
+        }
+        if (t & DFA_MATCH_FLAG) {
+            // A match ends right before character i
+            matched = true;
+            *end = i;
+            if (earliest) return DfaMatch;
+        }
+        bool loops = t == s;
+        s = t & ~DFA_MATCH_FLAG;
+        if (s == DFA_DEAD) break;
+        if (loops && c->states[s].loop != DFA_NO_LOOP) i = skip_loop(c, s, input, length, i);
+    }
+
+    if (s != DFA_DEAD) {
+        uint32_t t = next_state(c, &s, END_OF_INPUT);
+        if (t == DFA_UNKNOWN) return DfaGaveUp;
+        if (t & DFA_MATCH_FLAG) {
+            matched = true;
+            *end = length;
+        }
+    }
+    return matched ? DfaMatch : DfaNoMatch;
+}
+
+DfaResult dfa_search_reverse(DfaCache* c, const char* input, size_t length, size_t end, size_t* start) {
+    if (c->state_count == 0) clear_cache(c);
+    c->clears = 0;
+    c->chars_since_clear = 0;
+
+    // Read backwards the end of the input is the start, and the character after a position
+    // is the one before it
+    const unsigned char* text = (const unsigned char*)input;
+    const uint8_t* classes = c->program->byte_classes;
+    uint32_t flags = 0;
+    if (end == length) flags |= DFA_AT_START;
+    if (end < length && is_word_char(text[end])) flags |= DFA_AFTER_WORD;
+    uint32_t s = start_state(c, flags, true);
+    bool matched = false;
+    size_t clear_position = end;
+
+    size_t i = end;
+    for (;i > 0;i--) {
+        uint32_t t = c->transitions[(size_t)s * c->stride + classes[text[i - 1]]];
+        if (t == DFA_UNKNOWN) {
+            size_t clears = c->clears;
+            c->chars_since_clear = clear_position - i;
+            t = next_state(c, &s, text[i - 1]);
+            if (t == DFA_UNKNOWN) return DfaGaveUp;
+            if (c->clears != clears) clear_position = i;
+        }
+        if (t & DFA_MATCH_FLAG) {
+            // A match starts right after character i - 1
+            matched = true;
+            *start = i;
+        }
+        s = t & ~DFA_MATCH_FLAG;
+        if (s == DFA_DEAD) break;
+    }
+
+    if (s != DFA_DEAD) {
+        uint32_t t = next_state(c, &s, END_OF_INPUT);
+        if (t == DFA_UNKNOWN) return DfaGaveUp;
+        if (t & DFA_MATCH_FLAG) {
+            matched = true;
+            *start = 0;
+        }
+    }
+    return matched ? DfaMatch : DfaNoMatch;
+}
+
+DfaResult dfa_search_set(DfaCache* c, const char* input, size_t length, uint64_t* matched) {
+    if (c->state_count == 0) clear_cache(c);
+    c->clears = 0;
+    c->chars_since_clear = 0;
+
+    const unsigned char* text = (const unsigned char*)input;
+    const uint8_t* classes = c->program->byte_classes;
+    uint32_t s = start_state(c, DFA_AT_START, false);
+    size_t clear_position = 0;
+
+    for (size_t i = 0;i < length;i++) {
+        uint32_t t = c->transitions[(size_t)s * c->stride + classes[text[i]]];
+        if (t == DFA_UNKNOWN) {
+            size_t clears = c->clears;
+            c->chars_since_clear = i - clear_position;
+            t = next_state(c, &s, text[i]);
+            if (t == DFA_UNKNOWN) return DfaGaveUp;
+            if (c->clears != clears) clear_position = i;
+        }
+        if (t == s && c->states[s].loop != DFA_NO_LOOP) i = skip_loop(c, s, input, length, i);
+        s = t & ~DFA_MATCH_FLAG;
+    }
+    uint32_t t = next_state(c, &s, END_OF_INPUT);
+    if (t == DFA_UNKNOWN) return DfaGaveUp;
+    s = t & ~DFA_MATCH_FLAG;
+
+    // Roots left after the end of input are the OpMatch of every pattern that matched
+    const Program* p = c->program;
+    memset(matched, 0, (p->pattern_count + 63) / 64 * sizeof(uint64_t));
+    const DfaState* state = &c->states[s];
+    for (uint32_t r = 0;r < state->roots_count;r++) {
+        uint32_t pattern = p->instructions[c->roots[state->roots_start + r]].x;
+        matched[pattern / 64] |= 1ull << (pattern % 64);
+    }
+    return state->roots_count > 0 ? DfaMatch : DfaNoMatch;
+}
+
+DfaStream new_dfa_stream(const Program* p, bool earliest) {
+    DfaStream st = (DfaStream) {
+        .roots = malloc(2 * (size_t)p->length * sizeof(uint32_t)),
+        .roots_count = 1,
+        .flags = DFA_AT_START,
+        .offset = 0,
+        .earliest = earliest,
+        .matched = false,
+        .end = 0,
+        .done = false,
+    };
+    st.roots[0] = p->start_unanchored;
+    return st;
+}
+
+void free_dfa_stream(DfaStream* st) {
+    free(st->roots);
+}
+
+// Record the state `s` of the cache in `st`
+static void save_stream_state(const DfaCache* c, DfaStream* st, uint32_t s) {
+    const DfaState* state = &c->states[s];
+    memcpy(st->roots, c->roots + state->roots_start, state->roots_count * sizeof(uint32_t));
+    st->roots_count = state->roots_count;
+    st->flags = state->flags;
+}
+
+// Step the roots of `st` over `next` without the cache
+static void step_stream(DfaCache* c, DfaStream* st, int next) {
+    bool matched;
+    uint32_t count = step_roots(c, st->roots, st->roots_count, st->flags, next, &matched);
+    memcpy(st->roots, c->next_roots, count * sizeof(uint32_t));
+    st->roots_count = count;
+    st->flags = next_flags(next);
+    if (matched) {
+        st->matched = true;
+        st->end = st->offset;
+    }
+    st->done = (matched && st->earliest) || count == 0;
+}
+
+// State of the cache for the roots of `st`, added when missing
+static uint32_t stream_state(DfaCache* c, DfaStream* st) {
+    if (c->state_count == 0) clear_cache(c);
+    uint32_t s = add_state(c, st->roots, st->roots_count, st->flags);
+    if (s == DFA_UNKNOWN) {
+        // Any single state fits in an empty cache
+        clear_cache(c);
+        s = add_state(c, st->roots, st->roots_count, st->flags);
+    }
+    return s;
+}
+
+void dfa_stream_feed(DfaCache* c, DfaStream* st, const char* chunk, size_t length) {
+    if (st->done) return;
+    c->clears = 0;
+    c->chars_since_clear = 0;
+
+    const unsigned char* text = (const unsigned char*)chunk;
+    const uint8_t* classes = c->program->byte_classes;
+    uint32_t s = stream_state(c, st);
+    size_t clear_position = 0;
+
+    size_t i = 0;
+    for (;i < length;i++) {
+        uint32_t t = c->transitions[(size_t)s * c->stride + classes[text[i]]];
+        if (t == DFA_UNKNOWN) {
+            size_t clears = c->clears;
+            c->chars_since_clear = i - clear_position;
+            t = next_state(c, &s, text[i]);
+            if (t == DFA_UNKNOWN) break;
+            if (c->clears != clears) clear_position = i;
+        }
+        if (t & DFA_MATCH_FLAG) {
+            st->matched = true;
+            st->end = st->offset + i;
+            if (st->earliest) {
+                st->done = true;
+                return;
+            }
+        }
+        bool loops = t == s;
+        s = t & ~DFA_MATCH_FLAG;
+        if (s == DFA_DEAD) {
+            st->done = true;
+            return;
+        }
+        if (loops && c->states[s].loop != DFA_NO_LOOP) i = skip_loop(c, s, chunk, length, i);
+    }
+
+    if (i == length) {
+        save_stream_state(c, st, s);
+        st->offset += length;
+        return;
+    }
+    // The cache thrashes, go on without it
+    save_stream_state(c, st, s);
+    st->offset += i;
+    for (;i < length && !st->done;i++) {
+        step_stream(c, st, text[i]);
+        st->offset++;
+    }
+    st->offset += length - i;
+}
+
+void dfa_stream_finish(DfaCache* c, DfaStream* st) {
+    if (st->done) return;
+    step_stream(c, st, END_OF_INPUT);
+    st->done = true;
+}
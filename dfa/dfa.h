@@ -0,0 +1,232 @@
+#ifndef DFA_H
+#define DFA_H
+
+#include "../compiler/program.h"
+#include "../prefilter/prefilter.h"
+
+// Lazy DFA: states are sets of program threads built the first time the search needs them,
+// each one costs a closure over the program once and then a table lookup per character
+// States and transitions live in a cache of fixed size that is cleared when full
+
+// Memory of a DFA cache when no size is given
+#define DFA_CACHE_SIZE (2 << 20)
+
+// Cache clears a search may cause before it gives up because the cache thrashes
+#define DFA_MAX_CLEARS 8
+
+// A search giving up must have scanned fewer than this many characters per state created
+// since the last clear, otherwise clearing is considered cheap enough to go on
+#define DFA_MIN_CHARS_PER_STATE 10
+
+// Value of a transition not computed yet
+#define DFA_UNKNOWN UINT32_MAX
+// Flag set on a transition whose source state ends a match right before the character
+#define DFA_MATCH_FLAG (1u << 31)
+// State without threads, every transition from it leads back to it
+#define DFA_DEAD 0
+
+// State flags describing the position a state is at, needed by \A and \b
+#define DFA_AT_START 1
+#define DFA_AFTER_WORD 2
+// Set on states made only of the unanchored start, where the search can skip ahead to
+// the next position the prefilter finds
+#define DFA_UNANCHORED_START 4
+
+// Most states of a cache whose loops are skipped with a vectorized scan, see field 'loop' of DfaState
+#define DFA_MAX_LOOPS 64
+// Field 'loop' of a state that is not skipped
+#define DFA_NO_LOOP (UINT32_MAX - 1)
+// Scans a loop gets before it is judged, it is given up when they skipped fewer than
+// DFA_MIN_LOOP_RUN characters on average: like \w+ over prose, short runs are cheaper
+// one transition at a time
+#define DFA_LOOP_TRIAL 32
+#define DFA_MIN_LOOP_RUN 8
+
+enum _DfaResult {
+    DfaNoMatch,
+    DfaMatch,
+    // Cache thrashed, the search must be run by another engine
+    DfaGaveUp,
+};
+
+typedef enum _DfaResult DfaResult;
+
+struct _DfaState {
+    // Program counters the threads of this state continue at, in priority order,
+    // slice of field 'roots' of the cache
+    uint32_t roots_start;
+    uint32_t roots_count;
+    uint32_t flags;
+    // Characters the state goes back to itself on without a match, as an index in field
+    // 'loops' of the cache, so runs of them (like [^"]* or the text before a \d) are skipped
+    // with charset_skip rather than one transition at a time
+    // DFA_UNKNOWN until the search first sees the state loop, DFA_NO_LOOP when not skipped
+    uint32_t loop;
+};
+
+typedef struct _DfaState DfaState;
+
+// Loop of a state, see field 'loop' of DfaState
+struct _DfaLoop {
+    CharSet set;
+    // Scans so far, counted up to DFA_LOOP_TRIAL, and characters they skipped
+    uint32_t scans;
+    size_t skipped;
+};
+
+typedef struct _DfaLoop DfaLoop;
+
+// Threads the unanchored start of a set program leads to over one column, a slice of field
+// 'start_steps' of the cache, and whether a pattern matched on the way
+struct _DfaStartStep {
+    uint32_t start;
+    uint32_t count;
+    bool matched;
+};
+
+typedef struct _DfaStartStep DfaStartStep;
+
+// Mutable part of a lazy DFA, one per thread using the program
+struct _DfaCache {
+    const Program* program;
+    // Which of DFA_AT_START and DFA_AFTER_WORD the program asserts on
+    uint32_t flags_mask;
+    // Transitions per state: one per byte class of the program then one for the end of input
+    uint32_t stride;
+    // Literals every match starts with, NULL when there are none
+    const Prefilter* prefilter;
+
+    DfaState* states;
+    uint32_t state_count;
+    uint32_t state_capacity;
+    // state_capacity * stride transitions
+    uint32_t* transitions;
+    uint32_t* roots;
+    uint32_t roots_count;
+    uint32_t roots_capacity;
+    // Open addressing table of state numbers, DFA_UNKNOWN for empty slots
+    uint32_t* table;
+    uint32_t table_mask;
+    // Start state per anchoring and flags, DFA_UNKNOWN when not built yet
+    uint32_t start_states[8];
+    // Loops of the states, room for DFA_MAX_LOOPS
+    DfaLoop* loops;
+    uint32_t loop_count;
+
+    // Closure work space: sparse set of visited program counters and a stack
+    uint32_t* sparse;
+    uint32_t* dense;
+    uint32_t* stack;
+    // Roots of the state being built
+    uint32_t* next_roots;
+
+    // Set programs only: start step per state flags (DFA_AT_START and DFA_AFTER_WORD)
+    // and column, count DFA_UNKNOWN when not computed yet
+    // They only depend on the program, clearing the cache keeps them
+    DfaStartStep* start_step_index;
+    uint32_t* start_steps;
+    uint32_t start_steps_count;
+    uint32_t start_steps_capacity;
+
+    // Statistics of the running search used to detect thrashing
+    size_t clears;
+    size_t chars_since_clear;
+};
+
+typedef struct _DfaCache DfaCache;
+
+// States of a cache as arrays, to save what searches built and restore it into a new cache
+// of the same program, see regex_serialize
+struct _DfaSnapshot {
+    // Field 'stride' of the cache, only a cache with the same one takes the snapshot
+    uint32_t stride;
+    const DfaState* states;
+    uint32_t state_count;
+    // state_count * stride transitions
+    const uint32_t* transitions;
+    const uint32_t* roots;
+    uint32_t roots_count;
+    const DfaLoop* loops;
+    uint32_t loop_count;
+    uint32_t start_states[8];
+};
+
+typedef struct _DfaSnapshot DfaSnapshot;
+
+// Search over input given in consecutive chunks, see dfa_stream_feed
+// The state reached is kept as its roots, the cache may be cleared between chunks
+struct _DfaStream {
+    // Roots and flags of the state after the characters fed so far
+    uint32_t* roots;
+    uint32_t roots_count;
+    uint32_t flags;
+    // Characters fed so far
+    size_t offset;
+    // Stop at the first position a match is known to end there
+    bool earliest;
+    bool matched;
+    // End of the match found so far, valid when field 'matched' is set
+    size_t end;
+    // No character can change the result anymore
+    bool done;
+};
+
+typedef struct _DfaStream DfaStream;
+
+// Construct a cache for program `p` using about `size` bytes (0 means DFA_CACHE_SIZE)
+// `prefilter` is NULL or of kind PrefixPrefilter, LiteralSetPrefilter or ClassPrefilter
+// A program of length 0 gets a cache allocating nothing, which must not be searched
+DfaCache new_dfa_cache(const Program* p, const Prefilter* prefilter, size_t size);
+
+void free_dfa_cache(DfaCache* c);
+
+// Snapshot of the states of `c`, pointing into its arrays until the next search
+DfaSnapshot dfa_cache_snapshot(const DfaCache* c);
+
+// Replace the states of `c` by those of `snapshot`
+// Returns false, leaving `c` empty, when the snapshot does not fit in `c` or refers to
+// states, roots or loops it does not have
+bool dfa_cache_restore(DfaCache* c, const DfaSnapshot* snapshot);
+
+// Build every state reachable from the start states and all their transitions, so searches
+// never run a closure
+// Returns false when the cache is full before, the states built so far stay
+bool dfa_cache_fill(DfaCache* c);
+
+// Search `input` from `start` for a match of the program of cache `c`
+// When `anchored` the match must begin exactly at `start`
+// When `earliest` the search stops at the first position a match is known to end there,
+// otherwise it reports where the leftmost-first match ends
+// On DfaMatch fills `end` with the end of the match
+DfaResult dfa_search(
+    DfaCache* c, const char* input, size_t length,
+    size_t start, bool anchored, bool earliest, size_t* end
+);
+
+// Search `input` backwards from `end` for the longest match of the reversed program
+// (field 'reverse' set) of cache `c` that ends exactly at `end`
+// Given the end of the leftmost-first match of a pattern, this finds where it starts
+// On DfaMatch fills `start` with the start of the match
+DfaResult dfa_search_reverse(DfaCache* c, const char* input, size_t length, size_t end, size_t* start);
+
+// Find which patterns of a set program (field 'all_matches' set) match somewhere in `input`
+// `matched` has room for one bit per pattern in 64 bit words, bit i is set when pattern i
+// matches and every other bit is cleared
+DfaResult dfa_search_set(DfaCache* c, const char* input, size_t length, uint64_t* matched);
+
+// Construct a stream for program `p` at the start of the input, unanchored
+// With `earliest` the match reported ends at the first position a match is known to end,
+// otherwise it is the end of the leftmost-first match
+DfaStream new_dfa_stream(const Program* p, bool earliest);
+
+void free_dfa_stream(DfaStream* st);
+
+// Continue stream `st` over the next `length` characters of the input
+// When the cache thrashes the rest of the chunk is run without caching states,
+// one closure per character like an NFA
+void dfa_stream_feed(DfaCache* c, DfaStream* st, const char* chunk, size_t length);
+
+// End the input of stream `st`, \Z and \b are checked against the end of input
+void dfa_stream_finish(DfaCache* c, DfaStream* st);
+
+#endif
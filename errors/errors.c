@@ -0,0 +1,179 @@
+#include "./errors.h"
+
+struct _ErrorText {
+    const char* message;
+    const char* hint;
+    // The diagnostic quotes the span, like the characters of an invalid range
+    bool quote;
+};
+
+typedef struct _ErrorText ErrorText;
+
+static const ErrorText ERROR_TEXTS[] = {
+    [NoError] = {"No error", NULL, false},
+
+    [InvalidRangeError] = {
+        "Invalid range", "Both bounds must be digits, lowercase or uppercase letters, the lower one first", true
+    },
+    [TrailingSlashError] = {
+        "Trailing \\ at end of pattern",
+        "\\ must be followed by something" "\n"
+        "Use `\\\\\\\\` in your pattern to match a literal \\", false
+    },
+    [InvalidGroupNameError] = {
+        "Invalid group number or name in backreference",
+        "Use a positive integer starting from 1 or any alphanumeric string starting with a non-digit" "\n"
+        "Otherwise use `\\\\\\\\g` in your pattern to match a \\ followed by `g`", true
+    },
+    [ExpectedGroupError] = {
+        "Expected numeric backreference `\\g<GROUP_NUMBER>` or named backreference `\\g<group_name>`",
+        "Use a positive integer starting from 1 or any alphanumeric string starting with a non-digit" "\n"
+        "Otherwise use `\\\\\\\\g` in your pattern to match a \\ followed by `g`", false
+    },
+    [InvalidEscapeError] = {
+        "Invalid regular expression escape", "Use `\\\\\\\\` in your pattern to match a literal \\", true
+    },
+    [NestedBracketError] = {
+        "Nested [", "Use `\\[` to match a literal [ inside a character class", false
+    },
+    [EmptyClassError] = {
+        "Empty character class",
+        "Use `\\[\\]` to match a [ followed by ]" "\n"
+        "Use `\\]` to match a literal ] inside a character class", false
+    },
+    [LoneInverterError] = {
+        "Using ^ alone inside a character class",
+        "Write `[\\^]` to use ^ inside a character class" "\n"
+        "Or make ^ the first character after [ if there are other characters inside [ and ]", false
+    },
+    [UnmatchedRightBracketError] = {"Unmatched ]", "Use `\\]` to match a literal ]", false},
+    [NestedBraceError] = {"Nested {", NULL, false},
+    [EmptyBracesError] = {"Empty braces quantifier", "Use `\\{\\}` to match a { followed by }", false},
+    [UnmatchedRightBraceError] = {"Unmatched }", "Use `\\}` to match a literal }", false},
+    [UnmatchedRightParenError] = {"Unmatched )", "Use `\\)` to match a literal )", false},
+
+    [RepetitionTooLargeError] = {
+        "Repetition count too large", "Numbers inside a braces quantifier can not be larger than 1000", false
+    },
+    [InvalidBracesError] = {
+        "Invalid braces quantifier", "Use {N}, {N,}, {,M} or {N,M} where N and M are non-negative integers", false
+    },
+    [MinAboveMaxError] = {"Minimum larger than maximum in braces quantifier", NULL, false},
+    [NothingToRepeatError] = {
+        "Nothing to repeat", "Use a slash to match a quantifier character literally, like `\\*`", false
+    },
+    [MultipleQuantifiersError] = {
+        "Multiple quantifiers in a row", "Put the quantified expression inside ( and ) to quantify it again", false
+    },
+    [UnmatchedLeftBracketError] = {"Unmatched [", "Use `\\[` to match a literal [", false},
+    [UnknownGroupNameError] = {
+        "Unknown group name in backreference",
+        "Capture groups have no names, refer to them by number like `\\g<1>`", true
+    },
+    [InvalidGroupReferenceError] = {
+        "Invalid group reference", "A backreference must refer to a capture group closed before it", true
+    },
+    [UnmatchedLeftParenError] = {"Unmatched (", "Use `\\(` to match a literal (", false},
+    [UnexpectedTokenError] = {"Unexpected token", NULL, true},
+    [GroupsTooDeepError] = {"Groups nested too deeply", "Groups can be nested at most 1000 levels deep", false},
+
+    [PatternTooLargeError] = {"Pattern too large", "Reduce the numbers in braces quantifiers", false},
+    [BacktrackingInSetError] = {
+        "Backreferences and possessive quantifiers are not supported in pattern sets", NULL, false
+    },
+
+    [BacktrackBudgetError] = {
+        "Backtracking step budget exhausted",
+        "Raise it with regex_set_backtrack_budget, or avoid nested quantifiers around backreferences"
+        " and possessive quantifiers", false
+    },
+    [BacktrackingInStreamError] = {
+        "Backreferences and possessive quantifiers can not be streamed",
+        "Search the whole input at once with regex_find", false
+    },
+
+    [OutOfMemoryError] = {"Out of memory", NULL, false},
+};
+
+#define ERROR_TEXTS_COUNT (sizeof(ERROR_TEXTS) / sizeof(ERROR_TEXTS[0]))
+
+const char* pattern_error_message(PatternErrorCode code) {
+    return (size_t)code < ERROR_TEXTS_COUNT ? ERROR_TEXTS[code].message : "Unknown error";
+}
+
+const char* pattern_error_hint(PatternErrorCode code) {
+    return (size_t)code < ERROR_TEXTS_COUNT ? ERROR_TEXTS[code].hint : NULL;
+}
+
+// Diagnostic being written, characters past field 'capacity' are only counted
+struct _Writer {
+    char* buffer;
+    size_t capacity;
+    size_t length;
+};
+
+typedef struct _Writer Writer;
+
+static void write_chars(Writer* w, const char* text, size_t length) {
+    for (size_t i = 0;i < length;i++) {
+        if (w->length + 1 < w->capacity) w->buffer[w->length] = text[i];
+        w->length++;
+    }
+}
+
+static void write_string(Writer* w, const char* text) {
+    write_chars(w, text, strlen(text));
+}
+
+static void write_repeated(Writer* w, char c, size_t count) {
+    for (size_t i = 0;i < count;i++) write_chars(w, &c, 1);
+}
+
+size_t format_pattern_error(const PatternError* e, const char* source, size_t length, char* buffer, size_t capacity) {
+    Writer w = (Writer){.buffer = buffer, .capacity = capacity, .length = 0};
+    // The span is clamped to the pattern, an error at its end has no characters under it
+    size_t position = e->position < length ? e->position : length;
+    size_t span = e->span < length - position ? e->span : length - position;
+
+    write_string(&w, pattern_error_message(e->code));
+    if ((size_t)e->code < ERROR_TEXTS_COUNT && ERROR_TEXTS[e->code].quote && span > 0) {
+        write_string(&w, " `");
+        write_chars(&w, source + position, span);
+        write_string(&w, "`");
+    }
+    char number[32];
+    snprintf(number, sizeof(number), " at position %zu" "\n", e->position);
+    write_string(&w, number);
+
+    write_chars(&w, source, length);
+    write_string(&w, "\n");
+    write_repeated(&w, ' ', position);
+    write_repeated(&w, '^', span == 0 ? 1 : span);
+    write_string(&w, "\n");
+
+    const char* hint = pattern_error_hint(e->code);
+    if (hint != NULL) {
+        write_string(&w, hint);
+        write_string(&w, "\n");
+    }
+    if (capacity > 0) buffer[w.length < capacity ? w.length : capacity - 1] = '\0';
+    return w.length;
+}
+
+void print_pattern_error(FILE* stream, const PatternError* e, const char* source, size_t length) {
+    char small[256];
+    size_t needed = format_pattern_error(e, source, length, small, sizeof(small));
+    char* text = small;
+    if (needed >= sizeof(small)) {
+        text = malloc(needed + 1);
+        // Without memory for the whole diagnostic print its beginning
+        if (text == NULL) {
+            text = small;
+            needed = sizeof(small) - 1;
+        } else {
+            format_pattern_error(e, source, length, text, needed + 1);
+        }
+    }
+    fwrite(text, 1, needed, stream);
+    if (text != small) free(text);
+}
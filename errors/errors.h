@@ -0,0 +1,84 @@
+#ifndef ERRORS_H
+#define ERRORS_H
+
+#include "../common.h"
+
+// What is wrong with a pattern, each stage of the compilation has its own codes
+enum _PatternErrorCode {
+    NoError,
+
+    // Scanner
+    InvalidRangeError, // z-a or a-Z inside [ ]
+    TrailingSlashError, // \ at end of pattern
+    InvalidGroupNameError, // \g<...> holding neither a number nor a name
+    ExpectedGroupError, // \g not followed by <
+    InvalidEscapeError, // \ followed by a character with no meaning escaped
+    NestedBracketError, // [ inside [ ]
+    EmptyClassError, // []
+    LoneInverterError, // [^]
+    UnmatchedRightBracketError, // ] without [
+    NestedBraceError, // { inside { }
+    EmptyBracesError, // {}
+    UnmatchedRightBraceError, // } without {
+    UnmatchedRightParenError, // ) without (
+
+    // Parser
+    RepetitionTooLargeError, // number above REPEAT_MAX in { }
+    InvalidBracesError, // anything but {N}, {N,}, {,M} or {N,M}
+    MinAboveMaxError, // {3,2}
+    NothingToRepeatError, // quantifier after nothing, an anchor or the empty string
+    MultipleQuantifiersError, // a**
+    UnmatchedLeftBracketError, // [ without ]
+    UnknownGroupNameError, // \g<name>, groups have no names
+    InvalidGroupReferenceError, // backreference to a group not closed before it
+    UnmatchedLeftParenError, // ( without )
+    UnexpectedTokenError,
+    GroupsTooDeepError, // more than GROUP_DEPTH_MAX groups inside each other
+
+    // Compiler
+    PatternTooLargeError, // more than PROGRAM_MAX_INSTRUCTIONS instructions
+    BacktrackingInSetError, // backreference or possessive quantifier in a RegexSet pattern
+
+    // Searches
+    BacktrackBudgetError, // backtracking search out of steps, see regex_set_backtrack_budget
+    BacktrackingInStreamError, // backreference or possessive quantifier in a streamed pattern
+
+    // Any stage
+    OutOfMemoryError, // malloc or realloc failed
+};
+
+typedef enum _PatternErrorCode PatternErrorCode;
+
+// Why a pattern was rejected or a search with it failed, only a code and a span of the pattern
+// so rejecting costs nothing more than finding the error
+// The message with carets under the span is made by format_pattern_error when asked for
+struct _PatternError {
+    PatternErrorCode code;
+    // Span of the pattern the error is about, source[position, position + span)
+    size_t position;
+    size_t span;
+    // Number of the pattern of a RegexSet the error is in, 0 for a single pattern
+    size_t pattern;
+};
+
+typedef struct _PatternError PatternError;
+
+// Error of a pattern with no error
+#define NO_PATTERN_ERROR ((PatternError){.code = NoError, .position = 0, .span = 0, .pattern = 0})
+
+// One line description of `code`, like "Unmatched )"
+const char* pattern_error_message(PatternErrorCode code);
+
+// How to fix a pattern with error `code`, NULL when there is no advice
+const char* pattern_error_hint(PatternErrorCode code);
+
+// Write the diagnostic of error `e` of pattern `source` of `length` characters into `buffer`:
+// the message and position, the pattern, carets under the span and the hint, one per line
+// Like snprintf, writes at most `capacity` - 1 characters followed by \0 and returns the
+// length of the whole diagnostic, which may be larger than `capacity`
+size_t format_pattern_error(const PatternError* e, const char* source, size_t length, char* buffer, size_t capacity);
+
+// Print the diagnostic of format_pattern_error to `stream`
+void print_pattern_error(FILE* stream, const PatternError* e, const char* source, size_t length);
+
+#endif
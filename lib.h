@@ -1,9 +1,87 @@
 #ifndef C_REGEXPS_LIB_H
 #define C_REGEXPS_LIB_H
 
+// Arena module
+// Bump allocator owning all memory of a compilation, released at once
+#include "./arena/arena.h"
+
+// Errors module
+// Why a pattern was rejected as a code and a span, diagnostics are only formatted when asked for
+#include "./errors/errors.h"
+
 // Scanner module
 // Scanner takes input pattern and transforms it into a Tokens stream
 // to be consumed be the parser
+// IncrementalScanner keeps the Tokens of a pattern being edited, rescanning only around edits
 #include "./scanner/scanner.h"
+#include "./scanner/incremental.h"
+
+// Parser module
+// Parser consumes the Tokens stream and builds the syntax tree of the pattern
+// Nodes are stored in one array and refer to each other by index
+#include "./parser/parser.h"
+
+// Optimizer module
+// Rewrites the syntax tree into a smaller one: merged literals and classes, factored prefixes
+#include "./optimizer/optimizer.h"
+
+// Charset module
+// Character classes as 256 bit bitmaps, with vectorized scans for the first character in or out of one
+#include "./charset/charset.h"
+
+// Compiler module
+// Compiler translates the syntax tree into the instructions of a Thompson NFA
+#include "./compiler/compiler.h"
+
+// Prefilter module
+// Literals every match must contain, found with SIMD loops before any engine runs
+#include "./prefilter/prefilter.h"
+
+// Literal matcher module
+// Aho-Corasick and Teddy searching for patterns that are only an alternation of literals
+#include "./literals/literals.h"
+
+// Pike VM module
+// Runs a program over the input in time linear in the input, tracking capture groups
+#include "./pikevm/pikevm.h"
+
+// Backtrack module
+// Runs backreferences and possessive quantifiers, bounded by a visited bitmap or a step budget
+#include "./backtrack/backtrack.h"
+
+// One-pass module
+// DFA of programs where one thread at most goes on at each character, finding capture
+// groups of anchored searches in a single pass
+#include "./onepass/onepass.h"
+
+// DFA module
+// Lazily determinized program with a bounded cache, the fast path for match/no-match
+// and match end queries
+#include "./dfa/dfa.h"
+
+// Regex module
+// Compiled patterns and the matching functions choosing an engine for each query
+#include "./regex/regex.h"
+
+// Serialize module
+// Compiled patterns saved to a position-independent block and loaded back with mmap,
+// skipping parsing and compilation
+#include "./serialize/serialize.h"
+
+// Pool module
+// Work-stealing thread pool running the tasks of an index range
+#include "./pool/pool.h"
+
+// Batch module
+// One compiled pattern matched against many inputs on a thread pool, a scratch per worker
+#include "./batch/batch.h"
+
+// Cache module
+// Thread-safe bounded cache of compiled patterns keyed by pattern and flags
+#include "./cache/cache.h"
+
+// Regex set module
+// Many patterns compiled together, one pass over the input tells which of them match
+#include "./regexset/regexset.h"
 
 #endif
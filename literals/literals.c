@@ -0,0 +1,314 @@
+#include "./literals.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#include <stdatomic.h>
+#define LITERALS_X86
+#endif
+
+bool is_literal_alternation(const Ast* ast) {
+    const Node* root = &ast->nodes[ast->root];
+    if (root->type == LiteralNode) return root->literal.length > 0;
+    if (root->type != AlternationNode) return false;
+    for (NodeIndex child = root->first_child;child != NO_NODE;child = ast->nodes[child].next_sibling) {
+        const Node* node = &ast->nodes[child];
+        if (node->type != LiteralNode || node->literal.length == 0) return false;
+    }
+    return true;
+}
+
+static uint32_t find_child(const LiteralMatcher* m, uint32_t s, unsigned char byte) {
+    for (uint32_t child = m->states[s].first_child;child != AC_NONE;child = m->states[child].next_sibling) {
+        if (m->states[child].byte == byte) return child;
+    }
+    return AC_NONE;
+}
+
+// State reached from `s` over `byte`, following failures until some state has the transition
+static uint32_t next_state(const LiteralMatcher* m, uint32_t s, unsigned char byte) {
+    while (true) {
+        const AcState* state = &m->states[s];
+        if (state->dense_row != AC_NONE) return m->dense[(size_t)state->dense_row * 256 + byte];
+        uint32_t child = find_child(m, s, byte);
+        if (child != AC_NONE) return child;
+        s = state->fail;
+    }
+}
+
+static uint32_t add_state(LiteralMatcher* m, uint32_t parent, unsigned char byte) {
+    uint32_t id = m->state_count++;
+    m->states[id] = (AcState) {
+        .byte = byte,
+        .depth = parent == AC_NONE ? 0 : m->states[parent].depth + 1,
+        .first_child = AC_NONE,
+        .next_sibling = AC_NONE,
+        .fail = 0,
+        .output = AC_NONE,
+        .literal = AC_NONE,
+        .dense_row = AC_NONE,
+    };
+    if (parent != AC_NONE) {
+        m->states[id].next_sibling = m->states[parent].first_child;
+        m->states[parent].first_child = id;
+    }
+    return id;
+}
+
+// Fill the Teddy tables, literals are spread over the buckets in order
+static void build_teddy(LiteralMatcher* m) {
+    uint32_t shortest = UINT32_MAX;
+    for (uint32_t i = 0;i < m->count;i++) if (m->lengths[i] < shortest) shortest = m->lengths[i];
+    m->teddy_length = shortest < TEDDY_MAX_PREFIX ? shortest : TEDDY_MAX_PREFIX;
+
+    for (uint32_t i = 0;i < m->count;i++) {
+        uint32_t bucket = i * TEDDY_BUCKETS / m->count;
+        m->teddy_buckets[bucket] |= 1ull << i;
+        for (uint32_t k = 0;k < m->teddy_length;k++) {
+            unsigned char c = m->bytes[m->starts[i] + k];
+            m->teddy_masks[k][0][c & 0xF] |= 1 << bucket;
+            m->teddy_masks[k][1][c >> 4] |= 1 << bucket;
+        }
+    }
+}
+
+LiteralMatcher new_literal_matcher(Arena* arena, const Ast* ast) {
+    LiteralMatcher m = (LiteralMatcher) {
+        .count = 0,
+        .bytes = ast->bytes,
+        .state_count = 0,
+        .first_bytes = {false},
+        .teddy_length = 0,
+        .teddy_masks = {{{0}}},
+        .teddy_buckets = {0},
+    };
+
+    const Node* root = &ast->nodes[ast->root];
+    NodeIndex first = root->type == LiteralNode ? ast->root : root->first_child;
+    uint32_t total = 0;
+    for (NodeIndex child = first;child != NO_NODE;child = ast->nodes[child].next_sibling) {
+        m.count++;
+        total += ast->nodes[child].literal.length;
+    }
+    m.starts = arena_alloc(arena, m.count * sizeof(uint32_t));
+    m.lengths = arena_alloc(arena, m.count * sizeof(uint32_t));
+    m.states = arena_alloc(arena, (total + 1) * sizeof(AcState));
+
+    // Trie of the literals, a literal already present keeps its lower number
+    add_state(&m, AC_NONE, 0);
+    uint32_t i = 0;
+    for (NodeIndex child = first;i < m.count;child = ast->nodes[child].next_sibling, i++) {
+        const Node* node = &ast->nodes[child];
+        m.starts[i] = node->literal.start;
+        m.lengths[i] = node->literal.length;
+        m.first_bytes[(unsigned char)m.bytes[m.starts[i]]] = true;
+        uint32_t s = 0;
+        for (uint32_t k = 0;k < m.lengths[i];k++) {
+            unsigned char byte = m.bytes[m.starts[i] + k];
+            uint32_t next = find_child(&m, s, byte);
+            s = next != AC_NONE ? next : add_state(&m, s, byte);
+        }
+        if (m.states[s].literal == AC_NONE) m.states[s].literal = i;
+    }
+
+    // Failure links in breadth first order, a state's failure is shallower than the state
+    uint32_t* queue = arena_alloc(arena, m.state_count * sizeof(uint32_t));
+    uint32_t head = 0;
+    uint32_t tail = 0;
+    queue[tail++] = 0;
+    uint32_t dense_count = 0;
+    while (head < tail) {
+        uint32_t s = queue[head++];
+        if (m.states[s].depth <= AC_DENSE_DEPTH) dense_count++;
+        for (uint32_t child = m.states[s].first_child;child != AC_NONE;child = m.states[child].next_sibling) {
+            queue[tail++] = child;
+            uint32_t fail = 0;
+            if (s != 0) {
+                uint32_t f = m.states[s].fail;
+                while (f != 0 && find_child(&m, f, m.states[child].byte) == AC_NONE) f = m.states[f].fail;
+                uint32_t target = find_child(&m, f, m.states[child].byte);
+                if (target != AC_NONE) fail = target;
+            }
+            m.states[child].fail = fail;
+            m.states[child].output = m.states[fail].literal != AC_NONE ? fail : m.states[fail].output;
+        }
+    }
+
+    // Dense rows for the shallow states, filled in breadth first order so the row of the
+    // failure of a state is complete before the state's own row
+    m.dense = arena_alloc(arena, (size_t)dense_count * 256 * sizeof(uint32_t));
+    uint32_t rows = 0;
+    for (uint32_t q = 0;q < m.state_count && m.states[queue[q]].depth <= AC_DENSE_DEPTH;q++) {
+        uint32_t s = queue[q];
+        uint32_t* row = m.dense + (size_t)rows * 256;
+        for (uint32_t byte = 0;byte < 256;byte++) {
+            uint32_t child = find_child(&m, s, byte);
+            if (child != AC_NONE) row[byte] = child;
+            else row[byte] = s == 0 ? 0 : next_state(&m, m.states[s].fail, byte);
+        }
+        m.states[s].dense_row = rows++;
+    }
+
+    if (m.count <= TEDDY_MAX_LITERALS) build_teddy(&m);
+    return m;
+}
+
+bool literal_matcher_is_valid(const LiteralMatcher* m, size_t byte_count, uint32_t dense_rows) {
+    if (m->count == 0 || m->state_count == 0) return false;
+    uint32_t shortest = UINT32_MAX;
+    for (uint32_t i = 0;i < m->count;i++) {
+        if (m->lengths[i] == 0 || m->starts[i] > byte_count || m->lengths[i] > byte_count - m->starts[i]) return false;
+        if (m->lengths[i] < shortest) shortest = m->lengths[i];
+    }
+    if (m->teddy_length > TEDDY_MAX_PREFIX || m->teddy_length > shortest) return false;
+    uint64_t literals = m->count >= 64 ? UINT64_MAX : (1ull << m->count) - 1;
+    for (uint32_t b = 0;b < TEDDY_BUCKETS;b++) {
+        if (m->teddy_buckets[b] & ~literals) return false;
+    }
+
+    // Searches walk down child lists, up failures and outputs, and stop at the root's dense row:
+    // children are numbered after their parent and siblings before each other, failures
+    // and outputs are shallower
+    const AcState* root = &m->states[0];
+    if (root->depth != 0 || root->dense_row == AC_NONE) return false;
+    for (uint32_t s = 0;s < m->state_count;s++) {
+        const AcState* state = &m->states[s];
+        if (state->first_child != AC_NONE) {
+            if (state->first_child <= s || state->first_child >= m->state_count) return false;
+            if (m->states[state->first_child].depth != state->depth + 1) return false;
+        }
+        if (state->next_sibling != AC_NONE) {
+            if (state->next_sibling >= s || m->states[state->next_sibling].depth != state->depth) return false;
+        }
+        if (state->fail >= m->state_count || (s != 0 && m->states[state->fail].depth >= state->depth)) return false;
+        if (state->output != AC_NONE) {
+            if (state->output >= m->state_count || m->states[state->output].depth >= state->depth) return false;
+            if (m->states[state->output].literal == AC_NONE) return false;
+        }
+        if (state->literal != AC_NONE && (state->literal >= m->count || m->lengths[state->literal] != state->depth)) return false;
+        if (state->dense_row != AC_NONE && state->dense_row >= dense_rows) return false;
+    }
+    for (size_t i = 0;i < (size_t)dense_rows * 256;i++) {
+        if (m->dense[i] >= m->state_count) return false;
+    }
+    return true;
+}
+
+static bool ac_find(
+    const LiteralMatcher* m, const char* input, size_t length,
+    size_t from, size_t* start, size_t* end
+) {
+    const unsigned char* text = (const unsigned char*)input;
+    uint32_t s = 0;
+    size_t best_start = NO_POSITION;
+    uint32_t best = AC_NONE;
+    for (size_t i = from;i < length;i++) {
+        if (s == 0 && best == AC_NONE) {
+            while (i < length && !m->first_bytes[text[i]]) i++;
+            if (i == length) break;
+        }
+        s = next_state(m, s, text[i]);
+        // The deepest state is the longest literal prefix still running, once it is shorter
+        // than the best match so far no literal can start at or before it anymore
+        if (best != AC_NONE && m->states[s].depth < i + 1 - best_start) break;
+
+        uint32_t o = m->states[s].literal != AC_NONE ? s : m->states[s].output;
+        for (;o != AC_NONE;o = m->states[o].output) {
+            uint32_t literal = m->states[o].literal;
+            size_t literal_start = i + 1 - m->states[o].depth;
+            if (best == AC_NONE || literal_start < best_start || (literal_start == best_start && literal < best)) {
+                best = literal;
+                best_start = literal_start;
+            }
+        }
+    }
+    if (best == AC_NONE) return false;
+    *start = best_start;
+    *end = best_start + m->lengths[best];
+    return true;
+}
+
+#ifdef LITERALS_X86
+
+static bool has_ssse3(void) {
+    // Atomic as searches of several threads may ask first at once
+    static atomic_int supported = -1;
+    int known = atomic_load_explicit(&supported, memory_order_relaxed);
+    if (known < 0) {
+        known = __builtin_cpu_supports("ssse3") ? 1 : 0;
+        atomic_store_explicit(&supported, known, memory_order_relaxed);
+    }
+    return known;
+}
+
+// Each of the 16 bytes of a block gets the buckets whose literals may start there:
+// for every prefix position k, the buckets of the low nibble and of the high nibble of
+// the character k further, all of them combined with and
+// Candidates are then compared against the literals of their buckets in order
+__attribute__((target("ssse3")))
+static bool teddy_find(
+    const LiteralMatcher* m, const char* input, size_t length,
+    size_t from, size_t* start, size_t* end
+) {
+    const __m128i nibble = _mm_set1_epi8(0xF);
+    __m128i low_masks[TEDDY_MAX_PREFIX];
+    __m128i high_masks[TEDDY_MAX_PREFIX];
+    uint32_t n = m->teddy_length;
+    for (uint32_t k = 0;k < n;k++) {
+        low_masks[k] = _mm_loadu_si128((const __m128i*)m->teddy_masks[k][0]);
+        high_masks[k] = _mm_loadu_si128((const __m128i*)m->teddy_masks[k][1]);
+    }
+
+    size_t i = from;
+    for (;i + n - 1 + 16 <= length;i += 16) {
+        __m128i buckets = _mm_set1_epi8(-1);
+        for (uint32_t k = 0;k < n;k++) {
+            __m128i block = _mm_loadu_si128((const __m128i*)(input + i + k));
+            __m128i low = _mm_and_si128(block, nibble);
+            __m128i high = _mm_and_si128(_mm_srli_epi16(block, 4), nibble);
+            buckets = _mm_and_si128(buckets, _mm_and_si128(
+                _mm_shuffle_epi8(low_masks[k], low), _mm_shuffle_epi8(high_masks[k], high)
+            ));
+        }
+        unsigned candidates = ~_mm_movemask_epi8(_mm_cmpeq_epi8(buckets, _mm_setzero_si128())) & 0xFFFF;
+        if (candidates == 0) continue;
+
+        uint8_t bucket_bytes[16];
+        _mm_storeu_si128((__m128i*)bucket_bytes, buckets);
+        while (candidates != 0) {
+            unsigned j = __builtin_ctz(candidates);
+            candidates &= candidates - 1;
+            size_t position = i + j;
+            uint64_t literals = 0;
+            for (uint32_t b = 0;b < TEDDY_BUCKETS;b++) {
+                if (bucket_bytes[j] & (1 << b)) literals |= m->teddy_buckets[b];
+            }
+            for (;literals != 0;literals &= literals - 1) {
+                uint32_t literal = __builtin_ctzll(literals);
+                uint32_t literal_length = m->lengths[literal];
+                if (
+                    literal_length <= length - position &&
+                    memcmp(input + position, m->bytes + m->starts[literal], literal_length) == 0
+                ) {
+                    *start = position;
+                    *end = position + literal_length;
+                    return true;
+                }
+            }
+        }
+    }
+    // Too close to the end for a whole block
+    return ac_find(m, input, length, i, start, end);
+}
+
+#endif
+
+bool literal_matcher_find(
+    const LiteralMatcher* m, const char* input, size_t length,
+    size_t from, size_t* start, size_t* end
+) {
+    if (from > length) return false;
+#ifdef LITERALS_X86
+    if (m->teddy_length > 0 && has_ssse3()) return teddy_find(m, input, length, from, start, end);
+#endif
+    return ac_find(m, input, length, from, start, end);
+}
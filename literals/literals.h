@@ -0,0 +1,90 @@
+#ifndef LITERALS_H
+#define LITERALS_H
+
+#include "../arena/arena.h"
+#include "../parser/parser.h"
+#include "../compiler/program.h"
+
+// Literal matcher: patterns made only of an alternation of literals, like foo|bar|baz,
+// are searched for without an automaton over the program
+// An Aho-Corasick trie answers every search, up to TEDDY_MAX_LITERALS literals are first
+// looked for 16 positions at a time by Teddy, a vectorized filter on their first characters
+
+// Most literals Teddy handles, one bit per literal in a bucket
+#define TEDDY_MAX_LITERALS 64
+// Teddy groups literals into this many buckets, one bit per bucket in its masks
+#define TEDDY_BUCKETS 8
+// Most leading characters of the literals Teddy compares
+#define TEDDY_MAX_PREFIX 3
+
+// Missing state or literal in an Aho-Corasick trie
+#define AC_NONE UINT32_MAX
+// States this close to the root get a full row of 256 transitions
+#define AC_DENSE_DEPTH 1
+
+// State of the trie, the path from the root to a state spells the text it stands for
+// Children of a state are a list: field 'first_child' then field 'next_sibling' of each child
+struct _AcState {
+    unsigned char byte;
+    uint32_t depth;
+    uint32_t first_child;
+    uint32_t next_sibling;
+    // State of the longest proper suffix of this state's text that is in the trie
+    uint32_t fail;
+    // Closest state on the failure chain (excluding this one) where a literal ends
+    uint32_t output;
+    // Lowest numbered literal ending at this state
+    uint32_t literal;
+    // Row in field 'dense' of the matcher, AC_NONE for states using their child list
+    uint32_t dense_row;
+};
+
+typedef struct _AcState AcState;
+
+struct _LiteralMatcher {
+    uint32_t count;
+    // Literal i is bytes[starts[i], starts[i] + lengths[i])
+    const char* bytes;
+    uint32_t* starts;
+    uint32_t* lengths;
+
+    // Aho-Corasick trie, state 0 is the root
+    AcState* states;
+    uint32_t state_count;
+    // 256 transitions per dense state, failures already followed
+    uint32_t* dense;
+    // Characters some literal starts with, the search skips others while at the root
+    bool first_bytes[256];
+
+    // Teddy tables, only used when field 'teddy_length' is not 0
+    // Length of the prefix compared, at most the length of the shortest literal
+    uint32_t teddy_length;
+    // For prefix position k, masks[k][0] and masks[k][1] give the buckets holding a literal
+    // whose k-th character has that low and high nibble
+    uint8_t teddy_masks[TEDDY_MAX_PREFIX][2][16];
+    // Literals of each bucket, one bit per literal number
+    uint64_t teddy_buckets[TEDDY_BUCKETS];
+};
+
+typedef struct _LiteralMatcher LiteralMatcher;
+
+// Whether the whole pattern is a literal or an alternation of non-empty literals
+bool is_literal_alternation(const Ast* ast);
+
+// Build the matcher of a tree for which is_literal_alternation holds, memory comes from `arena`
+LiteralMatcher new_literal_matcher(Arena* arena, const Ast* ast);
+
+// Whether every index of `m` is in bounds and every chain of its trie ends, with field 'bytes'
+// holding `byte_count` characters and field 'dense' `dense_rows` rows
+// Matchers read back with regex_deserialize are checked with it
+bool literal_matcher_is_valid(const LiteralMatcher* m, size_t byte_count, uint32_t dense_rows);
+
+// Find the leftmost-first match at or after `from`: the leftmost position a literal starts at,
+// the lowest numbered literal starting there when several do
+// On a match fills `start` and `end` and returns true
+bool literal_matcher_find(
+    const LiteralMatcher* m, const char* input, size_t length,
+    size_t from, size_t* start, size_t* end
+);
+
+#endif
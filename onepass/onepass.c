@@ -0,0 +1,243 @@
+#include "./onepass.h"
+
+// Path followed through the empty transitions of a node, with what it met so far
+struct _ClosureFrame {
+    uint32_t pc;
+    uint32_t conditions;
+    uint64_t saves;
+};
+
+typedef struct _ClosureFrame ClosureFrame;
+
+// Fill fields 'loops' and 'loop_sets' of `o`
+static void find_loops(Arena* arena, OnePass* o, const uint8_t* representative) {
+    const Program* p = o->program;
+    CharSet* sets = malloc(o->node_count * sizeof(CharSet));
+    uint32_t set_count = 0;
+    for (uint32_t node = 0;node < o->node_count;node++) {
+        o->loops[node] = ONE_PASS_NONE;
+        if (o->matches[node].next != ONE_PASS_NONE && o->matches[node].conditions != 0) continue;
+
+        CharSet set = new_charset();
+        bool loops = false;
+        for (uint32_t k = 0;k < o->stride;k++) {
+            const OnePassAction* action = &o->actions[(size_t)node * o->stride + k];
+            if (action->next != node || action->conditions != 0 || action->saves != 0 || action->match_wins) continue;
+            for (uint32_t c = representative[k];c < 256;c++) {
+                if (p->byte_classes[c] == k) charset_add_range(&set, c, c);
+            }
+            loops = true;
+        }
+        if (loops) {
+            sets[set_count] = set;
+            o->loops[node] = set_count++;
+        }
+    }
+    if (set_count > 0) {
+        o->loop_sets = arena_alloc(arena, set_count * sizeof(CharSet));
+        memcpy(o->loop_sets, sets, set_count * sizeof(CharSet));
+    }
+    o->loop_set_count = set_count;
+    free(sets);
+}
+
+OnePass new_one_pass(Arena* arena, const Program* p) {
+    OnePass o = (OnePass){.is_one_pass = false, .program = p};
+    if (p->needs_backtracking || p->all_matches || p->slot_count > ONE_PASS_MAX_SLOTS) return o;
+
+    // A node starts at the program start and after each instruction consuming a character
+    uint32_t stride = p->byte_class_count;
+    size_t max_nodes = 1;
+    for (uint32_t pc = 0;pc < p->length;pc++) {
+        Opcode op = p->instructions[pc].op;
+        if (op == OpByte || op == OpClass) max_nodes++;
+    }
+    if (max_nodes * stride * sizeof(OnePassAction) > ONE_PASS_MAX_SIZE) return o;
+
+    // Classes are decided by any of their characters, take the first one
+    uint8_t representative[256];
+    for (int c = 255;c >= 0;c--) representative[p->byte_classes[c]] = c;
+
+    // Node starting at each instruction and instruction each node starts at
+    uint32_t* node_of = malloc(p->length * sizeof(uint32_t));
+    uint32_t* entries = malloc(max_nodes * sizeof(uint32_t));
+    // Last node whose empty transitions reached each instruction
+    uint32_t* seen = malloc(p->length * sizeof(uint32_t));
+    // Each instruction is reached once per node, so pushes at most one split branch
+    ClosureFrame* stack = malloc(p->length * sizeof(ClosureFrame));
+    OnePassAction* actions = malloc(max_nodes * stride * sizeof(OnePassAction));
+    OnePassAction* matches = malloc(max_nodes * sizeof(OnePassAction));
+    for (uint32_t pc = 0;pc < p->length;pc++) {
+        node_of[pc] = ONE_PASS_NONE;
+        seen[pc] = ONE_PASS_NONE;
+    }
+
+    const OnePassAction none = (OnePassAction){.next = ONE_PASS_NONE, .conditions = 0, .saves = 0, .match_wins = false};
+    uint32_t node_count = 1;
+    node_of[p->start] = 0;
+    entries[0] = p->start;
+    bool one_pass = true;
+    for (uint32_t node = 0;one_pass && node < node_count;node++) {
+        OnePassAction* row = actions + (size_t)node * stride;
+        for (uint32_t k = 0;k < stride;k++) row[k] = none;
+        matches[node] = none;
+
+        // Follow the empty transitions in priority order, threads reached after the match
+        // only go on when the match does not hold
+        bool matched = false;
+        size_t top = 0;
+        stack[top++] = (ClosureFrame){.pc = entries[node], .conditions = 0, .saves = 0};
+        while (one_pass && top > 0) {
+            ClosureFrame frame = stack[--top];
+            uint32_t pc = frame.pc;
+            bool follow = true;
+            while (follow) {
+                // Two paths to one instruction could set different slots, one state can not hold both
+                if (seen[pc] == node) {
+                    one_pass = false;
+                    break;
+                }
+                seen[pc] = node;
+
+                Instruction inst = p->instructions[pc];
+                if (inst.op == OpJmp) {
+                    pc = inst.x;
+                } else if (inst.op == OpSplit) {
+                    stack[top++] = (ClosureFrame){.pc = inst.y, .conditions = frame.conditions, .saves = frame.saves};
+                    pc = inst.x;
+                } else if (inst.op == OpSave) {
+                    frame.saves |= 1ull << inst.x;
+                    pc++;
+                } else if (inst.op == OpAssert) {
+                    frame.conditions |= 1u << inst.x;
+                    pc++;
+                } else if (inst.op == OpMatch) {
+                    matches[node] = (OnePassAction) {
+                        .next = 0, .conditions = frame.conditions, .saves = frame.saves, .match_wins = false,
+                    };
+                    matched = true;
+                    follow = false;
+                } else {
+                    // OpByte or OpClass, the program needs no backtracking
+                    if (node_of[pc + 1] == ONE_PASS_NONE) {
+                        node_of[pc + 1] = node_count;
+                        entries[node_count++] = pc + 1;
+                    }
+                    for (uint32_t k = 0;k < stride && one_pass;k++) {
+                        unsigned char c = representative[k];
+                        bool consumes = inst.op == OpByte ? c == inst.x : program_class_contains(p, inst.x, c);
+                        if (!consumes) continue;
+                        // Another thread already takes this character
+                        if (row[k].next != ONE_PASS_NONE) one_pass = false;
+                        row[k] = (OnePassAction) {
+                            .next = node_of[pc + 1],
+                            .conditions = frame.conditions,
+                            .saves = frame.saves,
+                            .match_wins = matched,
+                        };
+                    }
+                    follow = false;
+                }
+            }
+        }
+    }
+
+    if (one_pass) {
+        // Anchored when every way out of the start requires \A
+        uint32_t start_text = 1u << AssertStartText;
+        bool anchored = matches[0].next == ONE_PASS_NONE || (matches[0].conditions & start_text);
+        for (uint32_t k = 0;k < stride;k++) {
+            if (actions[k].next != ONE_PASS_NONE && !(actions[k].conditions & start_text)) anchored = false;
+        }
+
+        size_t size = (size_t)node_count * stride * sizeof(OnePassAction);
+        o = (OnePass) {
+            .is_one_pass = true,
+            .program = p,
+            .node_count = node_count,
+            .stride = stride,
+            .actions = arena_alloc(arena, size),
+            .matches = arena_alloc(arena, node_count * sizeof(OnePassAction)),
+            .anchored = anchored,
+            .loops = arena_alloc(arena, node_count * sizeof(uint32_t)),
+            .loop_sets = NULL,
+            .loop_set_count = 0,
+        };
+        memcpy(o.actions, actions, size);
+        memcpy(o.matches, matches, node_count * sizeof(OnePassAction));
+        find_loops(arena, &o, representative);
+    }
+
+    free(node_of);
+    free(entries);
+    free(seen);
+    free(stack);
+    free(actions);
+    free(matches);
+    return o;
+}
+
+// Whether `action` leads to a node of `o` and only asserts and saves what the program has
+static bool action_is_valid(const OnePass* o, const OnePassAction* action) {
+    uint32_t slot_count = o->program->slot_count;
+    uint64_t slots = slot_count == 64 ? UINT64_MAX : (1ull << slot_count) - 1;
+    return
+        (action->next == ONE_PASS_NONE || action->next < o->node_count) &&
+        action->conditions < (1u << (AssertNotWordBoundary + 1)) &&
+        (action->saves & ~slots) == 0;
+}
+
+bool one_pass_is_valid(const OnePass* o) {
+    if (!o->is_one_pass) return true;
+    const Program* p = o->program;
+    if (p->needs_backtracking || p->all_matches || p->slot_count > ONE_PASS_MAX_SLOTS) return false;
+    if (o->node_count == 0 || o->stride != p->byte_class_count) return false;
+    for (size_t i = 0;i < (size_t)o->node_count * o->stride;i++) {
+        if (!action_is_valid(o, &o->actions[i])) return false;
+    }
+    for (uint32_t node = 0;node < o->node_count;node++) {
+        if (!action_is_valid(o, &o->matches[node])) return false;
+        if (o->loops[node] != ONE_PASS_NONE && o->loops[node] >= o->loop_set_count) return false;
+    }
+    return true;
+}
+
+// Whether every assertion with its bit set in `conditions` holds at `position`
+static bool conditions_hold(uint32_t conditions, const char* input, size_t length, size_t position) {
+    for (;conditions != 0;conditions &= conditions - 1) {
+        if (!assert_holds(__builtin_ctz(conditions), input, length, position)) return false;
+    }
+    return true;
+}
+
+static void save(size_t* slots, uint64_t saves, size_t position) {
+    for (;saves != 0;saves &= saves - 1) slots[__builtin_ctzll(saves)] = position;
+}
+
+bool one_pass_search(const OnePass* o, const char* input, size_t length, size_t start, size_t* slots) {
+    const Program* p = o->program;
+    size_t work[ONE_PASS_MAX_SLOTS];
+    for (uint32_t i = 0;i < p->slot_count;i++) work[i] = NO_POSITION;
+
+    bool matched = false;
+    uint32_t node = 0;
+    for (size_t position = start;;position++) {
+        if (o->loops[node] != ONE_PASS_NONE) position = charset_skip(&o->loop_sets[o->loops[node]], input, length, position);
+        const OnePassAction* match = &o->matches[node];
+        bool match_here = match->next != ONE_PASS_NONE && conditions_hold(match->conditions, input, length, position);
+        if (match_here) {
+            // A longer match of higher priority may still come, keep this one in case it does not
+            memcpy(slots, work, p->slot_count * sizeof(size_t));
+            save(slots, match->saves, position);
+            matched = true;
+        }
+        if (position == length) break;
+
+        const OnePassAction* action = &o->actions[(size_t)node * o->stride + p->byte_classes[(unsigned char)input[position]]];
+        if (action->next == ONE_PASS_NONE || (match_here && action->match_wins)) break;
+        if (!conditions_hold(action->conditions, input, length, position)) break;
+        save(work, action->saves, position);
+        node = action->next;
+    }
+    return matched;
+}
@@ -0,0 +1,77 @@
+#ifndef ONEPASS_H
+#define ONEPASS_H
+
+#include "../arena/arena.h"
+#include "../compiler/program.h"
+
+// One-pass DFA runs programs where, at every input character, at most one thread can go on
+// Such a program is in one state at a time, a node, and each transition of a node knows
+// which capture slots to set, so groups are found at DFA speed with one set of slots
+// Only anchored searches are one-pass, the unanchored loop before a match would be
+// a second thread on every character a match can start with
+// Like (\d+)-(\w+) most extraction patterns are one-pass, while (\w+)(\d+) is not: after
+// a digit both groups could go on
+
+// Most capture slots of a one-pass program, a transition sets them with one bit mask
+#define ONE_PASS_MAX_SLOTS 64
+
+// Largest transition table of a one-pass program in bytes, bigger programs are not one-pass
+#define ONE_PASS_MAX_SIZE (1 << 20)
+
+// Next node of a transition no thread takes
+#define ONE_PASS_NONE UINT32_MAX
+
+// What happens on one character in a node, or when the node matches
+struct _OnePassAction {
+    // Node after the character, ONE_PASS_NONE when no thread takes it
+    uint32_t next;
+    // Bit (1 << kind) of each AssertKind that must hold at the position of the character
+    uint32_t conditions;
+    // Bit i set when capture slot i takes the position of the character
+    uint64_t saves;
+    // A match of the node has priority over the thread taking the character
+    bool match_wins;
+};
+
+typedef struct _OnePassAction OnePassAction;
+
+// One-pass DFA of a program, only read by searches so threads share it freely
+struct _OnePass {
+    // Whether the program is one-pass, nothing else is set otherwise
+    bool is_one_pass;
+    const Program* program;
+    // Node 0 is where a match starts
+    uint32_t node_count;
+    // Field 'byte_class_count' of the program, the action of class k in node i is at i * stride + k
+    uint32_t stride;
+    OnePassAction* actions;
+    // Match of each node, field 'next' is ONE_PASS_NONE when the node can not match
+    OnePassAction* matches;
+    // Every match starts at the start of the input (the pattern begins with \A)
+    bool anchored;
+    // Per node, index in field 'loop_sets' of the characters leading back to the node without
+    // setting a slot, or ONE_PASS_NONE
+    // The match of such a node holds anywhere or nowhere, so a run of them like the digits of
+    // (\d+) is skipped at once and only its end is looked at
+    uint32_t* loops;
+    CharSet* loop_sets;
+    uint32_t loop_set_count;
+};
+
+typedef struct _OnePass OnePass;
+
+// Build the one-pass DFA of `p` in `arena`, with field 'is_one_pass' cleared when `p` is not one-pass
+// Programs with more than ONE_PASS_MAX_SLOTS capture slots, set programs and programs needing
+// the backtracker are never one-pass
+OnePass new_one_pass(Arena* arena, const Program* p);
+
+// Whether every node and slot `o` refers to is in bounds, checked on one-pass DFAs read back
+// with regex_deserialize
+bool one_pass_is_valid(const OnePass* o);
+
+// Find the leftmost-first match of the program of `o` beginning exactly at `start`
+// Characters before `start` are still seen by \b and \B
+// On a match fills `slots` (field 'slot_count' of the program entries) and returns true
+bool one_pass_search(const OnePass* o, const char* input, size_t length, size_t start, size_t* slots);
+
+#endif
@@ -0,0 +1,394 @@
+#include "./optimizer.h"
+
+static NodeIndex push_node(Optimizer* o, NodeType type, uint32_t position) {
+    return ast_push_node(o->arena, o->ast, (Node) {
+        .type = type,
+        .position = position,
+        .first_child = NO_NODE,
+        .next_sibling = NO_NODE,
+    });
+}
+
+static NodeIndex push_literal(Optimizer* o, uint32_t start, uint32_t length, uint32_t position) {
+    NodeIndex node = push_node(o, LiteralNode, position);
+    o->ast->nodes[node].literal.start = start;
+    o->ast->nodes[node].literal.length = length;
+    return node;
+}
+
+// Children of node `index` in an array from the arena
+static NodeIndex* children(Optimizer* o, NodeIndex index, uint32_t* count) {
+    const Ast* ast = o->ast;
+    *count = 0;
+    for (NodeIndex child = ast->nodes[index].first_child;child != NO_NODE;child = ast->nodes[child].next_sibling) (*count)++;
+    NodeIndex* list = arena_alloc(o->arena, (*count + 1) * sizeof(NodeIndex));
+    uint32_t i = 0;
+    for (NodeIndex child = ast->nodes[index].first_child;child != NO_NODE;child = ast->nodes[child].next_sibling) list[i++] = child;
+    return list;
+}
+
+// New node of `type` with the `count` nodes of `list` as children
+static NodeIndex push_parent(Optimizer* o, NodeType type, const NodeIndex* list, uint32_t count, uint32_t position) {
+    NodeIndex node = push_node(o, type, position);
+    Node* nodes = o->ast->nodes;
+    nodes[node].first_child = list[0];
+    for (uint32_t i = 0;i < count;i++) nodes[list[i]].next_sibling = i + 1 < count ? list[i + 1] : NO_NODE;
+    return node;
+}
+
+// Append `length` characters to field 'bytes' of the tree, copied from `source` unless it is NULL
+// Returns where they start
+static uint32_t push_bytes(Optimizer* o, const char* source, uint32_t length) {
+    Ast* ast = o->ast;
+    if (ast->byte_count + length > ast->byte_capacity) {
+        uint32_t capacity = ast->byte_capacity == 0 ? 64 : 2 * ast->byte_capacity;
+        while (capacity < ast->byte_count + length) capacity *= 2;
+        ast->bytes = arena_grow(o->arena, ast->bytes, ast->byte_capacity, capacity);
+        ast->byte_capacity = capacity;
+    }
+    uint32_t start = ast->byte_count;
+    if (source != NULL) memcpy(ast->bytes + start, source, length);
+    ast->byte_count += length;
+    return start;
+}
+
+// Append literal node `b` to literal node `a`
+static void merge_literals(Optimizer* o, NodeIndex a, NodeIndex b) {
+    Ast* ast = o->ast;
+    uint32_t a_start = ast->nodes[a].literal.start;
+    uint32_t a_length = ast->nodes[a].literal.length;
+    uint32_t b_start = ast->nodes[b].literal.start;
+    uint32_t b_length = ast->nodes[b].literal.length;
+    if (a_start + a_length != b_start) {
+        // Not next to each other in field 'bytes', copy both to its end unless `a` already is
+        if (a_start + a_length != ast->byte_count) {
+            uint32_t start = push_bytes(o, NULL, a_length);
+            memcpy(ast->bytes + start, ast->bytes + a_start, a_length);
+            a_start = start;
+        }
+        uint32_t start = push_bytes(o, NULL, b_length);
+        memcpy(ast->bytes + start, ast->bytes + b_start, b_length);
+    }
+    ast->nodes[a].literal.start = a_start;
+    ast->nodes[a].literal.length = a_length + b_length;
+}
+
+static int compare_ranges(const void* a, const void* b) {
+    const ClassRange* x = a;
+    const ClassRange* y = b;
+    if (x->low != y->low) return x->low - y->low;
+    return x->high - y->high;
+}
+
+// Sort and merge `count` ranges into `out`, complemented when `negated`
+// At most 129 ranges come out, returns how many
+static uint32_t normalize_ranges(Optimizer* o, const ClassRange* ranges, uint32_t count, bool negated, ClassRange* out) {
+    ClassRange* sorted = arena_alloc(o->arena, (count + 1) * sizeof(ClassRange));
+    memcpy(sorted, ranges, count * sizeof(ClassRange));
+    qsort(sorted, count, sizeof(ClassRange), compare_ranges);
+
+    // Merge overlapping and adjacent ranges, at most 128 remain
+    ClassRange merged[128];
+    uint32_t merged_count = 0;
+    for (uint32_t i = 0;i < count;i++) {
+        ClassRange r = sorted[i];
+        if (merged_count > 0 && r.low <= merged[merged_count - 1].high + 1) {
+            if (r.high > merged[merged_count - 1].high) merged[merged_count - 1].high = r.high;
+        } else {
+            merged[merged_count++] = r;
+        }
+    }
+
+    if (!negated) {
+        memcpy(out, merged, merged_count * sizeof(ClassRange));
+        return merged_count;
+    }
+    uint32_t out_count = 0;
+    unsigned next = 0;
+    for (uint32_t i = 0;i < merged_count;i++) {
+        if (merged[i].low > next) out[out_count++] = (ClassRange){.low = next, .high = merged[i].low - 1};
+        next = merged[i].high + 1;
+    }
+    if (next <= 255) out[out_count++] = (ClassRange){.low = next, .high = 255};
+    return out_count;
+}
+
+// Node matching one character of `count` sorted ranges, a literal when there is only one character
+static NodeIndex push_class(Optimizer* o, const ClassRange* ranges, uint32_t count, uint32_t position) {
+    if (count == 1 && ranges[0].low == ranges[0].high) {
+        char c = ranges[0].low;
+        return push_literal(o, push_bytes(o, &c, 1), 1, position);
+    }
+
+    Ast* ast = o->ast;
+    if (ast->range_count + count > ast->range_capacity) {
+        uint32_t capacity = ast->range_capacity == 0 ? 16 : 2 * ast->range_capacity;
+        while (capacity < ast->range_count + count) capacity *= 2;
+        ast->ranges = arena_grow(
+            o->arena, ast->ranges,
+            ast->range_capacity * sizeof(ClassRange), capacity * sizeof(ClassRange)
+        );
+        ast->range_capacity = capacity;
+    }
+    uint32_t start = ast->range_count;
+    memcpy(ast->ranges + start, ranges, count * sizeof(ClassRange));
+    ast->range_count += count;
+
+    NodeIndex node = push_node(o, ClassNode, position);
+    ast->nodes[node].class.start = start;
+    ast->nodes[node].class.count = count;
+    ast->nodes[node].class.negated = false;
+    return node;
+}
+
+// Concatenation of the optimized nodes of `list`, nested concatenations are flattened,
+// empty nodes dropped and literals following each other merged
+static NodeIndex make_concatenation(Optimizer* o, const NodeIndex* list, uint32_t count, uint32_t position) {
+    uint32_t total = 0;
+    for (uint32_t i = 0;i < count;i++) {
+        uint32_t grandchildren = 1;
+        if (o->ast->nodes[list[i]].type == ConcatenationNode) children(o, list[i], &grandchildren);
+        total += grandchildren;
+    }
+    NodeIndex* flat = arena_alloc(o->arena, total * sizeof(NodeIndex));
+    uint32_t flat_count = 0;
+    for (uint32_t i = 0;i < count;i++) {
+        if (o->ast->nodes[list[i]].type != ConcatenationNode) {
+            flat[flat_count++] = list[i];
+            continue;
+        }
+        uint32_t grandchildren;
+        NodeIndex* inner = children(o, list[i], &grandchildren);
+        memcpy(flat + flat_count, inner, grandchildren * sizeof(NodeIndex));
+        flat_count += grandchildren;
+    }
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0;i < flat_count;i++) {
+        const Node* node = &o->ast->nodes[flat[i]];
+        if (node->type == EmptyNode) continue;
+        if (node->type == LiteralNode && kept > 0 && o->ast->nodes[flat[kept - 1]].type == LiteralNode) {
+            merge_literals(o, flat[kept - 1], flat[i]);
+            continue;
+        }
+        flat[kept++] = flat[i];
+    }
+
+    if (kept == 0) return push_node(o, EmptyNode, position);
+    if (kept == 1) return flat[0];
+    return push_parent(o, ConcatenationNode, flat, kept, position);
+}
+
+// Literal node a branch starts with, NO_NODE when it does not start with one
+static NodeIndex first_literal(const Optimizer* o, NodeIndex branch) {
+    const Node* nodes = o->ast->nodes;
+    NodeIndex first = nodes[branch].type == ConcatenationNode ? nodes[branch].first_child : branch;
+    if (nodes[first].type != LiteralNode || nodes[first].literal.length == 0) return NO_NODE;
+    return first;
+}
+
+// Branch without its first `length` characters, which are a literal it starts with
+static NodeIndex drop_prefix(Optimizer* o, NodeIndex branch, uint32_t length) {
+    NodeIndex literal = first_literal(o, branch);
+    const Node* node = &o->ast->nodes[literal];
+    uint32_t position = node->position;
+    NodeIndex rest = NO_NODE;
+    if (node->literal.length > length) {
+        rest = push_literal(o, node->literal.start + length, node->literal.length - length, position);
+    }
+    if (literal == branch) return rest != NO_NODE ? rest : push_node(o, EmptyNode, position);
+
+    uint32_t count;
+    NodeIndex* list = children(o, branch, &count);
+    if (rest != NO_NODE) {
+        list[0] = rest;
+        return make_concatenation(o, list, count, position);
+    }
+    return make_concatenation(o, list + 1, count - 1, position);
+}
+
+// Whether a node matches exactly one character of a set
+static bool is_character_set(const Node* node) {
+    return (node->type == LiteralNode && node->literal.length == 1) || (node->type == ClassNode && !node->class.negated);
+}
+
+static NodeIndex make_alternation(Optimizer* o, const NodeIndex* list, uint32_t count, uint32_t position);
+
+// Replace runs of neighbouring branches starting with the same character by their common
+// prefix followed by the alternation of what remains of them
+// Neighbours only, so the branches are still tried in the same order
+static uint32_t factor_prefixes(Optimizer* o, NodeIndex* branches, uint32_t count) {
+    const Ast* ast = o->ast;
+    uint32_t kept = 0;
+    for (uint32_t i = 0;i < count;) {
+        NodeIndex literal = first_literal(o, branches[i]);
+        uint32_t end = i + 1;
+        uint32_t prefix = literal == NO_NODE ? 0 : ast->nodes[literal].literal.length;
+        const char* bytes = literal == NO_NODE ? NULL : ast->bytes + ast->nodes[literal].literal.start;
+        while (end < count && literal != NO_NODE) {
+            NodeIndex other = first_literal(o, branches[end]);
+            if (other == NO_NODE) break;
+            const char* other_bytes = ast->bytes + ast->nodes[other].literal.start;
+            uint32_t common = 0;
+            uint32_t limit = ast->nodes[other].literal.length;
+            while (common < prefix && common < limit && bytes[common] == other_bytes[common]) common++;
+            if (common == 0) break;
+            prefix = common;
+            end++;
+        }
+        if (end - i < 2) {
+            branches[kept++] = branches[i++];
+            continue;
+        }
+
+        uint32_t position = ast->nodes[branches[i]].position;
+        uint32_t start = o->ast->nodes[literal].literal.start;
+        NodeIndex* rests = arena_alloc(o->arena, (end - i) * sizeof(NodeIndex));
+        for (uint32_t k = i;k < end;k++) rests[k - i] = drop_prefix(o, branches[k], prefix);
+        NodeIndex parts[2] = {
+            push_literal(o, start, prefix, position),
+            make_alternation(o, rests, end - i, position),
+        };
+        branches[kept++] = make_concatenation(o, parts, 2, position);
+        i = end;
+    }
+    return kept;
+}
+
+// Replace runs of neighbouring branches matching one character by one class
+static uint32_t merge_character_sets(Optimizer* o, NodeIndex* branches, uint32_t count) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0;i < count;) {
+        uint32_t end = i;
+        uint32_t range_count = 0;
+        while (end < count && is_character_set(&o->ast->nodes[branches[end]])) {
+            const Node* node = &o->ast->nodes[branches[end]];
+            range_count += node->type == ClassNode ? node->class.count : 1;
+            end++;
+        }
+        if (end - i < 2) {
+            branches[kept++] = branches[i++];
+            continue;
+        }
+
+        ClassRange* ranges = arena_alloc(o->arena, range_count * sizeof(ClassRange));
+        range_count = 0;
+        for (uint32_t k = i;k < end;k++) {
+            const Node* node = &o->ast->nodes[branches[k]];
+            if (node->type == ClassNode) {
+                memcpy(ranges + range_count, o->ast->ranges + node->class.start, node->class.count * sizeof(ClassRange));
+                range_count += node->class.count;
+            } else {
+                unsigned char c = o->ast->bytes[node->literal.start];
+                ranges[range_count++] = (ClassRange){.low = c, .high = c};
+            }
+        }
+        ClassRange merged[129];
+        uint32_t merged_count = normalize_ranges(o, ranges, range_count, false, merged);
+        branches[kept++] = push_class(o, merged, merged_count, o->ast->nodes[branches[i]].position);
+        i = end;
+    }
+    return kept;
+}
+
+// Alternation of the optimized nodes of `list`, nested alternations are flattened,
+// common prefixes factored and character sets merged
+static NodeIndex make_alternation(Optimizer* o, const NodeIndex* list, uint32_t count, uint32_t position) {
+    uint32_t total = 0;
+    for (uint32_t i = 0;i < count;i++) {
+        uint32_t inner = 1;
+        if (o->ast->nodes[list[i]].type == AlternationNode) children(o, list[i], &inner);
+        total += inner;
+    }
+    NodeIndex* branches = arena_alloc(o->arena, total * sizeof(NodeIndex));
+    uint32_t branch_count = 0;
+    for (uint32_t i = 0;i < count;i++) {
+        if (o->ast->nodes[list[i]].type != AlternationNode) {
+            branches[branch_count++] = list[i];
+            continue;
+        }
+        uint32_t inner_count;
+        NodeIndex* inner = children(o, list[i], &inner_count);
+        memcpy(branches + branch_count, inner, inner_count * sizeof(NodeIndex));
+        branch_count += inner_count;
+    }
+
+    branch_count = factor_prefixes(o, branches, branch_count);
+    branch_count = merge_character_sets(o, branches, branch_count);
+    if (branch_count == 1) return branches[0];
+    return push_parent(o, AlternationNode, branches, branch_count, position);
+}
+
+// Whether a repetition is one of x? x* x+ or their lazy forms
+static bool is_simple_repeat(const Node* node) {
+    return
+        node->repeat.kind != PossessiveRepeat && node->repeat.min <= 1 &&
+        (node->repeat.max == 1 || node->repeat.max == REPEAT_INFINITY);
+}
+
+static NodeIndex optimize_node(Optimizer* o, NodeIndex index);
+
+static NodeIndex optimize_repeat(Optimizer* o, NodeIndex index) {
+    NodeIndex child = optimize_node(o, o->ast->nodes[index].first_child);
+    Node* nodes = o->ast->nodes;
+    Node* node = &nodes[index];
+    node->first_child = child;
+
+    if (node->repeat.max == 0 || nodes[child].type == EmptyNode) return push_node(o, EmptyNode, node->position);
+    // x{1} is x, unless possessive: an atomic part drops the alternatives of x
+    if (node->repeat.min == 1 && node->repeat.max == 1 && node->repeat.kind != PossessiveRepeat) return child;
+
+    // Only reached without groups, so only which strings match matters, not which branch wins:
+    // a repetition of x? x* x+ matches any count of x from the product of the minimums
+    Node* inner = &nodes[child];
+    if (!o->keep_groups && inner->type == RepeatNode && is_simple_repeat(node) && is_simple_repeat(inner)) {
+        inner->repeat.min *= node->repeat.min;
+        if (node->repeat.max == REPEAT_INFINITY) inner->repeat.max = REPEAT_INFINITY;
+        inner->repeat.kind = GreedyRepeat;
+        return child;
+    }
+    return index;
+}
+
+static NodeIndex optimize_node(Optimizer* o, NodeIndex index) {
+    Node node = o->ast->nodes[index];
+    uint32_t count;
+    NodeIndex* list;
+    switch (node.type) {
+        case ClassNode: {
+            ClassRange ranges[129];
+            uint32_t range_count = normalize_ranges(
+                o, o->ast->ranges + node.class.start, node.class.count, node.class.negated, ranges
+            );
+            return push_class(o, ranges, range_count, node.position);
+        }
+
+        case GroupNode: {
+            NodeIndex child = optimize_node(o, node.first_child);
+            if (!o->keep_groups) return child;
+            o->ast->nodes[index].first_child = child;
+            return index;
+        }
+
+        case RepeatNode:
+            return optimize_repeat(o, index);
+
+        case ConcatenationNode:
+            list = children(o, index, &count);
+            for (uint32_t i = 0;i < count;i++) list[i] = optimize_node(o, list[i]);
+            return make_concatenation(o, list, count, node.position);
+
+        case AlternationNode:
+            list = children(o, index, &count);
+            for (uint32_t i = 0;i < count;i++) list[i] = optimize_node(o, list[i]);
+            return make_alternation(o, list, count, node.position);
+
+        default:
+            return index;
+    }
+}
+
+void optimize_ast(Arena* arena, Ast* ast, bool keep_groups) {
+    Optimizer o = (Optimizer){.arena = arena, .ast = ast, .keep_groups = keep_groups};
+    if (ast->root != NO_NODE) ast->root = optimize_node(&o, ast->root);
+}
@@ -0,0 +1,34 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "../arena/arena.h"
+#include "../parser/parser.h"
+
+// Optimizer rewrites a syntax tree into a smaller one matching the same strings, with the
+// same leftmost-first match and the same capture groups, so it compiles to fewer instructions:
+// - literals following each other become one, \.a[b] is the literal ".ab"
+// - class ranges are sorted and merged, negated classes complemented, one character classes
+//   become literals
+// - alternation branches starting with the same literal share it, foobar|foobaz is fooba[rz]
+// - neighbouring alternation branches of one character become one class, a|b|[cd] is [a-d]
+// - x{1} is x, x{0} and repetitions of empty are empty, empty parts of concatenations go away
+// - without groups nested repetitions are one, (a*)* is a*, (a+)? is a* and (a+)+ is a+
+// Every group captures, so nested repetitions keep their meaning when groups are kept:
+// (a*)* captures the last, empty, iteration of a*
+// New nodes, characters and ranges are appended to the tree, existing ones may be modified
+
+// Optimizer data structure
+struct _Optimizer {
+    Arena* arena;
+    Ast* ast;
+    // Whether capture groups are kept, programs without capture slots (pattern sets) drop them
+    bool keep_groups;
+};
+
+typedef struct _Optimizer Optimizer;
+
+// Optimize `ast` in place, all memory comes from `arena`
+// With `keep_groups` false, group nodes are replaced by their child
+void optimize_ast(Arena* arena, Ast* ast, bool keep_groups);
+
+#endif
@@ -0,0 +1,491 @@
+#include <ctype.h>
+#include "./parser.h"
+
+Parser new_parser(Arena* arena, const char* source, size_t length) {
+    Parser p = (Parser) {
+        .arena = arena,
+        .scanner = new_scanner(arena, source, length),
+        .ast = (Ast) {
+            .nodes = NULL,
+            .node_count = 0,
+            .node_capacity = 0,
+            .bytes = NULL,
+            .byte_count = 0,
+            .byte_capacity = 0,
+            .ranges = NULL,
+            .range_count = 0,
+            .range_capacity = 0,
+            .root = NO_NODE,
+            .group_count = 0,
+            .source = NULL,
+            .source_length = length,
+        },
+        .open_groups = NULL,
+        .open_groups_count = 0,
+        .open_groups_capacity = 0,
+        .error = NO_PATTERN_ERROR,
+    };
+    p.ast.source = p.scanner.source;
+    p.current = get_next_token(&p.scanner);
+    p.error = p.scanner.error;
+    return p;
+}
+
+// Record the first error, then every token is an EndMarker so parsing winds down
+static void report_error(Parser* p, size_t position, size_t span, PatternErrorCode code) {
+    if (p->error.code == NoError) {
+        p->error = (PatternError){.code = code, .position = position, .span = span, .pattern = 0};
+    }
+    p->current = (Token){.type = EndMarker, .length = 0, .position = p->scanner.source_length};
+}
+
+static void advance(Parser* p) {
+    if (p->error.code != NoError) return;
+    p->current = get_next_token(&p->scanner);
+    p->error = p->scanner.error;
+}
+
+NodeIndex ast_push_node(Arena* arena, Ast* ast, Node node) {
+    if (ast->node_count == ast->node_capacity) {
+        uint32_t capacity = ast->node_capacity == 0 ? 16 : 2 * ast->node_capacity;
+        ast->nodes = arena_grow(
+            arena, ast->nodes,
+            ast->node_capacity * sizeof(Node), capacity * sizeof(Node)
+        );
+        ast->node_capacity = capacity;
+    }
+    ast->nodes[ast->node_count] = node;
+    return ast->node_count++;
+}
+
+static NodeIndex push_node(Parser* p, NodeType type, size_t position) {
+    return ast_push_node(p->arena, &p->ast, (Node) {
+        .type = type,
+        .position = position,
+        .first_child = NO_NODE,
+        .next_sibling = NO_NODE,
+    });
+}
+
+static bool is_quantifier(TokenType t) {
+    switch (t) {
+        case LazyMark:
+        case LazyPlus:
+        case LazyStar:
+        case Mark:
+        case Star:
+        case Plus:
+        case PossessiveMark:
+        case PossessivePlus:
+        case PossessiveStar:
+        case LeftBrace:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Parse the number in an Integer token
+static uint32_t parse_integer(Parser* p, Token t) {
+    const char* digits = p->scanner.source + t.position;
+    uint32_t value = 0;
+    for (size_t i = 0;i < t.length;i++) {
+        value = 10 * value + (digits[i] - '0');
+        if (value > REPEAT_MAX) {
+            report_error(p, t.position, t.length, RepetitionTooLargeError);
+            return REPEAT_MAX;
+        }
+    }
+    return value;
+}
+
+// Parse the inside of braces quantifier {N}, {N,}, {,M} or {N,M}
+// Current token is the LeftBrace
+static void parse_braces(Parser* p, uint32_t* min, uint32_t* max) {
+    size_t brace_position = p->current.position;
+    advance(p); // Move past {
+
+    *min = 0;
+    *max = REPEAT_INFINITY;
+    if (p->current.type == Integer) {
+        *min = parse_integer(p, p->current);
+        *max = *min;
+        advance(p);
+    }
+    if (p->current.type == Comma) {
+        *max = REPEAT_INFINITY;
+        advance(p);
+        if (p->current.type == Integer) {
+            *max = parse_integer(p, p->current);
+            advance(p);
+        }
+    }
+    if (p->current.type != RightBrace) {
+        report_error(p, p->current.position, p->current.length, InvalidBracesError);
+    }
+    if (*min > *max) {
+        report_error(p, brace_position, p->current.position - brace_position + 1, MinAboveMaxError);
+    }
+}
+
+// Wrap `atom` in a repeat node if a quantifier follows it
+static NodeIndex parse_quantifier(Parser* p, NodeIndex atom) {
+    Token q = p->current;
+    if (!is_quantifier(q.type)) return atom;
+
+    NodeType atom_type = p->ast.nodes[atom].type;
+    if (atom_type == AssertNode || atom_type == EmptyNode) {
+        report_error(p, q.position, q.length, NothingToRepeatError);
+    }
+
+    uint32_t min = 0, max = REPEAT_INFINITY;
+    RepeatKind kind = GreedyRepeat;
+    switch (q.type) {
+        case LazyMark:       kind = LazyRepeat;       /* fall through */
+        case Mark:           min = 0; max = 1; break;
+        case LazyStar:       kind = LazyRepeat;       /* fall through */
+        case Star:           min = 0; break;
+        case LazyPlus:       kind = LazyRepeat;       /* fall through */
+        case Plus:           min = 1; break;
+        case PossessiveMark: kind = PossessiveRepeat; min = 0; max = 1; break;
+        case PossessiveStar: kind = PossessiveRepeat; min = 0; break;
+        case PossessivePlus: kind = PossessiveRepeat; min = 1; break;
+        default:
+            parse_braces(p, &min, &max);
+            break;
+    }
+    advance(p); // Move past quantifier
+
+    if (q.type == LeftBrace) {
+        // {}? is lazy and {}+ is possessive
+        if (p->current.type == Mark) {
+            kind = LazyRepeat;
+            advance(p);
+        } else if (p->current.type == Plus) {
+            kind = PossessiveRepeat;
+            advance(p);
+        }
+    }
+
+    if (is_quantifier(p->current.type)) {
+        report_error(p, p->current.position, p->current.length, MultipleQuantifiersError);
+    }
+
+    NodeIndex repeat = push_node(p, RepeatNode, q.position);
+    Node* node = &p->ast.nodes[repeat];
+    node->first_child = atom;
+    node->repeat.min = min;
+    node->repeat.max = max;
+    node->repeat.kind = kind;
+    return repeat;
+}
+
+// Current token is the LeftBracket
+static NodeIndex parse_class(Parser* p) {
+    NodeIndex class = push_node(p, ClassNode, p->current.position);
+    uint32_t start = p->ast.range_count;
+    bool negated = false;
+    advance(p); // Move past [
+
+    if (p->current.type == CharacterClassInverter) {
+        negated = true;
+        advance(p);
+    }
+
+    while (p->current.type == Range) {
+        char bounds[2];
+        decode_token(&p->scanner, p->current, bounds, 2);
+        Ast* ast = &p->ast;
+        if (ast->range_count == ast->range_capacity) {
+            uint32_t capacity = ast->range_capacity == 0 ? 16 : 2 * ast->range_capacity;
+            ast->ranges = arena_grow(
+                p->arena, ast->ranges,
+                ast->range_capacity * sizeof(ClassRange), capacity * sizeof(ClassRange)
+            );
+            ast->range_capacity = capacity;
+        }
+        ast->ranges[ast->range_count++] = (ClassRange) {
+            .low = (unsigned char)bounds[0],
+            .high = (unsigned char)bounds[1],
+        };
+        advance(p);
+    }
+
+    if (p->current.type != RightBracket) {
+        report_error(p, p->ast.nodes[class].position, 1, UnmatchedLeftBracketError);
+    }
+    advance(p); // Move past ]
+
+    Node* node = &p->ast.nodes[class];
+    node->class.start = start;
+    node->class.count = p->ast.range_count - start;
+    node->class.negated = negated;
+    return class;
+}
+
+// Current token is a Backreference
+static NodeIndex parse_backreference(Parser* p) {
+    Token t = p->current;
+    const char* text = p->scanner.source + t.position;
+    bool is_named = t.length >= 4 && text[1] == 'g' && !isdigit(text[3]);
+    if (is_named) {
+        report_error(p, t.position, t.length, UnknownGroupNameError);
+    }
+
+    // No group number has more digits than the buffer, longer references are invalid
+    char digits[16];
+    size_t length = decode_token(&p->scanner, t, digits, sizeof(digits));
+    uint32_t group = 0;
+    for (size_t i = 0;i < length && i < sizeof(digits) && group <= p->ast.group_count;i++) {
+        group = 10 * group + (digits[i] - '0');
+    }
+
+    bool is_open = false;
+    for (uint32_t i = 0;i < p->open_groups_count;i++) is_open = is_open || p->open_groups[i] == group;
+    if (length > sizeof(digits) || group == 0 || group > p->ast.group_count || is_open) {
+        report_error(p, t.position, t.length, InvalidGroupReferenceError);
+    }
+
+    NodeIndex node = push_node(p, BackreferenceNode, t.position);
+    p->ast.nodes[node].group = group;
+    advance(p);
+    return node;
+}
+
+static NodeIndex parse_alternation(Parser* p);
+
+// Current token is the LeftParen
+static NodeIndex parse_group(Parser* p) {
+    size_t position = p->current.position;
+    if (p->open_groups_count == GROUP_DEPTH_MAX) {
+        report_error(p, position, 1, GroupsTooDeepError);
+        return push_node(p, EmptyNode, position);
+    }
+    uint32_t group = ++p->ast.group_count;
+    advance(p); // Move past (
+
+    if (p->open_groups_count == p->open_groups_capacity) {
+        uint32_t capacity = p->open_groups_capacity == 0 ? 8 : 2 * p->open_groups_capacity;
+        p->open_groups = arena_grow(
+            p->arena, p->open_groups,
+            p->open_groups_capacity * sizeof(uint32_t), capacity * sizeof(uint32_t)
+        );
+        p->open_groups_capacity = capacity;
+    }
+    p->open_groups[p->open_groups_count++] = group;
+
+    NodeIndex child = parse_alternation(p);
+    if (p->current.type != RightParen) {
+        report_error(p, position, 1, UnmatchedLeftParenError);
+    }
+    advance(p); // Move past )
+    p->open_groups_count--;
+
+    NodeIndex node = push_node(p, GroupNode, position);
+    p->ast.nodes[node].first_child = child;
+    p->ast.nodes[node].group = group;
+    return node;
+}
+
+static NodeIndex parse_atom(Parser* p) {
+    Token t = p->current;
+    NodeIndex node = NO_NODE;
+    switch (t.type) {
+        case Dot:
+            node = push_node(p, DotNode, t.position);
+            advance(p);
+            return node;
+
+        case Empty:
+            node = push_node(p, EmptyNode, t.position);
+            advance(p);
+            return node;
+
+        case DigitClass:
+        case NonDigitClass:
+        case WhitespaceClass:
+        case NonWhitespaceClass:
+        case WordCharacterClass:
+        case NonWordCharacterClass:
+            node = push_node(p, SlashClassNode, t.position);
+            p->ast.nodes[node].token = t.type;
+            advance(p);
+            return node;
+
+        case StartAnchor:
+        case EndAnchor:
+        case WordBoundaryAnchor:
+        case NonWordBoundaryAnchor:
+            node = push_node(p, AssertNode, t.position);
+            p->ast.nodes[node].token = t.type;
+            advance(p);
+            return node;
+
+        case Backreference:
+            return parse_backreference(p);
+
+        case LeftBracket:
+            return parse_class(p);
+
+        case LeftParen:
+            return parse_group(p);
+
+        default:
+            break;
+    }
+
+    if (is_quantifier(t.type)) {
+        report_error(p, t.position, t.length, NothingToRepeatError);
+    }
+    report_error(p, t.position, t.length, UnexpectedTokenError);
+    // Stands for the bad token so the tree stays valid while parsing winds down
+    return push_node(p, EmptyNode, t.position);
+}
+
+// Current token is a Literal
+// Appends the literal to the concatenation being built, returns the part a following quantifier applies to
+static NodeIndex parse_literal(Parser* p, NodeIndex* first, NodeIndex* last) {
+    Token t = p->current;
+    Ast* ast = &p->ast;
+    // Decoded literal is never longer than its token
+    if (ast->byte_count + t.length > ast->byte_capacity) {
+        uint32_t capacity = ast->byte_capacity == 0 ? 64 : 2 * ast->byte_capacity;
+        while (capacity < ast->byte_count + t.length) capacity *= 2;
+        ast->bytes = arena_grow(p->arena, ast->bytes, ast->byte_capacity, capacity);
+        ast->byte_capacity = capacity;
+    }
+    uint32_t start = ast->byte_count;
+    uint32_t length = decode_token(&p->scanner, t, ast->bytes + start, t.length);
+    ast->byte_count += length;
+    advance(p);
+
+    if (length > 1 && is_quantifier(p->current.type)) {
+        // A quantifier applies to the last character only, like in abc*
+        NodeIndex prefix = push_node(p, LiteralNode, t.position);
+        p->ast.nodes[prefix].literal.start = start;
+        p->ast.nodes[prefix].literal.length = length - 1;
+        if (*first == NO_NODE) *first = prefix;
+        else p->ast.nodes[*last].next_sibling = prefix;
+        *last = prefix;
+        start += length - 1;
+        length = 1;
+    }
+
+    NodeIndex node = push_node(p, LiteralNode, t.position);
+    p->ast.nodes[node].literal.start = start;
+    p->ast.nodes[node].literal.length = length;
+    return node;
+}
+
+static NodeIndex parse_concatenation(Parser* p) {
+    size_t position = p->current.position;
+    NodeIndex first = NO_NODE;
+    NodeIndex last = NO_NODE;
+    while (
+        p->current.type != Or &&
+        p->current.type != RightParen &&
+        p->current.type != EndMarker
+    ) {
+        NodeIndex atom;
+        if (p->current.type == Literal) atom = parse_literal(p, &first, &last);
+        else atom = parse_atom(p);
+        atom = parse_quantifier(p, atom);
+
+        if (first == NO_NODE) first = atom;
+        else p->ast.nodes[last].next_sibling = atom;
+        last = atom;
+    }
+
+    if (first == NO_NODE) {
+        // Nothing before | or ) or end of pattern
+        return push_node(p, EmptyNode, position);
+    } else if (first == last) {
+        return first;
+    }
+    NodeIndex node = push_node(p, ConcatenationNode, position);
+    p->ast.nodes[node].first_child = first;
+    return node;
+}
+
+static NodeIndex parse_alternation(Parser* p) {
+    size_t position = p->current.position;
+    NodeIndex first = parse_concatenation(p);
+    if (p->current.type != Or) return first;
+
+    NodeIndex last = first;
+    while (p->current.type == Or) {
+        advance(p); // Move past |
+        NodeIndex branch = parse_concatenation(p);
+        p->ast.nodes[last].next_sibling = branch;
+        last = branch;
+    }
+    NodeIndex node = push_node(p, AlternationNode, position);
+    p->ast.nodes[node].first_child = first;
+    return node;
+}
+
+Ast parse(Parser* p) {
+    p->ast.root = parse_alternation(p);
+    // Only a ) can stop the top level alternation early and the scanner reports unmatched ones,
+    // an EndMarker before the end of the source is a token the scanner could not make
+    bool at_end = p->current.type == EndMarker && p->current.position >= p->scanner.source_length;
+    if (!at_end) {
+        report_error(p, p->current.position, p->current.length, UnexpectedTokenError);
+    }
+    return p->ast;
+}
+
+static void print_node(const Ast* ast, NodeIndex index, size_t depth) {
+    const Node* node = &ast->nodes[index];
+    for (size_t i = 0;i < depth;i++) printf("  ");
+    switch (node->type) {
+        case EmptyNode:
+            printf("Empty");
+            break;
+        case LiteralNode:
+            printf("Literal \"%.*s\"", (int)node->literal.length, ast->bytes + node->literal.start);
+            break;
+        case DotNode:
+            printf("Dot");
+            break;
+        case ClassNode:
+            printf("Class %s[", node->class.negated ? "^ " : "");
+            for (uint32_t i = 0;i < node->class.count;i++) {
+                ClassRange r = ast->ranges[node->class.start + i];
+                if (r.low == r.high) printf(" %c", r.low);
+                else printf(" %c-%c", r.low, r.high);
+            }
+            printf(" ]");
+            break;
+        case SlashClassNode:
+        case AssertNode:
+            printf("%s", token_type_name(node->token));
+            break;
+        case BackreferenceNode:
+            printf("Backreference %u", node->group);
+            break;
+        case GroupNode:
+            printf("Group %u", node->group);
+            break;
+        case RepeatNode:
+            printf("Repeat {%u,", node->repeat.min);
+            if (node->repeat.max != REPEAT_INFINITY) printf("%u", node->repeat.max);
+            printf("}%s", node->repeat.kind == LazyRepeat ? " lazy" :
+                          node->repeat.kind == PossessiveRepeat ? " possessive" : "");
+            break;
+        case ConcatenationNode:
+            printf("Concatenation");
+            break;
+        case AlternationNode:
+            printf("Alternation");
+            break;
+    }
+    printf("\n");
+    for (NodeIndex child = node->first_child;child != NO_NODE;child = ast->nodes[child].next_sibling) {
+        print_node(ast, child, depth + 1);
+    }
+}
+
+void print_ast(const Ast* ast) {
+    if (ast->root != NO_NODE) print_node(ast, ast->root, 0);
+}
@@ -0,0 +1,161 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stdint.h>
+#include "../arena/arena.h"
+#include "../scanner/scanner.h"
+
+// Index of a node in field 'nodes' of an Ast
+typedef uint32_t NodeIndex;
+
+// Missing node, like the first child of a leaf or the next sibling of a last child
+#define NO_NODE UINT32_MAX
+
+// Maximum of an unbounded repetition like x* or x{2,}
+#define REPEAT_INFINITY UINT32_MAX
+
+// Largest number allowed inside a braces quantifier
+#define REPEAT_MAX 1000
+
+// Most groups open at once, the parser and later stages recurse once per level
+// Compiling a pattern this deep takes up to 512KB of stack, the default of threads is 8MB
+#define GROUP_DEPTH_MAX 1000
+
+enum _NodeType {
+    // Matches the empty string
+    EmptyNode,
+    // A sequence of characters, stored in field 'bytes' of the Ast
+    LiteralNode,
+    // Any character except \n
+    DotNode,
+    // Characters inside [ and ], stored as ranges in field 'ranges' of the Ast
+    ClassNode,
+    // \d \D \s \S \w \W
+    SlashClassNode,
+    // \A \Z \b \B
+    AssertNode,
+    // \N or \g<N>
+    BackreferenceNode,
+    // ( ), has one child
+    GroupNode,
+    // Quantified expression, has one child
+    RepeatNode,
+    // Children are matched one after another
+    ConcatenationNode,
+    // Children are tried in order, first one matching wins
+    AlternationNode,
+};
+
+typedef enum _NodeType NodeType;
+
+enum _RepeatKind {
+    // ? * + {}
+    GreedyRepeat,
+    // ?? *? +? {}?
+    LazyRepeat,
+    // ?+ *+ ++ {}+
+    PossessiveRepeat,
+};
+
+typedef enum _RepeatKind RepeatKind;
+
+// Inclusive range of characters inside a character class
+struct _ClassRange {
+    unsigned char low;
+    unsigned char high;
+};
+
+typedef struct _ClassRange ClassRange;
+
+// Nodes live in one array and refer to each other by index
+// Children of a node are a list: field 'first_child' then field 'next_sibling' of each child
+struct _Node {
+    NodeType type;
+    // Position in source string of the token this node starts at
+    uint32_t position;
+    NodeIndex first_child;
+    NodeIndex next_sibling;
+    union {
+        // LiteralNode: slice of field 'bytes' of the Ast
+        struct {
+            uint32_t start;
+            uint32_t length;
+        } literal;
+        // ClassNode: slice of field 'ranges' of the Ast
+        struct {
+            uint32_t start;
+            uint32_t count;
+            bool negated;
+        } class;
+        // SlashClassNode and AssertNode: token the node was made from, like DigitClass or StartAnchor
+        TokenType token;
+        // GroupNode and BackreferenceNode: capture group number, starting from 1
+        uint32_t group;
+        // RepeatNode: child is matched from min to max times
+        struct {
+            uint32_t min;
+            uint32_t max;
+            RepeatKind kind;
+        } repeat;
+    };
+};
+
+typedef struct _Node Node;
+
+// Abstract syntax tree of a pattern
+// All arrays are allocated from the arena of the parser that made the tree
+struct _Ast {
+    Node* nodes;
+    uint32_t node_count;
+    uint32_t node_capacity;
+    // Decoded characters of all literal nodes
+    char* bytes;
+    uint32_t byte_count;
+    uint32_t byte_capacity;
+    // Ranges of all class nodes
+    ClassRange* ranges;
+    uint32_t range_count;
+    uint32_t range_capacity;
+    NodeIndex root;
+    // Number of capture groups, not counting the whole match (group 0)
+    uint32_t group_count;
+    // Pattern the tree was parsed from, for error messages of later stages
+    const char* source;
+    size_t source_length;
+};
+
+typedef struct _Ast Ast;
+
+// Parser data structure
+struct _Parser {
+    Arena* arena;
+    // Tokens source
+    Scanner scanner;
+    // Token being looked at
+    Token current;
+    // Tree being built
+    Ast ast;
+    // Capture groups whose ) was not reached yet, they can not be backreferenced
+    uint32_t* open_groups;
+    uint32_t open_groups_count;
+    uint32_t open_groups_capacity;
+    // First syntax error of the scanner or the parser, code NoError while there is none
+    PatternError error;
+};
+
+typedef struct _Parser Parser;
+
+// Construct a new parser from a string, all memory comes from `arena`
+Parser new_parser(Arena* arena, const char* source, size_t length);
+
+// Consume all tokens and build the syntax tree of the pattern
+// On a syntax error field 'error' of the parser is set and the tree must not be used
+Ast parse(Parser* p);
+
+// Append a node to the tree, returns its index
+NodeIndex ast_push_node(Arena* arena, Ast* ast, Node node);
+
+// Print the tree, one node per line indented by depth
+void print_ast(const Ast* ast);
+
+#endif
@@ -0,0 +1,205 @@
+#include "./pikevm.h"
+
+// Everything one search needs, the memory comes from a PikeScratch
+struct _PikeVM {
+    const Program* program;
+    const char* input;
+    size_t length;
+    ThreadList current;
+    ThreadList next;
+    AddFrame* stack;
+    // Capture slots of the path add_thread is following
+    size_t* work_slots;
+};
+
+typedef struct _PikeVM PikeVM;
+
+static ThreadList new_thread_list(const Program* p) {
+    return (ThreadList) {
+        .sparse = malloc(p->length * sizeof(uint32_t)),
+        .dense = malloc(p->length * sizeof(uint32_t)),
+        .count = 0,
+        .slots = malloc((size_t)p->length * p->slot_count * sizeof(size_t)),
+    };
+}
+
+static void free_thread_list(ThreadList* l) {
+    free(l->sparse);
+    free(l->dense);
+    free(l->slots);
+}
+
+PikeScratch new_pike_scratch(const Program* p) {
+    PikeScratch s = (PikeScratch) {
+        .program = p,
+        .current = new_thread_list(p),
+        .next = new_thread_list(p),
+        .stack = malloc(2 * (size_t)p->length * sizeof(AddFrame)),
+        .work_slots = malloc(p->slot_count * sizeof(size_t)),
+        .initial_slots = malloc(p->slot_count * sizeof(size_t)),
+        .slots = malloc(p->slot_count * sizeof(size_t)),
+    };
+    for (uint32_t i = 0;i < p->slot_count;i++) s.initial_slots[i] = NO_POSITION;
+    return s;
+}
+
+void free_pike_scratch(PikeScratch* s) {
+    free_thread_list(&s->current);
+    free_thread_list(&s->next);
+    free(s->stack);
+    free(s->work_slots);
+    free(s->initial_slots);
+    free(s->slots);
+}
+
+static PikeVM new_pike_vm(PikeScratch* s, const char* input, size_t length) {
+    return (PikeVM) {
+        .program = s->program,
+        .input = input,
+        .length = length,
+        .current = s->current,
+        .next = s->next,
+        .stack = s->stack,
+        .work_slots = s->work_slots,
+    };
+}
+
+static bool contains(const ThreadList* l, uint32_t pc) {
+    uint32_t i = l->sparse[pc];
+    return i < l->count && l->dense[i] == pc;
+}
+
+// Follow empty transitions from `pc` at `position` and add every thread reached to `l`
+// Threads waiting on a character or a match get a copy of the capture slots of their path
+static void add_thread(PikeVM* vm, ThreadList* l, uint32_t pc, size_t position, const size_t* slots) {
+    const Program* p = vm->program;
+    uint32_t slot_count = p->slot_count;
+    memcpy(vm->work_slots, slots, slot_count * sizeof(size_t));
+
+    size_t top = 0;
+    vm->stack[top++] = (AddFrame){.restore = false, .pc = pc};
+    while (top > 0) {
+        AddFrame frame = vm->stack[--top];
+        if (frame.restore) {
+            vm->work_slots[frame.slot] = frame.value;
+            continue;
+        }
+        pc = frame.pc;
+        while (!contains(l, pc)) {
+            uint32_t index = l->count++;
+            l->sparse[pc] = index;
+            l->dense[index] = pc;
+
+            Instruction inst = p->instructions[pc];
+            if (inst.op == OpJmp) {
+                pc = inst.x;
+            } else if (inst.op == OpSplit) {
+                vm->stack[top++] = (AddFrame){.restore = false, .pc = inst.y};
+                pc = inst.x;
+            } else if (inst.op == OpSave) {
+                if (inst.x < slot_count) {
+                    vm->stack[top++] = (AddFrame) {
+                        .restore = true,
+                        .slot = inst.x,
+                        .value = vm->work_slots[inst.x],
+                    };
+                    vm->work_slots[inst.x] = position;
+                }
+                pc++;
+            } else if (inst.op == OpAssert) {
+                if (!assert_holds(inst.x, vm->input, vm->length, position)) break;
+                pc++;
+            } else {
+                // Waits on a character or matched
+                memcpy(l->slots + (size_t)index * slot_count, vm->work_slots, slot_count * sizeof(size_t));
+                break;
+            }
+        }
+    }
+}
+
+bool pikevm_search(
+    PikeScratch* s, const char* input, size_t length,
+    size_t start, bool anchored, const Prefilter* prefilter, size_t* slots
+) {
+    const Program* p = s->program;
+    PikeVM vm = new_pike_vm(s, input, length);
+    vm.current.count = 0;
+
+    bool matched = false;
+    for (size_t position = start;position <= length;position++) {
+        if (prefilter != NULL && !matched && !anchored && vm.current.count == 0) {
+            position = prefilter_find(prefilter, input, length, position);
+            if (position == NO_POSITION) break;
+        }
+        if (!matched && (!anchored || position == start)) {
+            // A match starting here has lower priority than every thread already running
+            add_thread(&vm, &vm.current, p->start, position, s->initial_slots);
+        }
+        if (vm.current.count == 0 && (matched || anchored)) break;
+
+        unsigned char c = position < length ? input[position] : 0;
+        vm.next.count = 0;
+        for (uint32_t i = 0;i < vm.current.count;i++) {
+            uint32_t pc = vm.current.dense[i];
+            Instruction inst = p->instructions[pc];
+            const size_t* thread_slots = vm.current.slots + (size_t)i * p->slot_count;
+            bool step = false;
+            if (inst.op == OpMatch) {
+                memcpy(slots, thread_slots, p->slot_count * sizeof(size_t));
+                matched = true;
+                // Threads after this one have lower priority
+                break;
+            } else if (inst.op == OpByte) {
+                step = position < length && c == inst.x;
+            } else if (inst.op == OpClass) {
+                step = position < length && program_class_contains(p, inst.x, c);
+            }
+            if (step) add_thread(&vm, &vm.next, pc + 1, position + 1, thread_slots);
+        }
+
+        ThreadList swap = vm.current;
+        vm.current = vm.next;
+        vm.next = swap;
+    }
+
+    return matched;
+}
+
+bool pikevm_search_set(PikeScratch* s, const char* input, size_t length, uint64_t* matched) {
+    const Program* p = s->program;
+    PikeVM vm = new_pike_vm(s, input, length);
+    vm.current.count = 0;
+    // Set programs have no capture slots
+    const size_t* no_slots = s->initial_slots;
+    memset(matched, 0, (p->pattern_count + 63) / 64 * sizeof(uint64_t));
+
+    bool any = false;
+    for (size_t position = 0;position <= length;position++) {
+        add_thread(&vm, &vm.current, p->start, position, no_slots);
+
+        unsigned char c = position < length ? input[position] : 0;
+        vm.next.count = 0;
+        for (uint32_t i = 0;i < vm.current.count;i++) {
+            uint32_t pc = vm.current.dense[i];
+            Instruction inst = p->instructions[pc];
+            bool step = false;
+            if (inst.op == OpMatch) {
+                // Every thread goes on, other patterns may still match
+                matched[inst.x / 64] |= 1ull << (inst.x % 64);
+                any = true;
+            } else if (inst.op == OpByte) {
+                step = position < length && c == inst.x;
+            } else if (inst.op == OpClass) {
+                step = position < length && program_class_contains(p, inst.x, c);
+            }
+            if (step) add_thread(&vm, &vm.next, pc + 1, position + 1, no_slots);
+        }
+
+        ThreadList swap = vm.current;
+        vm.current = vm.next;
+        vm.next = swap;
+    }
+
+    return any;
+}
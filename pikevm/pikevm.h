@@ -0,0 +1,75 @@
+#ifndef PIKEVM_H
+#define PIKEVM_H
+
+#include "../compiler/program.h"
+#include "../prefilter/prefilter.h"
+
+// Pike VM runs all threads of a program in lock step, one input character at a time
+// Each thread carries its own capture slots and a program counter is never run twice
+// at the same position, so matching takes O(program length * input length) time
+// whatever the pattern, at the cost of being slower than a DFA per character
+
+// Threads at one input position, a sparse set of program counters in priority order
+// Field 'slots' holds field 'slot_count' of the program capture slots per thread
+struct _ThreadList {
+    uint32_t* sparse;
+    uint32_t* dense;
+    uint32_t count;
+    size_t* slots;
+};
+
+typedef struct _ThreadList ThreadList;
+
+// Work item of add_thread: follow program counter 'pc', or put 'value' back in capture slot 'slot'
+struct _AddFrame {
+    bool restore;
+    uint32_t pc;
+    uint32_t slot;
+    size_t value;
+};
+
+typedef struct _AddFrame AddFrame;
+
+// Memory of the searches of one program, sized from it once so searches never allocate
+// A scratch is used by one search at a time
+struct _PikeScratch {
+    const Program* program;
+    ThreadList current;
+    ThreadList next;
+    // Each instruction pushes at most one split branch and one slot restore
+    AddFrame* stack;
+    // Capture slots of the path being followed
+    size_t* work_slots;
+    // All NO_POSITION, the slots of a thread starting a match
+    size_t* initial_slots;
+    // Free for the caller to receive the slots of a match
+    size_t* slots;
+};
+
+typedef struct _PikeScratch PikeScratch;
+
+// Construct the scratch of searches of `p`, which must outlive it
+PikeScratch new_pike_scratch(const Program* p);
+
+void free_pike_scratch(PikeScratch* s);
+
+// Search `input` from `start` for the leftmost-first match of the program of `s`
+// When `anchored` the match must begin exactly at `start`
+// Characters before `start` are still seen by \b and \B
+// When no thread is running the search skips to the next position `prefilter` finds,
+// it is NULL or of kind PrefixPrefilter, LiteralSetPrefilter or ClassPrefilter
+// On a match fills `slots` (field 'slot_count' of the program entries, NO_POSITION for groups
+// not taking part in the match) and returns true
+bool pikevm_search(
+    PikeScratch* s, const char* input, size_t length,
+    size_t start, bool anchored, const Prefilter* prefilter, size_t* slots
+);
+
+// Find which patterns of a set program (field 'all_matches' set), the program of `s`,
+// match somewhere in `input`
+// `matched` has room for one bit per pattern in 64 bit words, bit i is set when pattern i
+// matches and every other bit is cleared
+// Returns whether any pattern matches
+bool pikevm_search_set(PikeScratch* s, const char* input, size_t length, uint64_t* matched);
+
+#endif
@@ -0,0 +1,185 @@
+#include <time.h>
+#include "./pool.h"
+
+// Indices a run gives the workers at once, a slice holds them in 32 bits
+#define POOL_RUN_MAX UINT32_MAX
+
+static uint64_t pack_range(uint32_t begin, uint32_t end) {
+    return (uint64_t)begin << 32 | end;
+}
+
+static uint32_t range_begin(uint64_t range) {
+    return range >> 32;
+}
+
+static uint32_t range_end(uint64_t range) {
+    return (uint32_t)range;
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Take up to POOL_BATCH tasks from the front of the slice of `worker`, false when it is empty
+static bool take_own(ThreadPool* pool, size_t worker, uint32_t* begin, uint32_t* end) {
+    _Atomic uint64_t* slice = &pool->slices[worker].range;
+    uint64_t range = atomic_load_explicit(slice, memory_order_acquire);
+    while (true) {
+        uint32_t b = range_begin(range);
+        uint32_t e = range_end(range);
+        if (b >= e) return false;
+        uint32_t taken = e - b < POOL_BATCH ? e : b + POOL_BATCH;
+        if (atomic_compare_exchange_weak_explicit(
+            slice, &range, pack_range(taken, e), memory_order_acq_rel, memory_order_acquire
+        )) {
+            *begin = b;
+            *end = taken;
+            return true;
+        }
+    }
+}
+
+// Move the back half of the slice of another worker into the empty slice of `worker`
+// Victims are tried in turn starting after `worker`, false when all of them are empty
+static bool steal(ThreadPool* pool, size_t worker) {
+    for (size_t k = 1;k < pool->worker_count;k++) {
+        _Atomic uint64_t* victim = &pool->slices[(worker + k) % pool->worker_count].range;
+        uint64_t range = atomic_load_explicit(victim, memory_order_acquire);
+        while (true) {
+            uint32_t b = range_begin(range);
+            uint32_t e = range_end(range);
+            if (b >= e) break;
+            // A single task left is stolen whole, the victim is busy with the tasks it took
+            uint32_t middle = b + (e - b) / 2;
+            if (atomic_compare_exchange_weak_explicit(
+                victim, &range, pack_range(b, middle), memory_order_acq_rel, memory_order_acquire
+            )) {
+                // Only this thread writes to an empty slice, thieves skip it
+                atomic_store_explicit(&pool->slices[worker].range, pack_range(middle, e), memory_order_release);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void run_worker(ThreadPool* pool, size_t worker) {
+    // Counted locally, the stats of neighbour workers share cache lines
+    size_t tasks = 0;
+    size_t steals = 0;
+    double start = now();
+    while (true) {
+        uint32_t begin;
+        uint32_t end;
+        if (!take_own(pool, worker, &begin, &end)) {
+            if (!steal(pool, worker)) break;
+            steals++;
+            continue;
+        }
+        for (uint32_t i = begin;i < end;i++) pool->task(pool->context, worker, pool->base + i);
+        tasks += end - begin;
+    }
+    PoolWorkerStats* stats = &pool->stats[worker];
+    stats->tasks += tasks;
+    stats->steals += steals;
+    stats->seconds += now() - start;
+}
+
+struct _WorkerArgument {
+    ThreadPool* pool;
+    size_t worker;
+};
+
+typedef struct _WorkerArgument WorkerArgument;
+
+static void* worker_main(void* argument) {
+    WorkerArgument a = *(WorkerArgument*)argument;
+    free(argument);
+    ThreadPool* pool = a.pool;
+    uint64_t generation = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->generation == generation && !pool->stopping) pthread_cond_wait(&pool->started, &pool->lock);
+        if (pool->stopping) break;
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_worker(pool, a.worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) pthread_cond_signal(&pool->finished);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+ThreadPool* new_thread_pool(size_t workers) {
+    if (workers == 0) workers = 1;
+    ThreadPool* pool = malloc(sizeof(ThreadPool));
+    *pool = (ThreadPool) {
+        .threads = malloc(workers * sizeof(pthread_t)),
+        .worker_count = workers,
+        .slices = aligned_alloc(_Alignof(PoolSlice), workers * sizeof(PoolSlice)),
+        .stats = calloc(workers, sizeof(PoolWorkerStats)),
+        .generation = 0,
+        .running = 0,
+        .stopping = false,
+    };
+    for (size_t i = 0;i < workers;i++) atomic_init(&pool->slices[i].range, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->started, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+    for (size_t i = 0;i < workers;i++) {
+        WorkerArgument* a = malloc(sizeof(WorkerArgument));
+        *a = (WorkerArgument){.pool = pool, .worker = i};
+        pthread_create(&pool->threads[i], NULL, worker_main, a);
+    }
+    return pool;
+}
+
+void free_thread_pool(ThreadPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->started);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 0;i < pool->worker_count;i++) pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->finished);
+    pthread_cond_destroy(&pool->started);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->stats);
+    free(pool->slices);
+    free(pool->threads);
+    free(pool);
+}
+
+void pool_run(ThreadPool* pool, size_t count, PoolTask task, void* context, PoolWorkerStats* stats) {
+    size_t n = pool->worker_count;
+    memset(pool->stats, 0, n * sizeof(PoolWorkerStats));
+
+    // Longer runs go in parts, slices index at most POOL_RUN_MAX tasks
+    for (size_t base = 0;base < count;base += POOL_RUN_MAX) {
+        size_t part = count - base < POOL_RUN_MAX ? count - base : POOL_RUN_MAX;
+        // Equal slices to start with, stealing evens out the rest
+        for (size_t i = 0;i < n;i++) {
+            uint32_t begin = part * i / n;
+            uint32_t end = part * (i + 1) / n;
+            atomic_store_explicit(&pool->slices[i].range, pack_range(begin, end), memory_order_relaxed);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        pool->task = task;
+        pool->context = context;
+        pool->base = base;
+        pool->running = n;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->started);
+        while (pool->running > 0) pthread_cond_wait(&pool->finished, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    if (stats != NULL) memcpy(stats, pool->stats, n * sizeof(PoolWorkerStats));
+}
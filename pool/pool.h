@@ -0,0 +1,76 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "../common.h"
+
+// Work-stealing thread pool running the tasks of an index range
+// Each worker owns a slice of the range and takes tasks from its front, a worker whose slice
+// is empty takes the back half of the slice of another worker, so workers only touch shared
+// memory when they run out of work
+
+// Tasks a worker takes from its own slice at once
+#define POOL_BATCH 16
+
+// Task `index` of a run, `worker` is the index of the thread running it
+typedef void (*PoolTask)(void* context, size_t worker, size_t index);
+
+// Counters of one worker during the last run
+struct _PoolWorkerStats {
+    size_t tasks;
+    // Times the worker took half of the slice of another worker
+    size_t steals;
+    // Time from the start of the run until the worker found no task left
+    double seconds;
+};
+
+typedef struct _PoolWorkerStats PoolWorkerStats;
+
+// Slice of tasks left to a worker, written by its owner and by thieves
+// Packed in one word so a compare and swap takes tasks: begin in the high half, end in the low half
+struct _PoolSlice {
+    _Alignas(64) _Atomic uint64_t range;
+};
+
+typedef struct _PoolSlice PoolSlice;
+
+struct _ThreadPool {
+    pthread_t* threads;
+    size_t worker_count;
+    // One per worker, on its own cache line
+    PoolSlice* slices;
+    PoolWorkerStats* stats;
+    // Run being executed, read by workers once woken up
+    PoolTask task;
+    void* context;
+    // First index of the run, slices hold indices relative to it
+    size_t base;
+    // Guards fields 'generation', 'running' and 'stopping'
+    pthread_mutex_t lock;
+    pthread_cond_t started;
+    pthread_cond_t finished;
+    // Incremented by each run, workers wait for it to change
+    uint64_t generation;
+    // Workers still busy with the current run
+    size_t running;
+    bool stopping;
+};
+
+typedef struct _ThreadPool ThreadPool;
+
+// Start `workers` threads waiting for runs
+// Threads keep pointers to the pool, so a pool never moves
+ThreadPool* new_thread_pool(size_t workers);
+
+// Stop the threads and release the pool
+void free_thread_pool(ThreadPool* pool);
+
+// Call `task` with `context` for every index in [0, count) on the threads of the pool,
+// returns once all calls have returned
+// Counters of worker i are written to stats[i] when `stats` is not NULL
+// Runs of one pool must not overlap
+void pool_run(ThreadPool* pool, size_t count, PoolTask task, void* context, PoolWorkerStats* stats);
+
+#endif
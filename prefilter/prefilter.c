@@ -0,0 +1,377 @@
+#include "./prefilter.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#include <stdatomic.h>
+#define PREFILTER_X86
+#endif
+
+// Literals all matches of a node start with
+struct _LiteralSet {
+    uint32_t count;
+    uint32_t lengths[PREFILTER_MAX_LITERALS];
+    char literals[PREFILTER_MAX_LITERALS][PREFILTER_MAX_LENGTH];
+    // Every literal is a whole match of the node, so what follows the node can extend them
+    bool complete;
+};
+
+typedef struct _LiteralSet LiteralSet;
+
+static LiteralSet empty_string_set(void) {
+    return (LiteralSet){.count = 1, .lengths = {0}, .complete = true};
+}
+
+// Compute the literals every match of node `index` starts with
+// Returns false when matches can start with anything
+static bool prefixes(const Ast* ast, NodeIndex index, LiteralSet* out) {
+    const Node* node = &ast->nodes[index];
+    switch (node->type) {
+        case EmptyNode:
+        case AssertNode:
+            // Zero-width, matches start with whatever follows
+            *out = empty_string_set();
+            return true;
+
+        case LiteralNode: {
+            uint32_t length = node->literal.length;
+            bool truncated = length > PREFILTER_MAX_LENGTH;
+            if (truncated) length = PREFILTER_MAX_LENGTH;
+            *out = (LiteralSet){.count = 1, .lengths = {length}, .complete = !truncated};
+            memcpy(out->literals[0], ast->bytes + node->literal.start, length);
+            return true;
+        }
+
+        case GroupNode:
+            return prefixes(ast, node->first_child, out);
+
+        case RepeatNode:
+            if (node->repeat.min == 0 || !prefixes(ast, node->first_child, out)) return false;
+            out->complete = out->complete && node->repeat.min == 1 && node->repeat.max == 1;
+            return true;
+
+        case ConcatenationNode: {
+            *out = empty_string_set();
+            for (NodeIndex child = node->first_child;child != NO_NODE && out->complete;child = ast->nodes[child].next_sibling) {
+                LiteralSet next;
+                if (!prefixes(ast, child, &next) || out->count * next.count > PREFILTER_MAX_LITERALS) {
+                    out->complete = false;
+                    break;
+                }
+                // Every literal so far followed by every literal of the child
+                LiteralSet product = {.count = 0, .complete = next.complete};
+                for (uint32_t i = 0;i < out->count;i++) {
+                    for (uint32_t k = 0;k < next.count;k++) {
+                        uint32_t length = out->lengths[i];
+                        uint32_t extra = next.lengths[k];
+                        if (length + extra > PREFILTER_MAX_LENGTH) {
+                            extra = PREFILTER_MAX_LENGTH - length;
+                            product.complete = false;
+                        }
+                        memcpy(product.literals[product.count], out->literals[i], length);
+                        memcpy(product.literals[product.count] + length, next.literals[k], extra);
+                        product.lengths[product.count++] = length + extra;
+                    }
+                }
+                *out = product;
+            }
+            return true;
+        }
+
+        case AlternationNode: {
+            *out = (LiteralSet){.count = 0, .complete = true};
+            for (NodeIndex child = node->first_child;child != NO_NODE;child = ast->nodes[child].next_sibling) {
+                LiteralSet branch;
+                if (!prefixes(ast, child, &branch) || out->count + branch.count > PREFILTER_MAX_LITERALS) {
+                    return false;
+                }
+                for (uint32_t i = 0;i < branch.count;i++) {
+                    memcpy(out->literals[out->count], branch.literals[i], branch.lengths[i]);
+                    out->lengths[out->count++] = branch.lengths[i];
+                }
+                out->complete = out->complete && branch.complete;
+            }
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+// Find the longest literal every match of node `index` contains
+static void required_literal(const Ast* ast, NodeIndex index, const Node** best) {
+    const Node* node = &ast->nodes[index];
+    switch (node->type) {
+        case LiteralNode:
+            if (*best == NULL || node->literal.length > (*best)->literal.length) *best = node;
+            break;
+
+        case GroupNode:
+            required_literal(ast, node->first_child, best);
+            break;
+
+        case RepeatNode:
+            if (node->repeat.min > 0) required_literal(ast, node->first_child, best);
+            break;
+
+        case ConcatenationNode:
+            for (NodeIndex child = node->first_child;child != NO_NODE;child = ast->nodes[child].next_sibling) {
+                required_literal(ast, child, best);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+Prefilter new_prefilter(const Ast* ast) {
+    Prefilter p = (Prefilter){.kind = NoPrefilter, .count = 0, .first_byte_count = 0};
+
+    LiteralSet set;
+    bool has_prefixes = prefixes(ast, ast->root, &set);
+    for (uint32_t i = 0;has_prefixes && i < set.count;i++) {
+        // A match may start with anything
+        if (set.lengths[i] == 0) has_prefixes = false;
+    }
+
+    if (has_prefixes) {
+        p.kind = set.count == 1 ? PrefixPrefilter : LiteralSetPrefilter;
+        p.count = set.count;
+        memcpy(p.lengths, set.lengths, sizeof(p.lengths));
+        memcpy(p.literals, set.literals, sizeof(p.literals));
+    } else {
+        const Node* best = NULL;
+        required_literal(ast, ast->root, &best);
+        // A single character is too common to be worth a pass over the input
+        if (best == NULL || best->literal.length < 2) return p;
+        uint32_t length = best->literal.length;
+        if (length > PREFILTER_MAX_LENGTH) length = PREFILTER_MAX_LENGTH;
+        p.kind = InnerPrefilter;
+        p.count = 1;
+        p.lengths[0] = length;
+        memcpy(p.literals[0], ast->bytes + best->literal.start, length);
+    }
+
+    for (uint32_t i = 0;i < p.count;i++) {
+        uint8_t first = p.literals[i][0];
+        bool seen = false;
+        for (uint32_t k = 0;k < p.first_byte_count;k++) seen = seen || p.first_bytes[k] == first;
+        if (!seen) p.first_bytes[p.first_byte_count++] = first;
+    }
+    return p;
+}
+
+bool prefilter_is_valid(const Prefilter* p) {
+    switch (p->kind) {
+        case NoPrefilter:
+        case ClassPrefilter:
+            return true;
+        case PrefixPrefilter:
+        case InnerPrefilter:
+            if (p->count != 1) return false;
+            break;
+        case LiteralSetPrefilter:
+            if (p->count == 0 || p->count > PREFILTER_MAX_LITERALS) return false;
+            break;
+        default:
+            return false;
+    }
+    for (uint32_t i = 0;i < p->count;i++) {
+        if (p->lengths[i] == 0 || p->lengths[i] > PREFILTER_MAX_LENGTH) return false;
+    }
+    return p->first_byte_count > 0 && p->first_byte_count <= PREFILTER_MAX_LITERALS;
+}
+
+void prefilter_use_first_class(Prefilter* p, const Program* program) {
+    if (p->kind != NoPrefilter) return;
+
+    // Characters consumed by the instructions the start reaches over empty transitions,
+    // assertions are taken as holding, a reachable match means matches can be empty
+    CharSet set = new_charset();
+    bool* visited = calloc(program->length, sizeof(bool));
+    uint32_t* stack = malloc((2 * (size_t)program->length + 1) * sizeof(uint32_t));
+    uint32_t top = 0;
+    stack[top++] = program->start;
+    bool empty = false;
+    while (top > 0 && !empty) {
+        uint32_t pc = stack[--top];
+        if (visited[pc]) continue;
+        visited[pc] = true;
+        Instruction inst = program->instructions[pc];
+        switch (inst.op) {
+            case OpByte:
+                charset_add_range(&set, inst.x, inst.x);
+                break;
+            case OpClass:
+                charset_add_set(&set, &program->classes[inst.x].set);
+                break;
+            case OpSplit:
+                stack[top++] = inst.y;
+                stack[top++] = inst.x;
+                break;
+            case OpJmp:
+                stack[top++] = inst.x;
+                break;
+            case OpProgress:
+                stack[top++] = inst.y;
+                stack[top++] = pc + 1;
+                break;
+            case OpSave:
+            case OpAssert:
+            case OpAtomicStart:
+            case OpAtomicEnd:
+                stack[top++] = pc + 1;
+                break;
+            case OpMatch:
+            case OpBackref:
+                // A backreference to an empty group consumes nothing
+                empty = true;
+                break;
+        }
+    }
+    free(visited);
+    free(stack);
+
+    if (empty || charset_count(&set) > PREFILTER_MAX_CLASS_SIZE) return;
+    p->kind = ClassPrefilter;
+    p->first_class = set;
+}
+
+#ifdef PREFILTER_X86
+
+static bool has_avx2(void) {
+    // Atomic as searches of several threads may ask first at once
+    static atomic_int supported = -1;
+    int known = atomic_load_explicit(&supported, memory_order_relaxed);
+    if (known < 0) {
+        known = __builtin_cpu_supports("avx2") ? 1 : 0;
+        atomic_store_explicit(&supported, known, memory_order_relaxed);
+    }
+    return known;
+}
+
+// Compare the first and the last characters of the literal against 16 positions at a time,
+// only positions where both match are compared in full
+static size_t find_literal_sse2(const char* input, size_t length, size_t from, const char* literal, size_t n) {
+    const __m128i first = _mm_set1_epi8(literal[0]);
+    const __m128i last = _mm_set1_epi8(literal[n - 1]);
+    size_t i = from;
+    for (;i + n - 1 + 16 <= length;i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(input + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(input + i + n - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask != 0) {
+            unsigned bit = __builtin_ctz(mask);
+            if (memcmp(input + i + bit, literal, n) == 0) return i + bit;
+            mask &= mask - 1;
+        }
+    }
+    for (;i + n <= length;i++) {
+        if (input[i] == literal[0] && memcmp(input + i, literal, n) == 0) return i;
+    }
+    return NO_POSITION;
+}
+
+__attribute__((target("avx2")))
+static size_t find_literal_avx2(const char* input, size_t length, size_t from, const char* literal, size_t n) {
+    const __m256i first = _mm256_set1_epi8(literal[0]);
+    const __m256i last = _mm256_set1_epi8(literal[n - 1]);
+    size_t i = from;
+    for (;i + n - 1 + 32 <= length;i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(input + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(input + i + n - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (mask != 0) {
+            unsigned bit = __builtin_ctz(mask);
+            if (memcmp(input + i + bit, literal, n) == 0) return i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return find_literal_sse2(input, length, i, literal, n);
+}
+
+// First position at or after `from` holding one of `count` characters
+static size_t find_bytes_sse2(const char* input, size_t length, size_t from, const uint8_t* bytes, uint32_t count) {
+    __m128i needles[PREFILTER_MAX_LITERALS];
+    for (uint32_t k = 0;k < count;k++) needles[k] = _mm_set1_epi8(bytes[k]);
+    size_t i = from;
+    for (;i + 16 <= length;i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(input + i));
+        __m128i hits = _mm_cmpeq_epi8(block, needles[0]);
+        for (uint32_t k = 1;k < count;k++) hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, needles[k]));
+        unsigned mask = _mm_movemask_epi8(hits);
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    for (;i < length;i++) {
+        for (uint32_t k = 0;k < count;k++) if ((uint8_t)input[i] == bytes[k]) return i;
+    }
+    return NO_POSITION;
+}
+
+__attribute__((target("avx2")))
+static size_t find_bytes_avx2(const char* input, size_t length, size_t from, const uint8_t* bytes, uint32_t count) {
+    __m256i needles[PREFILTER_MAX_LITERALS];
+    for (uint32_t k = 0;k < count;k++) needles[k] = _mm256_set1_epi8(bytes[k]);
+    size_t i = from;
+    for (;i + 32 <= length;i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(input + i));
+        __m256i hits = _mm256_cmpeq_epi8(block, needles[0]);
+        for (uint32_t k = 1;k < count;k++) hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, needles[k]));
+        unsigned mask = _mm256_movemask_epi8(hits);
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    return find_bytes_sse2(input, length, i, bytes, count);
+}
+
+#endif
+
+size_t find_literal(const char* input, size_t length, size_t from, const char* literal, size_t literal_length) {
+    if (from > length || literal_length > length - from) return NO_POSITION;
+    if (literal_length == 1) {
+        const char* found = memchr(input + from, literal[0], length - from);
+        return found == NULL ? NO_POSITION : (size_t)(found - input);
+    }
+#ifdef PREFILTER_X86
+    if (has_avx2()) return find_literal_avx2(input, length, from, literal, literal_length);
+    return find_literal_sse2(input, length, from, literal, literal_length);
+#else
+    const char* found = memmem(input + from, length - from, literal, literal_length);
+    return found == NULL ? NO_POSITION : (size_t)(found - input);
+#endif
+}
+
+static size_t find_bytes(const char* input, size_t length, size_t from, const uint8_t* bytes, uint32_t count) {
+    if (count == 1) {
+        const char* found = memchr(input + from, bytes[0], length - from);
+        return found == NULL ? NO_POSITION : (size_t)(found - input);
+    }
+#ifdef PREFILTER_X86
+    if (has_avx2()) return find_bytes_avx2(input, length, from, bytes, count);
+    return find_bytes_sse2(input, length, from, bytes, count);
+#else
+    for (size_t i = from;i < length;i++) {
+        for (uint32_t k = 0;k < count;k++) if ((uint8_t)input[i] == bytes[k]) return i;
+    }
+    return NO_POSITION;
+#endif
+}
+
+size_t prefilter_find(const Prefilter* p, const char* input, size_t length, size_t from) {
+    if (p->kind == NoPrefilter) return from <= length ? from : NO_POSITION;
+    if (p->kind == ClassPrefilter) {
+        size_t found = charset_find(&p->first_class, input, length, from);
+        return found < length ? found : NO_POSITION;
+    }
+    if (p->count == 1) return find_literal(input, length, from, p->literals[0], p->lengths[0]);
+
+    // Candidates hold a first character of some literal, keep those where a whole literal is
+    for (size_t i = from;i < length;i++) {
+        i = find_bytes(input, length, i, p->first_bytes, p->first_byte_count);
+        if (i == NO_POSITION) break;
+        for (uint32_t k = 0;k < p->count;k++) {
+            if (p->lengths[k] <= length - i && memcmp(input + i, p->literals[k], p->lengths[k]) == 0) return i;
+        }
+    }
+    return NO_POSITION;
+}
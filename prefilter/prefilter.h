@@ -0,0 +1,69 @@
+#ifndef PREFILTER_H
+#define PREFILTER_H
+
+#include <stdint.h>
+#include "../compiler/program.h"
+
+// Prefilter: literals every match must contain, searched with vectorized loops
+// so engines only run near positions where a match can be
+// Patterns without such literals may still start with few characters, like \d+-\d+
+
+// Most literals a prefilter searches for at once
+#define PREFILTER_MAX_LITERALS 8
+// Longest literal a prefilter keeps, longer ones are cut
+#define PREFILTER_MAX_LENGTH 32
+// Most characters matches may start with for a ClassPrefilter, more are too common
+// for skipping to the next one to pay off
+#define PREFILTER_MAX_CLASS_SIZE 32
+
+enum _PrefilterKind {
+    // Nothing useful to search for
+    NoPrefilter,
+    // Every match starts with the only literal
+    PrefixPrefilter,
+    // Every match starts with one of the literals
+    LiteralSetPrefilter,
+    // Every match contains the only literal somewhere, inputs without it can not match
+    InnerPrefilter,
+    // Every match starts with a character of field 'first_class'
+    ClassPrefilter,
+};
+
+typedef enum _PrefilterKind PrefilterKind;
+
+struct _Prefilter {
+    PrefilterKind kind;
+    uint32_t count;
+    uint32_t lengths[PREFILTER_MAX_LITERALS];
+    char literals[PREFILTER_MAX_LITERALS][PREFILTER_MAX_LENGTH];
+    // Distinct first characters of the literals
+    uint8_t first_bytes[PREFILTER_MAX_LITERALS];
+    uint32_t first_byte_count;
+    CharSet first_class;
+};
+
+typedef struct _Prefilter Prefilter;
+
+// Extract the literals of a pattern
+Prefilter new_prefilter(const Ast* ast);
+
+// Whether the kind, counts and lengths of `p` are consistent, checked on prefilters read back
+// with regex_deserialize
+bool prefilter_is_valid(const Prefilter* p);
+
+// Make `p` a ClassPrefilter when it is of kind NoPrefilter and every match of `program`
+// starts with one of at most PREFILTER_MAX_CLASS_SIZE characters
+void prefilter_use_first_class(Prefilter* p, const Program* program);
+
+// Position of the first occurrence at or after `from` of any literal of `p` in `input`,
+// or of a character of the class of a ClassPrefilter
+// For PrefixPrefilter, LiteralSetPrefilter and ClassPrefilter that is the first position
+// a match can start at
+// Returns NO_POSITION when there is none
+size_t prefilter_find(const Prefilter* p, const char* input, size_t length, size_t from);
+
+// Position of the first occurrence of `literal` at or after `from` in `input`, or NO_POSITION
+// Uses AVX2 when the processor has it, SSE2 otherwise
+size_t find_literal(const char* input, size_t length, size_t from, const char* literal, size_t literal_length);
+
+#endif
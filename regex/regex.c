@@ -0,0 +1,334 @@
+#include <sys/mman.h>
+#include "./regex.h"
+
+// Prefilter the engines can skip ahead with, NULL when matches do not start with a literal
+// or a character of a small class
+static const Prefilter* start_prefilter(const Regex* r) {
+    PrefilterKind kind = r->prefilter.kind;
+    bool starts = kind == PrefixPrefilter || kind == LiteralSetPrefilter || kind == ClassPrefilter;
+    return starts ? &r->prefilter : NULL;
+}
+
+// Whether the input lacks a literal every match contains
+static bool lacks_inner_literal(const Regex* r, const char* input, size_t length) {
+    if (r->prefilter.kind != InnerPrefilter) return false;
+    return find_literal(input, length, 0, r->prefilter.literals[0], r->prefilter.lengths[0]) == NO_POSITION;
+}
+
+// dfa_search on `dfa`, holding `lock` unless it is NULL
+// The DFA of a Regex may be used by several threads, the one of a Scratch by its owner only
+static DfaResult run_dfa(
+    DfaCache* dfa, pthread_mutex_t* lock, const char* input, size_t length, bool earliest, size_t* end
+) {
+    if (lock != NULL) pthread_mutex_lock(lock);
+    DfaResult result = dfa_search(dfa, input, length, 0, false, earliest, end);
+    if (lock != NULL) pthread_mutex_unlock(lock);
+    return result;
+}
+
+// dfa_search_reverse on `dfa`, holding `lock` unless it is NULL
+static DfaResult run_reverse_dfa(
+    DfaCache* dfa, pthread_mutex_t* lock, const char* input, size_t length, size_t end, size_t* start
+) {
+    if (lock != NULL) pthread_mutex_lock(lock);
+    DfaResult result = dfa_search_reverse(dfa, input, length, end, start);
+    if (lock != NULL) pthread_mutex_unlock(lock);
+    return result;
+}
+
+Regex* regex_compile(const char* pattern, size_t length, uint32_t flags, PatternError* error) {
+    // Engines keep pointers to the program, so a Regex never moves
+    Regex* r = malloc(sizeof(Regex));
+    if (r == NULL) {
+        if (error != NULL) {
+            *error = (PatternError){.code = OutOfMemoryError, .position = 0, .span = length, .pattern = 0};
+        }
+        return NULL;
+    }
+    *r = (Regex) {
+        .arena = new_arena(0),
+        .pattern_length = length,
+        .flags = flags,
+        .prefilter = (Prefilter){.kind = NoPrefilter},
+        .literals = NULL,
+        .one_pass = (OnePass){.is_one_pass = false},
+        .backtrack_budget = 0,
+        .mapping = NULL,
+        .mapping_size = 0,
+    };
+    Parser p = new_parser(&r->arena, pattern, length);
+    r->pattern = p.scanner.source;
+    r->ast = parse(&p);
+    PatternError failure = p.error;
+    if (failure.code == NoError) {
+        // Literals are read from the tree as written, the optimizer turns a|b into a class
+        if (!(flags & RegexNoPrefilter)) r->prefilter = new_prefilter(&r->ast);
+        if (!(flags & RegexNoLiteralMatcher) && is_literal_alternation(&r->ast)) {
+            r->literals = arena_alloc(&r->arena, sizeof(LiteralMatcher));
+            *r->literals = new_literal_matcher(&r->arena, &r->ast);
+        }
+        if (!(flags & RegexNoOptimize)) optimize_ast(&r->arena, &r->ast, true);
+        r->program = compile_program(&r->arena, &r->ast, &failure);
+    }
+    if (error != NULL) *error = failure;
+    if (failure.code != NoError) {
+        free_arena(&r->arena);
+        free(r);
+        return NULL;
+    }
+
+    if (!(flags & RegexNoPrefilter)) prefilter_use_first_class(&r->prefilter, &r->program);
+    r->reverse_program = (Program){.length = 0};
+    if (!r->program.needs_backtracking) r->reverse_program = compile_program_reverse(&r->arena, &r->ast);
+    if (!(flags & RegexNoOnePass)) r->one_pass = new_one_pass(&r->arena, &r->program);
+    r->dfa = new_dfa_cache(&r->program, start_prefilter(r), 0);
+    r->reverse_dfa = new_dfa_cache(&r->reverse_program, NULL, 0);
+    pthread_mutex_init(&r->dfa_lock, NULL);
+    return r;
+}
+
+Regex* new_regex(const char* pattern, size_t length, uint32_t flags) {
+    PatternError error;
+    Regex* r = regex_compile(pattern, length, flags, &error);
+    if (r == NULL) {
+        print_pattern_error(stderr, &error, pattern, length);
+        exit(1);
+    }
+    return r;
+}
+
+void free_regex(Regex* r) {
+    pthread_mutex_destroy(&r->dfa_lock);
+    free_dfa_cache(&r->dfa);
+    free_dfa_cache(&r->reverse_dfa);
+    free_arena(&r->arena);
+    if (r->mapping != NULL) munmap(r->mapping, r->mapping_size);
+    free(r);
+}
+
+size_t regex_group_count(const Regex* r) {
+    return r->ast.group_count;
+}
+
+void regex_set_backtrack_budget(Regex* r, size_t steps) {
+    r->backtrack_budget = steps;
+}
+
+static void copy_groups(const Program* p, const size_t* slots, Match* groups, size_t groups_count) {
+    for (size_t i = 0;i < groups_count;i++) {
+        bool exists = 2 * i + 1 < p->slot_count;
+        groups[i].start = exists ? slots[2 * i] : NO_POSITION;
+        groups[i].end = exists ? slots[2 * i + 1] : NO_POSITION;
+    }
+}
+
+// Run the Pike VM from `start`, it answers every query the DFA gives up on
+// Without a scratch of the caller one is made for this search only
+static bool pikevm_captures(
+    const Regex* r, Scratch* scratch, const char* input, size_t length,
+    size_t start, bool anchored, Match* groups, size_t groups_count
+) {
+    PikeScratch own;
+    PikeScratch* pike = scratch == NULL ? NULL : &scratch->pike;
+    if (pike == NULL) {
+        own = new_pike_scratch(&r->program);
+        pike = &own;
+    }
+
+    const Prefilter* prefilter = anchored ? NULL : start_prefilter(r);
+    bool matched = pikevm_search(pike, input, length, start, anchored, prefilter, pike->slots);
+    if (matched) copy_groups(&r->program, pike->slots, groups, groups_count);
+
+    if (pike == &own) free_pike_scratch(&own);
+    return matched;
+}
+
+// Run the backtracker, the only engine of programs with field 'needs_backtracking' set
+static RegexResult backtrack_captures(
+    const Regex* r, Scratch* scratch, const char* input, size_t length, Match* groups, size_t groups_count
+) {
+    BacktrackScratch own;
+    BacktrackScratch* backtrack = scratch == NULL ? NULL : &scratch->backtrack;
+    if (backtrack == NULL) {
+        own = new_backtrack_scratch(&r->program);
+        backtrack = &own;
+    }
+
+    BacktrackResult result = backtrack_search(
+        backtrack, input, length, 0, false, start_prefilter(r), r->backtrack_budget, backtrack->match_slots
+    );
+    if (result == BacktrackMatch) copy_groups(&r->program, backtrack->match_slots, groups, groups_count);
+
+    if (backtrack == &own) free_backtrack_scratch(&own);
+    if (result == BacktrackGaveUp) return RegexGaveUp;
+    return result == BacktrackMatch ? RegexMatch : RegexNoMatch;
+}
+
+static RegexResult to_result(bool matched) {
+    return matched ? RegexMatch : RegexNoMatch;
+}
+
+// Queries share these with their engines state: the DFA, the lock guarding it or NULL,
+// and the Scratch of the caller or NULL
+static RegexResult is_match(
+    const Regex* r, DfaCache* dfa, pthread_mutex_t* lock, Scratch* scratch, const char* input, size_t length
+) {
+    size_t start;
+    size_t end;
+    Match match;
+    if (r->literals != NULL) return to_result(literal_matcher_find(r->literals, input, length, 0, &start, &end));
+    if (lacks_inner_literal(r, input, length)) return RegexNoMatch;
+    if (r->program.needs_backtracking) return backtrack_captures(r, scratch, input, length, &match, 1);
+    DfaResult result = run_dfa(dfa, lock, input, length, true, &end);
+    if (result != DfaGaveUp) return to_result(result == DfaMatch);
+    return to_result(pikevm_captures(r, scratch, input, length, 0, false, &match, 1));
+}
+
+static RegexResult find_end(
+    const Regex* r, DfaCache* dfa, pthread_mutex_t* lock, Scratch* scratch,
+    const char* input, size_t length, size_t* end
+) {
+    size_t start;
+    if (r->literals != NULL) return to_result(literal_matcher_find(r->literals, input, length, 0, &start, end));
+    if (lacks_inner_literal(r, input, length)) return RegexNoMatch;
+    Match match;
+    RegexResult result;
+    if (r->program.needs_backtracking) {
+        result = backtrack_captures(r, scratch, input, length, &match, 1);
+    } else {
+        DfaResult dfa_result = run_dfa(dfa, lock, input, length, false, end);
+        if (dfa_result != DfaGaveUp) return to_result(dfa_result == DfaMatch);
+        result = to_result(pikevm_captures(r, scratch, input, length, 0, false, &match, 1));
+    }
+    if (result == RegexMatch) *end = match.end;
+    return result;
+}
+
+// Groups of the leftmost-first match, which starts at `start`
+static bool captures_from(
+    const Regex* r, Scratch* scratch, const char* input, size_t length,
+    size_t start, Match* groups, size_t groups_count
+) {
+    if (r->one_pass.is_one_pass) {
+        size_t slots[ONE_PASS_MAX_SLOTS];
+        if (!one_pass_search(&r->one_pass, input, length, start, slots)) return false;
+        copy_groups(&r->program, slots, groups, groups_count);
+        return true;
+    }
+    return pikevm_captures(r, scratch, input, length, start, true, groups, groups_count);
+}
+
+static RegexResult captures(
+    const Regex* r, DfaCache* dfa, DfaCache* reverse_dfa, pthread_mutex_t* lock, Scratch* scratch,
+    const char* input, size_t length, Match* groups, size_t groups_count
+) {
+    if (r->literals != NULL) {
+        // Alternations of literals have no capture group
+        Match match;
+        if (!literal_matcher_find(r->literals, input, length, 0, &match.start, &match.end)) return RegexNoMatch;
+        for (size_t i = 0;i < groups_count;i++) {
+            groups[i] = i == 0 ? match : (Match){.start = NO_POSITION, .end = NO_POSITION};
+        }
+        return RegexMatch;
+    }
+
+    if (lacks_inner_literal(r, input, length)) return RegexNoMatch;
+    if (r->program.needs_backtracking) return backtrack_captures(r, scratch, input, length, groups, groups_count);
+    if (r->one_pass.is_one_pass && r->one_pass.anchored) {
+        // Only a match at the start is possible, one pass over it finds the groups
+        return to_result(captures_from(r, scratch, input, length, 0, groups, groups_count));
+    }
+
+    // The forward DFA finds where the match ends, the reverse one where it starts
+    size_t start;
+    size_t end;
+    DfaResult result = run_dfa(dfa, lock, input, length, false, &end);
+    if (result == DfaNoMatch) return RegexNoMatch;
+    if (result == DfaMatch && run_reverse_dfa(reverse_dfa, lock, input, length, end, &start) == DfaMatch) {
+        if (groups_count > 1) return to_result(captures_from(r, scratch, input, length, start, groups, groups_count));
+        if (groups_count == 1) groups[0] = (Match){.start = start, .end = end};
+        return RegexMatch;
+    }
+    return to_result(pikevm_captures(r, scratch, input, length, 0, false, groups, groups_count));
+}
+
+RegexResult regex_is_match(Regex* r, const char* input, size_t length) {
+    return is_match(r, &r->dfa, &r->dfa_lock, NULL, input, length);
+}
+
+RegexResult regex_find_end(Regex* r, const char* input, size_t length, size_t* end) {
+    return find_end(r, &r->dfa, &r->dfa_lock, NULL, input, length, end);
+}
+
+RegexResult regex_find(Regex* r, const char* input, size_t length, Match* match) {
+    return regex_captures(r, input, length, match, 1);
+}
+
+RegexResult regex_captures(Regex* r, const char* input, size_t length, Match* groups, size_t groups_count) {
+    return captures(r, &r->dfa, &r->reverse_dfa, &r->dfa_lock, NULL, input, length, groups, groups_count);
+}
+
+Scratch new_scratch(const Regex* r) {
+    return (Scratch) {
+        .regex = r,
+        .dfa = new_dfa_cache(&r->program, start_prefilter(r), 0),
+        .reverse_dfa = new_dfa_cache(&r->reverse_program, NULL, 0),
+        .pike = new_pike_scratch(&r->program),
+        .backtrack = new_backtrack_scratch(&r->program),
+    };
+}
+
+void free_scratch(Scratch* s) {
+    free_dfa_cache(&s->dfa);
+    free_dfa_cache(&s->reverse_dfa);
+    free_pike_scratch(&s->pike);
+    free_backtrack_scratch(&s->backtrack);
+}
+
+RegexResult scratch_is_match(Scratch* s, const char* input, size_t length) {
+    return is_match(s->regex, &s->dfa, NULL, s, input, length);
+}
+
+RegexResult scratch_find_end(Scratch* s, const char* input, size_t length, size_t* end) {
+    return find_end(s->regex, &s->dfa, NULL, s, input, length, end);
+}
+
+RegexResult scratch_captures(Scratch* s, const char* input, size_t length, Match* groups, size_t groups_count) {
+    return captures(s->regex, &s->dfa, &s->reverse_dfa, NULL, s, input, length, groups, groups_count);
+}
+
+bool new_regex_stream(Regex* r, bool earliest, RegexStream* stream, PatternError* error) {
+    if (r->program.needs_backtracking) {
+        if (error != NULL) {
+            *error = (PatternError) {
+                .code = BacktrackingInStreamError, .position = 0, .span = r->pattern_length, .pattern = 0
+            };
+        }
+        return false;
+    }
+    *stream = (RegexStream) {
+        .regex = r,
+        .dfa = new_dfa_stream(&r->program, earliest),
+    };
+    if (error != NULL) *error = NO_PATTERN_ERROR;
+    return true;
+}
+
+void free_regex_stream(RegexStream* s) {
+    free_dfa_stream(&s->dfa);
+}
+
+bool regex_stream_feed(RegexStream* s, const char* chunk, size_t length) {
+    pthread_mutex_lock(&s->regex->dfa_lock);
+    dfa_stream_feed(&s->regex->dfa, &s->dfa, chunk, length);
+    pthread_mutex_unlock(&s->regex->dfa_lock);
+    return s->dfa.done;
+}
+
+bool regex_stream_finish(RegexStream* s, size_t* end) {
+    pthread_mutex_lock(&s->regex->dfa_lock);
+    dfa_stream_finish(&s->regex->dfa, &s->dfa);
+    pthread_mutex_unlock(&s->regex->dfa_lock);
+    if (s->dfa.matched) *end = s->dfa.end;
+    return s->dfa.matched;
+}
@@ -0,0 +1,174 @@
+#ifndef REGEX_H
+#define REGEX_H
+
+#include <pthread.h>
+#include "../arena/arena.h"
+#include "../parser/parser.h"
+#include "../optimizer/optimizer.h"
+#include "../compiler/compiler.h"
+#include "../prefilter/prefilter.h"
+#include "../literals/literals.h"
+#include "../dfa/dfa.h"
+#include "../pikevm/pikevm.h"
+#include "../backtrack/backtrack.h"
+#include "../onepass/onepass.h"
+
+// Options of new_regex, combined with |
+enum _RegexFlag {
+    // Do not search for literals of the pattern before running the engines
+    RegexNoPrefilter = 1 << 0,
+    // Run the automata even when the pattern is only an alternation of literals
+    RegexNoLiteralMatcher = 1 << 1,
+    // Find capture groups with the Pike VM even when the pattern is one-pass
+    RegexNoOnePass = 1 << 2,
+    // Compile the syntax tree as parsed, without the rewrites of optimize_ast
+    RegexNoOptimize = 1 << 3,
+};
+
+typedef enum _RegexFlag RegexFlag;
+
+// Outcome of a search
+enum _RegexResult {
+    RegexNoMatch,
+    RegexMatch,
+    // A backtracking search ran out of its step budget before it could tell,
+    // error BacktrackBudgetError describes it, see regex_set_backtrack_budget
+    // It also gives up when its stack can not grow for lack of memory
+    RegexGaveUp,
+};
+
+typedef enum _RegexResult RegexResult;
+
+// Compiled pattern, owns every stage of its compilation in field 'arena'
+struct _Regex {
+    Arena arena;
+    // Copy of the pattern
+    const char* pattern;
+    size_t pattern_length;
+    // RegexFlag values the pattern was compiled with
+    uint32_t flags;
+    // Syntax tree after optimize_ast, unless compiled with RegexNoOptimize
+    Ast ast;
+    Program program;
+    // Literals of the pattern, kind NoPrefilter when disabled by RegexNoPrefilter
+    Prefilter prefilter;
+    // Answers every query when the pattern is an alternation of literals, NULL otherwise
+    LiteralMatcher* literals;
+    // Finds capture groups of anchored one-pass patterns, field 'is_one_pass' cleared otherwise
+    OnePass one_pass;
+    // Steps a backtracking search may take, see backtrack_search
+    size_t backtrack_budget;
+    // Pattern read backwards, finds where a match starts from where it ends
+    // Not compiled for patterns needing the backtracker, field 'length' is 0 then
+    Program reverse_program;
+    // Lazy DFAs answering match/no-match and match end queries, and match start queries
+    // Mutated by searches, field 'dfa_lock' lets one thread at a time use them
+    DfaCache dfa;
+    DfaCache reverse_dfa;
+    pthread_mutex_t dfa_lock;
+    // File mapped by regex_load_file whose block the arrays point into, NULL otherwise
+    void* mapping;
+    size_t mapping_size;
+};
+
+typedef struct _Regex Regex;
+
+// Position of a match or a capture group in the input, [start, end)
+// Both are NO_POSITION for a group that did not take part in the match
+struct _Match {
+    size_t start;
+    size_t end;
+};
+
+typedef struct _Match Match;
+
+// Mutable state of the searches of one Regex, owned by one thread
+// Threads searching a shared Regex each with their own Scratch never wait on each other,
+// the Regex itself is only read
+// All memory is sized from the program when the scratch is made, so searches through a
+// scratch never allocate, except the backtracker growing to an input longer than any before
+struct _Scratch {
+    const Regex* regex;
+    DfaCache dfa;
+    DfaCache reverse_dfa;
+    PikeScratch pike;
+    BacktrackScratch backtrack;
+};
+
+typedef struct _Scratch Scratch;
+
+// Matching over input given in consecutive chunks (sockets, pipes, files read piece by piece)
+// Only the automaton state is carried from one chunk to the next, so memory does not grow
+// with the input and matches across chunk boundaries are found
+struct _RegexStream {
+    Regex* regex;
+    DfaStream dfa;
+};
+
+typedef struct _RegexStream RegexStream;
+
+// Compile a pattern, `flags` is 0 or RegexFlag values combined with |
+// Returns NULL if the pattern is invalid or memory runs out, `error` (when not NULL) tells why,
+// see format_pattern_error
+// Nothing is printed and no diagnostic is made, rejecting a pattern costs the compilation up to the error
+Regex* regex_compile(const char* pattern, size_t length, uint32_t flags, PatternError* error);
+
+// Same as regex_compile, but prints the diagnostic and exits if the pattern is invalid
+Regex* new_regex(const char* pattern, size_t length, uint32_t flags);
+
+// Release all memory of a compiled pattern, including the Regex itself
+void free_regex(Regex* r);
+
+// Number of capture groups, not counting the whole match
+size_t regex_group_count(const Regex* r);
+
+// Patterns with backreferences or possessive quantifiers run on the backtracker
+// A search with backreferences taking more than `steps` steps gives up and returns RegexGaveUp
+// (0 means BACKTRACK_STEP_BUDGET), set it before sharing the Regex between threads
+void regex_set_backtrack_budget(Regex* r, size_t steps);
+
+// Whether the pattern matches anywhere in `input`
+// Searches return RegexGaveUp only for patterns running on the backtracker
+RegexResult regex_is_match(Regex* r, const char* input, size_t length);
+
+// Find where the leftmost-first match in `input` ends
+RegexResult regex_find_end(Regex* r, const char* input, size_t length, size_t* end);
+
+// Find the leftmost-first match in `input`
+RegexResult regex_find(Regex* r, const char* input, size_t length, Match* match);
+
+// Construct the search state of a thread searching `r`, which must outlive it
+Scratch new_scratch(const Regex* r);
+
+void free_scratch(Scratch* s);
+
+// Same as regex_is_match, regex_find_end and regex_captures on field 'regex' of `s`,
+// using only `s` for the mutable state
+RegexResult scratch_is_match(Scratch* s, const char* input, size_t length);
+RegexResult scratch_find_end(Scratch* s, const char* input, size_t length, size_t* end);
+RegexResult scratch_captures(Scratch* s, const char* input, size_t length, Match* groups, size_t groups_count);
+
+// Start matching `r` against an input given in chunks, into `stream`
+// Returns false if the pattern needs the backtracker, it can not run on chunks,
+// `error` (when not NULL) is then set to BacktrackingInStreamError and `stream` left untouched
+// With `earliest` the stream reports the first position a match is known to end at,
+// otherwise the end of the leftmost-first match like regex_find_end
+bool new_regex_stream(Regex* r, bool earliest, RegexStream* stream, PatternError* error);
+
+void free_regex_stream(RegexStream* s);
+
+// Continue the stream over the next `length` characters of the input
+// Returns true once the result can not change anymore, later chunks may be skipped
+bool regex_stream_feed(RegexStream* s, const char* chunk, size_t length);
+
+// End the input, \Z and \b are checked against it
+// Returns whether the pattern matches, filling `end` with where the match ends
+bool regex_stream_finish(RegexStream* s, size_t* end);
+
+// Find the leftmost-first match in `input` and the spans of its capture groups
+// `groups` has room for `groups_count` entries, group 0 is the whole match
+// The span of the match takes a forward and a backward DFA pass, only the groups after it
+// need another engine
+RegexResult regex_captures(Regex* r, const char* input, size_t length, Match* groups, size_t groups_count);
+
+#endif
@@ -0,0 +1,61 @@
+#include "./regexset.h"
+
+RegexSet* regex_set_compile(const char* const* patterns, const size_t* lengths, size_t count, PatternError* error) {
+    // The DFA cache keeps a pointer to the program, so a RegexSet never moves
+    RegexSet* s = malloc(sizeof(RegexSet));
+    *s = (RegexSet) {
+        .arena = new_arena(0),
+        .count = count,
+    };
+    s->asts = arena_alloc(&s->arena, count * sizeof(Ast));
+    PatternError failure = NO_PATTERN_ERROR;
+    for (size_t i = 0;i < count && failure.code == NoError;i++) {
+        Parser p = new_parser(&s->arena, patterns[i], lengths[i]);
+        s->asts[i] = parse(&p);
+        failure = p.error;
+        failure.pattern = i;
+        // Set programs have no capture slots, groups can go
+        if (failure.code == NoError) optimize_ast(&s->arena, &s->asts[i], false);
+    }
+    if (failure.code == NoError) s->program = compile_program_set(&s->arena, s->asts, count, &failure);
+    if (error != NULL) *error = failure;
+    if (failure.code != NoError) {
+        free_arena(&s->arena);
+        free(s);
+        return NULL;
+    }
+
+    // States hold threads of every pattern at once, give them room in proportion to the program
+    size_t size = DFA_CACHE_SIZE;
+    while (size < 64 * (size_t)s->program.length * sizeof(uint32_t)) size *= 2;
+    s->dfa = new_dfa_cache(&s->program, NULL, size);
+    s->pike = new_pike_scratch(&s->program);
+    return s;
+}
+
+RegexSet* new_regex_set(const char* const* patterns, const size_t* lengths, size_t count) {
+    PatternError error;
+    RegexSet* s = regex_set_compile(patterns, lengths, count, &error);
+    if (s == NULL) {
+        print_pattern_error(stderr, &error, patterns[error.pattern], lengths[error.pattern]);
+        exit(1);
+    }
+    return s;
+}
+
+void free_regex_set(RegexSet* s) {
+    free_dfa_cache(&s->dfa);
+    free_pike_scratch(&s->pike);
+    free_arena(&s->arena);
+    free(s);
+}
+
+size_t regex_set_words(const RegexSet* s) {
+    return (s->count + 63) / 64;
+}
+
+bool regex_set_matches(RegexSet* s, const char* input, size_t length, uint64_t* matched) {
+    DfaResult result = dfa_search_set(&s->dfa, input, length, matched);
+    if (result != DfaGaveUp) return result == DfaMatch;
+    return pikevm_search_set(&s->pike, input, length, matched);
+}
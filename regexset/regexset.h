@@ -0,0 +1,47 @@
+#ifndef REGEXSET_H
+#define REGEXSET_H
+
+#include "../arena/arena.h"
+#include "../parser/parser.h"
+#include "../optimizer/optimizer.h"
+#include "../compiler/compiler.h"
+#include "../dfa/dfa.h"
+#include "../pikevm/pikevm.h"
+
+// Patterns compiled into one program, a search tells which of them match in a single pass
+// over the input whatever their number
+struct _RegexSet {
+    Arena arena;
+    uint32_t count;
+    // Optimized syntax tree of each pattern, sources are copies owned by field 'arena'
+    Ast* asts;
+    Program program;
+    // Mutated by searches, a RegexSet must not be used by several threads at once
+    DfaCache dfa;
+    // Memory of the Pike VM when the DFA gives up
+    PikeScratch pike;
+};
+
+typedef struct _RegexSet RegexSet;
+
+// Compile `count` (at least one) patterns, pattern i is `patterns[i]` of length `lengths[i]`
+// Returns NULL if a pattern is invalid, `error` (when not NULL) tells why and field 'pattern'
+// of it which pattern
+RegexSet* regex_set_compile(const char* const* patterns, const size_t* lengths, size_t count, PatternError* error);
+
+// Same as regex_set_compile, but prints the diagnostic and exits if a pattern is invalid
+RegexSet* new_regex_set(const char* const* patterns, const size_t* lengths, size_t count);
+
+// Release all memory of a pattern set, including the RegexSet itself
+void free_regex_set(RegexSet* s);
+
+// Number of 64 bit words of a result of regex_set_matches, one bit per pattern
+size_t regex_set_words(const RegexSet* s);
+
+// Find which patterns match somewhere in `input`
+// Sets bit i % 64 of `matched[i / 64]` when pattern i matches and clears every other bit,
+// `matched` has room for regex_set_words(s) words
+// Returns whether any pattern matches
+bool regex_set_matches(RegexSet* s, const char* input, size_t length, uint64_t* matched);
+
+#endif
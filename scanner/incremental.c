@@ -0,0 +1,144 @@
+#include "./incremental.h"
+
+// A token reads the source from two characters before it (whether it follows an escaping \)
+// to one character past the checkpoint after it (lookaheads like the - of a range or the
+// character after a [), so only tokens ending this close to an edit can change
+#define SCANNER_LOOKBEHIND 2
+#define SCANNER_LOOKAHEAD 1
+
+IncrementalScanner new_incremental_scanner(const char* source, size_t length) {
+    IncrementalScanner s = (IncrementalScanner) {
+        .scanner = (Scanner){.arena = NULL, .source = calloc(1, 1), .source_length = 0},
+        .tokens = NULL,
+        .checkpoints = NULL,
+        .token_count = 0,
+        .token_capacity = 0,
+        .fresh_tokens = NULL,
+        .fresh_checkpoints = NULL,
+        .fresh_capacity = 0,
+        .error = NO_PATTERN_ERROR,
+    };
+    incremental_scanner_edit(&s, 0, 0, source, length);
+    return s;
+}
+
+void free_incremental_scanner(IncrementalScanner* s) {
+    free(s->scanner.source);
+    free(s->tokens);
+    free(s->checkpoints);
+    free(s->fresh_tokens);
+    free(s->fresh_checkpoints);
+}
+
+// Make room for `count` tokens and their checkpoints in a pair of arrays of `capacity` entries
+static void reserve_tokens(Token** tokens, ScannerCheckpoint** checkpoints, size_t* capacity, size_t count) {
+    if (count <= *capacity) return;
+    size_t grown = *capacity == 0 ? 16 : *capacity;
+    while (grown < count) grown *= 2;
+    *tokens = realloc(*tokens, grown * sizeof(Token));
+    *checkpoints = realloc(*checkpoints, grown * sizeof(ScannerCheckpoint));
+    if (*tokens == NULL || *checkpoints == NULL) {
+        fprintf(stderr, "Out of memory" "\n");
+        exit(1);
+    }
+    *capacity = grown;
+}
+
+// Whether scanning from `a` and from `b` gives the same tokens, given the same source around them
+static bool same_state(ScannerCheckpoint a, ScannerCheckpoint b) {
+    return a.found_empty_string == b.found_empty_string &&
+        a.inside_parentheses == b.inside_parentheses &&
+        a.inside_braces == b.inside_braces &&
+        a.inside_brackets == b.inside_brackets &&
+        a.found_brackets_inverter == b.found_brackets_inverter &&
+        a.error.code == NoError && b.error.code == NoError;
+}
+
+// Index of the first token reading a character at or after `position`, the tokens before it
+// are the same whatever the edit at `position` is
+// The EndMarker depends on the source length, it is always scanned again
+static size_t first_changed_token(const IncrementalScanner* s, size_t position) {
+    if (s->token_count == 0) return 0;
+    // Token i is kept when the checkpoint after it is far enough from the edit,
+    // checkpoints are in source order so the first one too close is found by bisection
+    size_t low = 1, high = s->token_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (s->checkpoints[middle].current + SCANNER_LOOKAHEAD < position) low = middle + 1;
+        else high = middle;
+    }
+    return low - 1;
+}
+
+// Apply the edit to the source of the scanner
+static void edit_source(Scanner* s, size_t position, size_t removed, const char* inserted, size_t inserted_length) {
+    size_t length = s->source_length - removed + inserted_length;
+    size_t tail = s->source_length - position - removed;
+    if (inserted_length > removed) s->source = realloc(s->source, length + 1);
+    if (s->source == NULL) {
+        fprintf(stderr, "Out of memory" "\n");
+        exit(1);
+    }
+    memmove(s->source + position + inserted_length, s->source + position + removed, tail);
+    memcpy(s->source + position, inserted, inserted_length);
+    s->source[length] = '\0';
+    s->source_length = length;
+}
+
+size_t incremental_scanner_edit(
+    IncrementalScanner* s, size_t position, size_t removed,
+    const char* inserted, size_t inserted_length
+) {
+    Scanner* scanner = &s->scanner;
+    if (position > scanner->source_length) position = scanner->source_length;
+    if (removed > scanner->source_length - position) removed = scanner->source_length - position;
+
+    size_t first = first_changed_token(s, position);
+    edit_source(scanner, position, removed, inserted, inserted_length);
+    scanner_restore(scanner, first < s->token_count ? s->checkpoints[first] : SCANNER_START);
+
+    // Old tokens from field 'checkpoints'[old] on are kept once the rescan reaches their
+    // checkpoint, past the edit by more than the lookbehind so they read none of it
+    size_t old = first;
+    size_t fresh = 0;
+    while (true) {
+        ScannerCheckpoint c = scanner_checkpoint(scanner);
+        if (c.current >= position + inserted_length + SCANNER_LOOKBEHIND) {
+            // Position of the checkpoint in the source before the edit
+            size_t before = c.current - inserted_length + removed;
+            while (old < s->token_count && s->checkpoints[old].current < before) old++;
+            for (size_t i = old;i < s->token_count && s->checkpoints[i].current == before;i++) {
+                if (!same_state(s->checkpoints[i], c)) continue;
+                // Move the kept tokens after the fresh ones, shifted by the length difference
+                size_t kept = s->token_count - i;
+                reserve_tokens(&s->tokens, &s->checkpoints, &s->token_capacity, first + fresh + kept);
+                memmove(s->tokens + first + fresh, s->tokens + i, kept * sizeof(Token));
+                memmove(s->checkpoints + first + fresh, s->checkpoints + i, kept * sizeof(ScannerCheckpoint));
+                for (size_t k = first + fresh;k < first + fresh + kept;k++) {
+                    s->tokens[k].position = s->tokens[k].position + inserted_length - removed;
+                    s->checkpoints[k].current = s->checkpoints[k].current + inserted_length - removed;
+                }
+                if (s->error.code != NoError) s->error.position = s->error.position + inserted_length - removed;
+                memcpy(s->tokens + first, s->fresh_tokens, fresh * sizeof(Token));
+                memcpy(s->checkpoints + first, s->fresh_checkpoints, fresh * sizeof(ScannerCheckpoint));
+                s->token_count = first + fresh + kept;
+                return fresh;
+            }
+        }
+
+        Token t = get_next_token(scanner);
+        reserve_tokens(&s->fresh_tokens, &s->fresh_checkpoints, &s->fresh_capacity, fresh + 1);
+        s->fresh_tokens[fresh] = t;
+        s->fresh_checkpoints[fresh] = c;
+        fresh++;
+        if (t.type == EndMarker) break;
+    }
+
+    // No old token could be kept, the rescan went to the end of the source
+    reserve_tokens(&s->tokens, &s->checkpoints, &s->token_capacity, first + fresh);
+    memcpy(s->tokens + first, s->fresh_tokens, fresh * sizeof(Token));
+    memcpy(s->checkpoints + first, s->fresh_checkpoints, fresh * sizeof(ScannerCheckpoint));
+    s->token_count = first + fresh;
+    s->error = scanner->error;
+    return fresh;
+}
@@ -0,0 +1,44 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "./scanner.h"
+
+// Tokens of a pattern being edited, like a pattern typed in an input field
+// An edit only rescans from the last token it can change, and stops as soon as the scanner
+// is back in the state it was in before the edit at the same place, the tokens after it are
+// the old ones moved by the length difference
+// All memory comes from malloc since the source changes with every edit
+struct _IncrementalScanner {
+    // Scanner of the rescans, its field 'source' is owned by this structure
+    Scanner scanner;
+    // Tokens of the whole source, the last one is its EndMarker
+    Token* tokens;
+    // State of the scanner before each token, where a rescan resumes from
+    ScannerCheckpoint* checkpoints;
+    size_t token_count;
+    size_t token_capacity;
+    // Tokens of the rescan of an edit before they replace the ones it changed
+    Token* fresh_tokens;
+    ScannerCheckpoint* fresh_checkpoints;
+    size_t fresh_capacity;
+    // First syntax error of the whole source, code NoError while there is none
+    PatternError error;
+};
+
+typedef struct _IncrementalScanner IncrementalScanner;
+
+// Scan `length` characters of `source`, which are copied
+IncrementalScanner new_incremental_scanner(const char* source, size_t length);
+
+void free_incremental_scanner(IncrementalScanner* s);
+
+// Replace `removed` characters of the source starting at `position` with `inserted_length`
+// characters of `inserted`, then bring the tokens and field 'error' up to date
+// `position` and `removed` are clamped to the source
+// Returns the number of tokens scanned again, the others were kept
+size_t incremental_scanner_edit(
+    IncrementalScanner* s, size_t position, size_t removed,
+    const char* inserted, size_t inserted_length
+);
+
+#endif
@@ -1,46 +1,107 @@
 #include <ctype.h>
+#include "../charset/charset.h"
 #include "./scanner.h"
 
-#define METACHARACTERS_COUNT 13
-static const char METACHARACTERS[METACHARACTERS_COUNT] = {
-    '(', ')', '{', '}', '[' , ']', '*', '+', '.', '?', '\\', '|'
+#define SCANNER_SHORT_RUN 16
+
+// Kinds of a character, combined with | in CHARACTER_KINDS
+enum _CharacterKind {
+    // ( ) { } [ ] * + . ? \ | and the \0 read past the end of the source
+    KindMetacharacter = 1 << 0,
+    // Follows a \ in \A \Z \b \B
+    KindAnchor = 1 << 1,
+    // Follows a \ in \d \D \s \S \w \W
+    KindSlashClass = 1 << 2,
+    KindDigit = 1 << 3,
+};
+
+static const uint8_t CHARACTER_KINDS[256] = {
+    ['\0'] = KindMetacharacter,
+    ['('] = KindMetacharacter, [')'] = KindMetacharacter,
+    ['{'] = KindMetacharacter, ['}'] = KindMetacharacter,
+    ['['] = KindMetacharacter, [']'] = KindMetacharacter,
+    ['*'] = KindMetacharacter, ['+'] = KindMetacharacter, ['.'] = KindMetacharacter,
+    ['?'] = KindMetacharacter, ['\\'] = KindMetacharacter, ['|'] = KindMetacharacter,
+    ['A'] = KindAnchor, ['Z'] = KindAnchor, ['b'] = KindAnchor, ['B'] = KindAnchor,
+    ['d'] = KindSlashClass, ['D'] = KindSlashClass, ['s'] = KindSlashClass,
+    ['S'] = KindSlashClass, ['w'] = KindSlashClass, ['W'] = KindSlashClass,
+    ['0' ... '9'] = KindDigit,
+};
+
+// Characters without KindMetacharacter, the runs literals are made of
+// Runs longer than SCANNER_SHORT_RUN are skipped with charset_skip, 16 or 32 characters at a time
+static const CharSet PLAIN_CHARSET = {
+    .bits = {0x7FFFB0FFFFFFFFFEull, 0xC7FFFFFFC7FFFFFFull, 0xFFFFFFFFFFFFFFFFull, 0xFFFFFFFFFFFFFFFFull},
+    .low_table = {
+        0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFB, 0xFB, 0xFB, 0x5B, 0x5F, 0x5F, 0xFB, 0xF7,
+    },
+    .high_table = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    },
 };
 
 static bool is_metacharacter(char c) {
-    for (size_t i = 0;i < METACHARACTERS_COUNT;i++)
-        if (METACHARACTERS[i] == c) return true;
-    return false;
+    return CHARACTER_KINDS[(unsigned char)c] & KindMetacharacter;
 }
 
 static bool is_anchor_char(char c) {
-    return c == 'A' || c == 'Z' || c == 'b' || c == 'B';
+    return CHARACTER_KINDS[(unsigned char)c] & KindAnchor;
 }
 
 static bool is_slash_class_char(char c) {
-    return c == 'd' || c == 'D' || c == 's' || c == 'S' || c == 'w' || c == 'W';
+    return CHARACTER_KINDS[(unsigned char)c] & KindSlashClass;
+}
+
+static bool is_digit(char c) {
+    return CHARACTER_KINDS[(unsigned char)c] & KindDigit;
 }
 
-Scanner new_scanner(const char* source, size_t length) {
-    char* source_copy = malloc(length);
-    memcpy(source_copy, source, length);
-    return (Scanner) {
-        .source = source_copy,
+Scanner new_scanner(Arena* arena, const char* source, size_t length) {
+    Scanner s = (Scanner) {
+        .arena = arena,
+        .source = arena_copy(arena, source, length),
         .source_length = length,
-        .current = 0,
-        .found_empty_string = false,
-        .inside_parentheses = false,
-        .inside_braces = false,
-        .inside_brackets = false,
-        .found_brackets_inverter = false,
     };
+    scanner_restore(&s, SCANNER_START);
+    return s;
+}
+
+ScannerCheckpoint scanner_checkpoint(const Scanner* s) {
+    return (ScannerCheckpoint) {
+        .current = s->current,
+        .found_empty_string = s->found_empty_string,
+        .inside_parentheses = s->inside_parentheses,
+        .inside_braces = s->inside_braces,
+        .inside_brackets = s->inside_brackets,
+        .found_brackets_inverter = s->found_brackets_inverter,
+        .error = s->error,
+    };
+}
+
+void scanner_restore(Scanner* s, ScannerCheckpoint c) {
+    s->current = c.current;
+    s->found_empty_string = c.found_empty_string;
+    s->inside_parentheses = c.inside_parentheses;
+    s->inside_braces = c.inside_braces;
+    s->inside_brackets = c.inside_brackets;
+    s->found_brackets_inverter = c.found_brackets_inverter;
+    s->error = c.error;
 }
 
 static Token make_end_marker(size_t source_length) {
-    return (Token){.type = EndMarker, .lexeme="", .length=0, .position=source_length};
+    return (Token){.type = EndMarker, .length=0, .position=source_length};
 }
 
 static Token make_empty_token(size_t position) {
-        return (Token){.type = Empty, .lexeme="", .length=0, .position=position};
+        return (Token){.type = Empty, .length=0, .position=position};
+}
+
+// Record the error at source[position, position + span) and end the token stream there
+static Token fail(Scanner* s, PatternErrorCode code, size_t position, size_t span) {
+    s->error = (PatternError){.code = code, .position = position, .span = span, .pattern = 0};
+    return make_end_marker(s->source_length);
 }
 
 static bool has_next(Scanner* s) {
@@ -63,7 +124,33 @@ static char get_next_char(Scanner* s) {
     return get_char(s, s->current+1);
 }
 
+// Literal token `t` starting at field 'current', made of every non-metacharacter and
+// escaped metacharacter from there
+static Token scan_literal(Scanner* s, Token t) {
+    while (has_next(s)) {
+        // Short runs are cheaper one character at a time than through charset_skip
+        size_t stop = s->current + SCANNER_SHORT_RUN;
+        while (has_next(s) && s->current < stop && !is_metacharacter(get_peek_char(s))) s->current++;
+        if (s->current == stop) s->current = charset_skip(&PLAIN_CHARSET, s->source, s->source_length, s->current);
+        // A \ ending the pattern escapes nothing, it is reported by the next token
+        bool escapes = s->current + 1 < s->source_length && is_metacharacter(get_next_char(s));
+        if (get_peek_char(s) == '\\' && escapes) s->current += 2;
+        else break;
+    }
+    // A \ escaping nothing inside braces or a \0 of the source is a literal of its own,
+    // every token but Empty and EndMarker moves the scanner forward
+    if (s->current == t.position) s->current++;
+
+    // Escaped metacharacters are left in place, decode_token strips their slashes
+    t.type = Literal;
+    t.length = s->current - t.position;
+    return t;
+}
+
 Token get_next_token(Scanner* s) {
+    // Nothing follows an error
+    if (s->error.code != NoError) return make_end_marker(s->source_length);
+
     bool is_previous_char_escaped = false;
     if (s->current >= 2) {
         is_previous_char_escaped = s->source[s->current - 2] == '\\';
@@ -109,13 +196,9 @@ Token get_next_token(Scanner* s) {
 
     Token next_token = (Token) {
         .type = EndMarker,
-        .lexeme = "",
         .length = 1,
         .position = s->current,
     };
-    next_token.lexeme = malloc(2);
-    next_token.lexeme[0] = peek_char;
-    next_token.lexeme[1] = '\0';
 
     peek_char = get_peek_char(s);
     char next_char = get_next_char(s);
@@ -136,39 +219,20 @@ Token get_next_token(Scanner* s) {
             };
 
             next_token.type = Range;
-            next_token.lexeme = malloc(2);
-            next_token.lexeme[0] = lookahead[0];
 
             if (lookahead[1] == '-') {
                 bool ordered = lookahead[0] <= lookahead[2];
-                bool two_digits = isdigit(lookahead[0]) && isdigit(lookahead[2]);
+                bool two_digits = is_digit(lookahead[0]) && is_digit(lookahead[2]);
                 bool two_lower_case_letters = islower(lookahead[0]) && islower(lookahead[2]);
                 bool two_upper_case_letters = isupper(lookahead[0]) && isupper(lookahead[2]);
                 if (ordered && (two_digits || two_lower_case_letters || two_upper_case_letters)) {
-                    next_token.lexeme[1] = lookahead[2];
                     next_token.length = 3;
                 } else {
-                    // Invalid range
-                    char* caret = malloc(s->source_length);
-                    for (size_t i = 0;i < s->current;i++) caret[i] = ' ';
-                    caret[s->current] = '^';
-                    caret[s->current + 1] = '^';
-                    caret[s->current + 2] = '^';
-                    for (size_t i = s->current+3;i < s->source_length;i++) caret[i] = ' ';
-                    fprintf(
-                        stderr,
-                        "Invalid range %c-%c at position %lu" "\n"
-                        "%s" "\n" "%s" "\n",
-                        lookahead[0], lookahead[2], s->current, s->source, caret
-                    );
-                    exit(1);
+                    return fail(s, InvalidRangeError, s->current, 3);
                 }
             } else if (lookahead[0] == '\\' && is_metacharacter(lookahead[1])) {
-                next_token.lexeme[0] = lookahead[1];
-                next_token.lexeme[1] = lookahead[1];
                 next_token.length = 2;
             } else {
-                next_token.lexeme[1] = lookahead[0];
                 next_token.length = 1;
             }
             s->current += next_token.length;
@@ -179,15 +243,13 @@ Token get_next_token(Scanner* s) {
             next_token.type = Comma;
             s->current++;
             return next_token;
-        } else if (isdigit(peek_char)) {
+        } else if (is_digit(peek_char)) {
             size_t digits = 0;
-            while (isdigit(get_peek_char(s))) {
+            while (is_digit(get_peek_char(s))) {
                 digits++;
                 s->current++;
             }
             next_token.type = Integer;
-            next_token.lexeme = malloc(digits);
-            memcpy(next_token.lexeme, s->source+(s->current - digits), digits);
             next_token.length = digits;
             return next_token;
         }
@@ -196,13 +258,7 @@ Token get_next_token(Scanner* s) {
         s->current += 1; // Move past slash
 
         if (!has_next(s)) {
-            fprintf(
-                stderr,
-                "Trailing \\ at end of pattern" "\n"
-                "\\ must be followed by something" "\n"
-                "Use `\\\\\\\\` in your pattern to match a literal \\" "\n"
-            );
-            exit(1);
+            return fail(s, TrailingSlashError, slash_pos, 1);
         }
 
         if (is_anchor_char(next_char) || is_slash_class_char(next_char)) {
@@ -211,44 +267,32 @@ Token get_next_token(Scanner* s) {
 
             if (next_char == 'A') {
                 next_token.type = StartAnchor;
-                next_token.lexeme = "\\A";
             } else if (next_char == 'b') {
                 next_token.type = WordBoundaryAnchor;
-                next_token.lexeme = "\\b";
             } else if (next_char == 'B') {
                 next_token.type = NonWordBoundaryAnchor;
-                next_token.lexeme = "\\B";
             } else if (next_char == 'd') {
                 next_token.type = DigitClass;
-                next_token.lexeme = "\\d";
             } else if (next_char == 'D') {
                 next_token.type = NonDigitClass;
-                next_token.lexeme = "\\D";
             } else if (next_char == 'w') {
                 next_token.type = WordCharacterClass;
-                next_token.lexeme = "\\w";
             } else if (next_char == 'W') {
                 next_token.type = NonWordCharacterClass;
-                next_token.lexeme = "\\W";
             } else if (next_char == 's') {
                 next_token.type = WhitespaceClass;
-                next_token.lexeme = "\\s";
             } else if (next_char == 'S') {
                 next_token.type = NonWhitespaceClass;
-                next_token.lexeme = "\\S";
             } else if (next_char == 'Z') {
                 next_token.type = EndAnchor;
-                next_token.lexeme = "\\Z";
             }
-        } else if (next_char != '0' && isdigit(next_char)) {
+        } else if (next_char != '0' && is_digit(next_char)) {
             size_t digits = 0;
-            while (isdigit(get_peek_char(s))) {
+            while (is_digit(get_peek_char(s))) {
                 digits++;
                 s->current++;
             }
             next_token.type = Backreference;
-            next_token.lexeme = malloc(digits);
-            memcpy(next_token.lexeme, s->source + slash_pos + 1, digits);
             next_token.length = digits + 1;
         } else if (next_char == 'g') {
             s->current++; // Move past g
@@ -261,127 +305,51 @@ Token get_next_token(Scanner* s) {
                 }
                 if (peek_char == '>') {
                     s->current++; // Move past >
-                    next_token.lexeme = malloc(chars);
-                    memcpy(next_token.lexeme, s->source + slash_pos + 3, chars);
-                    bool is_group_number = isdigit(next_token.lexeme[0]);
-                    for(size_t i = 1;i < chars && is_group_number;i++) is_group_number = isdigit(next_token.lexeme[i]);
+                    // Group number or name between < and >
+                    const char* group = s->source + slash_pos + 3;
+                    bool is_group_number = is_digit(group[0]);
+                    for(size_t i = 1;i < chars && is_group_number;i++) is_group_number = is_digit(group[i]);
                     if (is_group_number) {
                         next_token.type = Backreference;
                         next_token.length = s->current - slash_pos;
                     } else {
-                        bool is_group_name = next_token.lexeme[0] == '_' && isalpha(next_token.lexeme[0]);
+                        bool is_group_name = group[0] == '_' && isalpha(group[0]);
                         for(size_t i = 1;i < chars && is_group_number;i++)
-                            is_group_name = isalnum(next_token.lexeme[i]);
+                            is_group_name = isalnum(group[i]);
                         if (is_group_name) {
                             next_token.type = Backreference;
                             next_token.length = s->current - slash_pos;
                         } else {
-                            char* caret = malloc(s->source_length);
-                            size_t i = 0;
-                            for (;i < slash_pos + 3;i++) caret[i] = ' ';
-                            for (size_t k = 1; k <= chars; k++) {
-                                caret[i] = '^'; i++;
-                            }
-                            for (;i < s->source_length;i++) caret[i] = ' ';
-                            fprintf(
-                                stderr,
-                                "Invalid group number or name `%s` in backreference at %lu" "\n"
-                                "%s" "\n" "%s" "\n"
-                                "Use a positive integer starting from 1 or any alphanumeric string starting with a non-digit" "\n"
-                                "Otherwise use `\\\\\\\\g` in your pattern to match a \\ followed by `g`" "\n",
-                                next_token.lexeme, slash_pos,
-                                s->source, caret
-                            );
-                            exit(1);
+                            return fail(s, InvalidGroupNameError, slash_pos + 3, chars);
                         }
                     }
+                } else {
+                    return fail(s, ExpectedGroupError, slash_pos, s->current - slash_pos);
                 }
             } else {
-                char* caret = malloc(s->source_length);
-                size_t i = 0;
-                for (;i < slash_pos;i++) caret[i] = ' ';
-                caret[i] = '^'; i++;
-                caret[i] = '^'; i++;
-                for (;i < s->source_length;i++) caret[i] = ' ';
-                fprintf(
-                    stderr,
-                    "Expected numeric backreference `\\g<GROUP_NUMBER>` or named backreference `\\g<group_name>` at %lu" "\n"
-                    "%s" "\n" "%s" "\n"
-                    "Use a positive integer starting from 1 or any alphanumeric string starting with a non-digit" "\n"
-                    "Otherwise use `\\\\\\\\g` in your pattern to match a \\ followed by `g`" "\n",
-                    slash_pos,
-                    s->source, caret
-                );
-                exit(1);
+                return fail(s, ExpectedGroupError, slash_pos, 2);
             }
-        } else if (!is_metacharacter(next_char)) {
-            char* caret = malloc(s->source_length);
-            size_t i = 0;
-            for (;i < slash_pos;i++) caret[i] = ' ';
-            caret[i] = '^'; i++;
-            caret[i] = '^'; i++;
-            for (;i < s->source_length;i++) caret[i] = ' ';
-            char invalid_escape_char = s->source[slash_pos + 1];
-            fprintf(
-                stderr,
-                "Invalid regular expression escape `\\%c` at position %lu" "\n"
-                "%s" "\n" "%s" "\n"
-                "Use `\\\\\\\\%c` in your pattern to match a \\ followed by %c" "\n",
-                invalid_escape_char, slash_pos,
-                s->source, caret,
-                invalid_escape_char, invalid_escape_char
-            );
-            exit(1);
+        } else if (is_metacharacter(next_char)) {
+            // An escaped metacharacter starts a literal like any other character
+            s->current = slash_pos;
+            return scan_literal(s, next_token);
+        } else {
+            return fail(s, InvalidEscapeError, slash_pos, 2);
         }
 
+        // Only the end of the source makes an EndMarker, any escape left without a type is invalid
+        if (next_token.type == EndMarker) return fail(s, InvalidEscapeError, slash_pos, s->current - slash_pos);
         return next_token;
     } 
 
     switch (peek_char) {
         case '[':
             if (s->inside_brackets) {
-                char* caret = malloc(s->source_length);
-                for (size_t i = 0;i < s->current;i++) caret[i] = ' ';
-                caret[s->current] = '^';
-                for (size_t i = s->current+1;i < s->source_length;i++) caret[i] = ' ';
-                fprintf(
-                    stderr,
-                    "Nested [ at position %lu" "\n"
-                    "%s" "\n" "%s" "\n"
-                    "Use `\\[` to match a literal [ inside a character class" "\n"
-                    "Use `\\[` to match a literal ] inside a character class" "\n",
-                    s->current, s->source, caret
-                );
-                exit(1);
+                return fail(s, NestedBracketError, s->current, 1);
             } else if (next_char == ']') {
-                char* caret = malloc(s->source_length);
-                for (size_t i = 0;i < s->current;i++) caret[i] = ' ';
-                caret[s->current] = '^';
-                caret[s->current + 1] = '^';
-                for (size_t i = s->current+2;i < s->source_length;i++) caret[i] = ' ';
-                fprintf(
-                    stderr,
-                    "Empty character class at position %lu" "\n"
-                    "%s" "\n" "%s" "\n"
-                    "Use `\\[\\]` to match a [ followed by ]" "\n"
-                    "Use `\\]` to match a literal ] inside a character class" "\n",
-                    s->current, s->source, caret
-                );
-                exit(1);
+                return fail(s, EmptyClassError, s->current, 2);
             } else if (next_char == '^' && get_char(s, s->current+2) == ']') {
-                char* caret = malloc(s->source_length);
-                for (size_t i = 0;i < s->current+1;i++) caret[i] = ' ';
-                caret[s->current+1] = '^';
-                for (size_t i = s->current+2;i < s->source_length;i++) caret[i] = ' ';
-                fprintf(
-                    stderr,
-                    "Using ^ alone inside a character class at position %lu" "\n"
-                    "%s" "\n" "%s" "\n"
-                    "Write `[\\^]` to use ^ inside a character class" "\n"
-                    "Or make ^ the first character after [ if there are other characters inside [ and ]" "\n",
-                    s->current+1, s->source, caret
-                );
-                exit(1);
+                return fail(s, LoneInverterError, s->current + 1, 1);
             }
             s->inside_brackets = true;
             next_token.type = LeftBracket;
@@ -389,19 +357,7 @@ Token get_next_token(Scanner* s) {
 
         case ']':
             if (!s->inside_brackets) {
-                char* caret = malloc(s->source_length);
-                for (size_t i = 0;i < s->current;i++) caret[i] = ' ';
-                caret[s->current] = '^';
-                for (size_t i = s->current+1;i < s->source_length;i++) caret[i] = ' ';
-
-                fprintf(
-                    stderr,
-                    "Unmatched ] at position %lu" "\n"
-                    "%s" "\n" "%s" "\n"
-                    "Use `\\]` to match a literal ]" "\n",
-                    s->current, s->source, caret
-                );
-                exit(1);
+                return fail(s, UnmatchedRightBracketError, s->current, 1);
             }
             s->inside_brackets = false;
             s->found_brackets_inverter = false;
@@ -410,31 +366,9 @@ Token get_next_token(Scanner* s) {
 
         case '{':
             if (s->inside_braces) {
-                char* caret = malloc(s->source_length);
-                for (size_t i = 0;i < s->current;i++) caret[i] = ' ';
-                caret[s->current] = '^';
-                for (size_t i = s->current+1;i < s->source_length;i++) caret[i] = ' ';
-                fprintf(
-                    stderr,
-                    "Nested { at position %lu" "\n"
-                    "%s" "\n" "%s" "\n",
-                    s->current, s->source, caret
-                );
-                exit(1);
+                return fail(s, NestedBraceError, s->current, 1);
             } else if (next_char == '}') {
-                char* caret = malloc(s->source_length);
-                for (size_t i = 0;i < s->current;i++) caret[i] = ' ';
-                caret[s->current] = '^';
-                caret[s->current + 1] = '^';
-                for (size_t i = s->current+2;i < s->source_length;i++) caret[i] = ' ';
-                fprintf(
-                    stderr,
-                    "Empty braces quantifieri at position %lu" "\n"
-                    "%s" "\n" "%s" "\n"
-                    "Use `\\{\\}` to match a { followed by }" "\n",
-                    s->current, s->source, caret
-                );
-                exit(1);
+                return fail(s, EmptyBracesError, s->current, 2);
             }
             s->inside_braces = true;
             next_token.type = LeftBrace;
@@ -442,46 +376,22 @@ Token get_next_token(Scanner* s) {
 
         case '}':
             if (!s->inside_braces) {
-                char* caret = malloc(s->source_length);
-                for (size_t i = 0;i < s->current;i++) caret[i] = ' ';
-                caret[s->current] = '^';
-                for (size_t i = s->current+1;i < s->source_length;i++) caret[i] = ' ';
-
-                fprintf(
-                    stderr,
-                    "Unmatched } at position %lu" "\n"
-                    "%s" "\n" "%s" "\n"
-                    "Use `\\}` to match a literal }" "\n",
-                    s->current, s->source, caret
-                );
-                exit(1);
+                return fail(s, UnmatchedRightBraceError, s->current, 1);
             }
             s->inside_braces = false;
             next_token.type = RightBrace;
             break;
 
         case '(':
-            s->inside_parentheses = true;
+            s->inside_parentheses++;
             next_token.type = LeftParen;
             break;
 
         case ')':
-            if (!s->inside_parentheses) {
-                char* caret = malloc(s->source_length);
-                for (size_t i = 0;i < s->current;i++) caret[i] = ' ';
-                caret[s->current] = '^';
-                for (size_t i = s->current+1;i < s->source_length;i++) caret[i] = ' ';
-
-                fprintf(
-                    stderr,
-                    "Unmatched ) at position %lu" "\n"
-                    "%s" "\n" "%s" "\n"
-                    "Use `\\)` to match a literal )" "\n",
-                    s->current, s->source, caret
-                );
-                exit(1);
+            if (s->inside_parentheses == 0) {
+                return fail(s, UnmatchedRightParenError, s->current, 1);
             }
-            s->inside_parentheses = false;
+            s->inside_parentheses--;
             next_token.type = RightParen;
             break;
 
@@ -493,12 +403,10 @@ Token get_next_token(Scanner* s) {
             if (next_char == '?') {
                 s->current++;
                 next_token.type = LazyMark;
-                next_token.lexeme = "??";
                 next_token.length = 2;
             } else if (next_char == '+') {
                 s->current++;
                 next_token.type = PossessiveMark;
-                next_token.lexeme = "?+";
                 next_token.length = 2;
             } else {
                 next_token.type = Mark;
@@ -509,12 +417,10 @@ Token get_next_token(Scanner* s) {
             if (next_char == '?') {
                 s->current++;
                 next_token.type = LazyStar;
-                next_token.lexeme = "*?";
                 next_token.length = 2;
             } else if (next_char == '+') {
                 s->current++;
                 next_token.type = PossessiveStar;
-                next_token.lexeme = "*+";
                 next_token.length = 2;
             } else {
                 next_token.type = Star;
@@ -525,12 +431,10 @@ Token get_next_token(Scanner* s) {
             if (next_char == '?') {
                 s->current++;
                 next_token.type = LazyPlus;
-                next_token.lexeme = "+?";
                 next_token.length = 2;
             } else if (next_char == '+') {
                 s->current++;
                 next_token.type = PossessivePlus;
-                next_token.lexeme = "++";
                 next_token.length = 2;
             } else {
                 next_token.type = Plus;
@@ -542,40 +446,64 @@ Token get_next_token(Scanner* s) {
             break;
 
         default:
-            size_t chars_count = 0;
-            // Consume any non-metacharacter or any escaped metacharacter
-            while (has_next(s)) {
-                char peek = get_peek_char(s);
-                char next = get_next_char(s);
-                if (!is_metacharacter(peek)) {
-                    s->current++;
-                    chars_count++;
-                } else if (peek == '\\' && is_metacharacter(next)) {
-                    s->current += 2;
-                    chars_count += 2;
-                } else {
-                    break;
-                }
+            return scan_literal(s, next_token);
+    }
+    s->current++;
+    return next_token;
+}
+
+size_t decode_token(const Scanner* s, Token t, char* buffer, size_t capacity) {
+    // Slice of source this token points to, clamped to the source end
+    const char* text = s->source + t.position;
+    size_t length = t.length;
+    if (t.position >= s->source_length) length = 0;
+    else if (length > s->source_length - t.position) length = s->source_length - t.position;
+
+    size_t written = 0;
+    switch (t.type) {
+        case Literal:
+            for (size_t i = 0;i < length;i++) {
+                // Any metacharacter inside a literal is an escaping slash
+                if (text[i] == '\\' && i + 1 < length) i++;
+                if (written < capacity) buffer[written] = text[i];
+                written++;
             }
+            return written;
+
+        case Range: {
+            // Lower bound followed by upper bound
+            char bounds[2];
+            if (length == 3) {
+                // x-y
+                bounds[0] = text[0];
+                bounds[1] = text[2];
+            } else if (length == 2) {
+                // Escaped metacharacter
+                bounds[0] = bounds[1] = text[1];
+            } else {
+                bounds[0] = bounds[1] = length == 0 ? '\0' : text[0];
+            }
+            for (;written < 2;written++)
+                if (written < capacity) buffer[written] = bounds[written];
+            return written;
+        }
 
-            next_token.type = Literal;
-            next_token.lexeme = malloc(chars_count);
-            const size_t old_position = s->current - chars_count;
-            size_t lexeme_length = 0;
-            for (size_t i = 0, k = old_position;k < s->current;k++,i++) {
-                if (is_metacharacter(s->source[k])) {
-                    lexeme_length += 2;
-                    k++;
-                    next_token.lexeme[i] = s->source[k];
-                } else {
-                    lexeme_length++;
-                    next_token.lexeme[i] = s->source[k];
-                }
+        case Backreference:
+            if (length >= 4 && text[1] == 'g') {
+                // \g<group>
+                text += 3;
+                length -= 4;
+            } else if (length >= 1) {
+                // \N
+                text += 1;
+                length -= 1;
             }
-            next_token.length = lexeme_length;
-            next_token.position = old_position;
-            return next_token;
+            break;
+
+        default:
+            break;
     }
-    s->current++;
-    return next_token;
+
+    memcpy(buffer, text, length < capacity ? length : capacity);
+    return length;
 }
@@ -1,11 +1,16 @@
 #ifndef SCANNER_H
 #define SCANNER_H
 
+#include "../arena/arena.h"
+#include "../errors/errors.h"
 #include "./tokens.h"
 
 // Scanner data structure
 struct _Scanner {
-    // Input pattern to be transformed into Tokens
+    // Arena of the compilation this scanner belongs to, NULL in an IncrementalScanner
+    Arena* arena;
+    // Input pattern to be transformed into Tokens, a copy owned by field 'arena'
+    // or by the IncrementalScanner the scanner belongs to
     char* source;
     // Input length, needed to make the scanner stop generating tokens after consuming the whole input
     size_t source_length;
@@ -16,22 +21,67 @@ struct _Scanner {
     // the scanner generated empty string token at current position or not
     // otherwise the scanner will loop endlessly generating empty string token at the position
     bool found_empty_string;
-    bool inside_parentheses;
+    // Number of ( not closed yet, zero outside parentheses
+    size_t inside_parentheses;
     bool inside_braces;
     bool inside_brackets;
     bool found_brackets_inverter;
+    // First syntax error found, code NoError while there is none
+    PatternError error;
 };
 
 typedef struct _Scanner Scanner;
 
+// State of a scanner between two tokens, see field descriptions of Scanner
+// Restoring it makes the scanner produce the same tokens again as long as the source
+// from two characters before field 'current' onwards is the same
+struct _ScannerCheckpoint {
+    size_t current;
+    bool found_empty_string;
+    size_t inside_parentheses;
+    bool inside_braces;
+    bool inside_brackets;
+    bool found_brackets_inverter;
+    PatternError error;
+};
+
+typedef struct _ScannerCheckpoint ScannerCheckpoint;
+
+// Checkpoint of a scanner that has not read anything yet
+#define SCANNER_START ((ScannerCheckpoint){ \
+    .current = 0, .found_empty_string = false, .inside_parentheses = 0, .inside_braces = false, \
+    .inside_brackets = false, .found_brackets_inverter = false, .error = NO_PATTERN_ERROR \
+})
+
 // Construct a new scanner from a string
-Scanner new_scanner(const char* source, size_t length);
+// The scanner copies `source` into `arena`, all its memory is released with the arena
+Scanner new_scanner(Arena* arena, const char* source, size_t length);
 
 // Consume character in source and generate a token
+// On a syntax error sets field 'error' and returns an EndMarker, so does every later call
+// Otherwise an EndMarker is only returned at the end of the source
 Token get_next_token(Scanner* s);
 
+// Save the state of `s` to resume scanning from where it is now
+ScannerCheckpoint scanner_checkpoint(const Scanner* s);
+
+// Resume scanning from checkpoint `c`, taken from `s` or from a scanner of an earlier version
+// of the same source, see IncrementalScanner
+void scanner_restore(Scanner* s, ScannerCheckpoint c);
+
+// Decode the value of token `t` into `buffer`, writing at most `capacity` characters
+// Literal: escaped metacharacters lose their slashes
+// Range: two characters, lower bound followed by upper bound
+// Integer: the digits
+// Backreference: group number or name, without \ or \g<>
+// Any other token: its characters in source string
+// Returns the number of characters the decoded value has, which may be larger than `capacity`
+// No heap memory is used, tokens themselves only point into source string
+size_t decode_token(const Scanner* s, Token t, char* buffer, size_t capacity);
+
 // Print token in this format:
 // Token { type = type_name, lexeme = "lexeme_value", length = N, position = I }
-void print_token(Token t);
+// where lexeme is the slice of `source` this token points to
+void print_token(const char* source, Token t);
 
 #endif
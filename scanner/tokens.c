@@ -88,8 +88,8 @@ const char* token_type_name(TokenType t) {
     return "UNKNOWN";
 }
 
-void print_token(Token t) {
-    printf("Token { type = %s, lexeme = %s, length = %lu, position = %lu }",
-           token_type_name(t.type), t.lexeme, t.length, t.position);
+void print_token(const char* source, Token t) {
+    printf("Token { type = %s, lexeme = \"%.*s\", length = %lu, position = %lu }",
+           token_type_name(t.type), (int)t.length, source + t.position, t.length, t.position);
     printf("\n");
 }
@@ -55,12 +55,12 @@ enum _TokenType {
 
 typedef enum _TokenType TokenType;
 
+// A token is a view into the scanner source string, it owns no memory
+// Its characters are source[position, position + length)
+// Use decode_token to get its value (e.g. a literal without escaping slashes)
 struct _Token {
     TokenType type;
-    // Actually characters this token points to
-    char* lexeme;
     // Number of characters this token points to in source string
-    // NOT number of characters in field 'lexeme'
     size_t length;
     // Position in source string
     size_t position;
@@ -70,6 +70,6 @@ typedef struct _Token Token;
 
 const char* token_type_name(TokenType t);
 
-void print_token(Token t);
+void print_token(const char* source, Token t);
 
 #endif
@@ -0,0 +1,401 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "./serialize.h"
+
+// Sizes of the structures stored as they are in memory, and the byte order, hashed
+static uint32_t layout_fingerprint(void) {
+    uint32_t order = 1;
+    size_t sizes[] = {
+        sizeof(SerialHeader), sizeof(Program), sizeof(Instruction), sizeof(ProgramClass),
+        sizeof(ClassRange), sizeof(Prefilter), sizeof(LiteralMatcher), sizeof(AcState),
+        sizeof(OnePass), sizeof(OnePassAction), sizeof(CharSet), sizeof(DfaState),
+        sizeof(DfaLoop), sizeof(size_t), *(uint8_t*)&order,
+    };
+    uint32_t h = 2166136261u;
+    for (size_t i = 0;i < sizeof(sizes) / sizeof(sizes[0]);i++) h = (h ^ (uint32_t)sizes[i]) * 16777619u;
+    return h;
+}
+
+// Continue hash `h` over `size` bytes
+// Four lanes take 8 bytes each in turn so their multiplications overlap, loading is bound
+// by reading the block rather than by one chain of multiplications
+static uint64_t checksum(uint64_t h, const unsigned char* data, size_t size) {
+    uint64_t lanes[4] = {h, h ^ 1, h ^ 2, h ^ 3};
+    for (;size >= 32;data += 32, size -= 32) {
+        for (int i = 0;i < 4;i++) {
+            uint64_t word;
+            memcpy(&word, data + 8 * i, 8);
+            lanes[i] = (lanes[i] ^ word) * 0x100000001B3ull;
+            lanes[i] ^= lanes[i] >> 29;
+        }
+    }
+    h = lanes[0];
+    for (int i = 1;i < 4;i++) {
+        h = (h ^ lanes[i]) * 0x100000001B3ull;
+        h ^= h >> 29;
+    }
+    for (;size > 0;data++, size--) h = (h ^ *data) * 0x100000001B3ull;
+    return h;
+}
+
+// Checksum of a block, its header taken with field 'checksum' 0
+static uint64_t block_checksum(const char* data, size_t size) {
+    SerialHeader header;
+    memcpy(&header, data, sizeof(SerialHeader));
+    header.checksum = 0;
+    uint64_t h = checksum(0xCBF29CE484222325ull, (const unsigned char*)&header, sizeof(SerialHeader));
+    return checksum(h, (const unsigned char*)data + sizeof(SerialHeader), size - sizeof(SerialHeader));
+}
+
+static void write_bytes(SerialWriter* w, const void* bytes, size_t size) {
+    if (w->size + size > w->capacity) {
+        while (w->size + size > w->capacity) w->capacity *= 2;
+        w->data = realloc(w->data, w->capacity);
+    }
+    if (bytes == NULL) memset(w->data + w->size, 0, size);
+    else if (size > 0) memcpy(w->data + w->size, bytes, size);
+    w->size += size;
+}
+
+// Append `size` bytes as a section starting on SERIAL_ALIGNMENT
+static SerialSection write_section(SerialWriter* w, const void* bytes, size_t size) {
+    size_t padding = (SERIAL_ALIGNMENT - w->size % SERIAL_ALIGNMENT) % SERIAL_ALIGNMENT;
+    write_bytes(w, NULL, padding);
+    SerialSection section = (SerialSection){.offset = w->size, .size = size};
+    write_bytes(w, bytes, size);
+    return section;
+}
+
+// Write the arrays of `p` to the three sections from `first`, returns `p` without them
+static Program write_program(SerialWriter* w, SerialHeader* h, const Program* p, SerialSectionKind first) {
+    h->sections[first] = write_section(w, p->instructions, p->length * sizeof(Instruction));
+    h->sections[first + 1] = write_section(w, p->classes, p->class_count * sizeof(ProgramClass));
+    h->sections[first + 2] = write_section(w, p->ranges, p->range_count * sizeof(ClassRange));
+    Program copy = *p;
+    copy.instructions = NULL;
+    copy.classes = NULL;
+    copy.ranges = NULL;
+    return copy;
+}
+
+static LiteralMatcher write_literals(SerialWriter* w, SerialHeader* h, const LiteralMatcher* m) {
+    size_t byte_count = 0;
+    for (uint32_t i = 0;i < m->count;i++) {
+        if (m->starts[i] + m->lengths[i] > byte_count) byte_count = m->starts[i] + m->lengths[i];
+    }
+    uint32_t dense_rows = 0;
+    for (uint32_t s = 0;s < m->state_count;s++) dense_rows += m->states[s].dense_row != AC_NONE;
+
+    h->sections[SerialLiteralBytes] = write_section(w, m->bytes, byte_count);
+    h->sections[SerialLiteralStarts] = write_section(w, m->starts, m->count * sizeof(uint32_t));
+    h->sections[SerialLiteralLengths] = write_section(w, m->lengths, m->count * sizeof(uint32_t));
+    h->sections[SerialAcStates] = write_section(w, m->states, m->state_count * sizeof(AcState));
+    h->sections[SerialAcDense] = write_section(w, m->dense, (size_t)dense_rows * 256 * sizeof(uint32_t));
+    LiteralMatcher copy = *m;
+    copy.bytes = NULL;
+    copy.starts = NULL;
+    copy.lengths = NULL;
+    copy.states = NULL;
+    copy.dense = NULL;
+    return copy;
+}
+
+static OnePass write_one_pass(SerialWriter* w, SerialHeader* h, const OnePass* o) {
+    OnePass copy = *o;
+    copy.program = NULL;
+    copy.actions = NULL;
+    copy.matches = NULL;
+    copy.loops = NULL;
+    copy.loop_sets = NULL;
+    if (!o->is_one_pass) return copy;
+
+    size_t actions = (size_t)o->node_count * o->stride;
+    h->sections[SerialOnePassActions] = write_section(w, o->actions, actions * sizeof(OnePassAction));
+    h->sections[SerialOnePassMatches] = write_section(w, o->matches, o->node_count * sizeof(OnePassAction));
+    h->sections[SerialOnePassLoops] = write_section(w, o->loops, o->node_count * sizeof(uint32_t));
+    h->sections[SerialOnePassLoopSets] = write_section(w, o->loop_sets, o->loop_set_count * sizeof(CharSet));
+    return copy;
+}
+
+// Write the snapshot of `c` to the four sections from `first`
+static SerialDfa write_dfa(SerialWriter* w, SerialHeader* h, const DfaCache* c, SerialSectionKind first) {
+    DfaSnapshot snapshot = dfa_cache_snapshot(c);
+    size_t transitions = (size_t)snapshot.state_count * snapshot.stride;
+    h->sections[first] = write_section(w, snapshot.states, snapshot.state_count * sizeof(DfaState));
+    h->sections[first + 1] = write_section(w, snapshot.transitions, transitions * sizeof(uint32_t));
+    h->sections[first + 2] = write_section(w, snapshot.roots, snapshot.roots_count * sizeof(uint32_t));
+    h->sections[first + 3] = write_section(w, snapshot.loops, snapshot.loop_count * sizeof(DfaLoop));
+    SerialDfa d = (SerialDfa) {
+        .stride = snapshot.stride,
+        .state_count = snapshot.state_count,
+        .roots_count = snapshot.roots_count,
+        .loop_count = snapshot.loop_count,
+    };
+    memcpy(d.start_states, snapshot.start_states, sizeof(d.start_states));
+    return d;
+}
+
+char* regex_serialize(Regex* r, bool with_dfa, size_t* size) {
+    SerialWriter w = (SerialWriter){.data = malloc(4096), .size = 0, .capacity = 4096};
+    SerialHeader h;
+    memset(&h, 0, sizeof(SerialHeader));
+    write_bytes(&w, NULL, sizeof(SerialHeader));
+
+    h.sections[SerialPattern] = write_section(&w, r->pattern, r->pattern_length);
+    write_bytes(&w, "", 1);
+    h.sections[SerialPattern].size++;
+    h.program = write_program(&w, &h, &r->program, SerialInstructions);
+    h.reverse_program = write_program(&w, &h, &r->reverse_program, SerialReverseInstructions);
+    h.prefilter = r->prefilter;
+    h.has_literals = r->literals != NULL;
+    if (h.has_literals) h.literals = write_literals(&w, &h, r->literals);
+    h.one_pass = write_one_pass(&w, &h, &r->one_pass);
+    if (with_dfa) {
+        pthread_mutex_lock(&r->dfa_lock);
+        dfa_cache_fill(&r->dfa);
+        dfa_cache_fill(&r->reverse_dfa);
+        h.dfa = write_dfa(&w, &h, &r->dfa, SerialDfaStates);
+        h.reverse_dfa = write_dfa(&w, &h, &r->reverse_dfa, SerialReverseDfaStates);
+        pthread_mutex_unlock(&r->dfa_lock);
+    }
+
+    memcpy(h.magic, SERIAL_MAGIC, sizeof(h.magic));
+    h.version = SERIAL_VERSION;
+    h.layout = layout_fingerprint();
+    h.size = w.size;
+    h.flags = r->flags;
+    h.group_count = r->ast.group_count;
+    h.backtrack_budget = r->backtrack_budget;
+    memcpy(w.data, &h, sizeof(SerialHeader));
+    h.checksum = block_checksum(w.data, w.size);
+    memcpy(w.data, &h, sizeof(SerialHeader));
+
+    *size = w.size;
+    return w.data;
+}
+
+// Reads the sections of a block whose header was checked
+struct _SerialReader {
+    const char* data;
+    const SerialHeader* header;
+    // Cleared by the first section not holding what the header says
+    bool valid;
+};
+
+typedef struct _SerialReader SerialReader;
+
+// Array of `count` elements of `size` bytes making up section `kind`
+// Clears field 'valid' of `rd` when the section has another size
+static void* read_section(SerialReader* rd, SerialSectionKind kind, size_t count, size_t size) {
+    SerialSection section = rd->header->sections[kind];
+    if (section.size != count * size) rd->valid = false;
+    // Blocks are only read, fields of the structures pointing into them are not const
+    return (void*)(rd->data + section.offset);
+}
+
+// Whether every section lies inside the block, after the header and aligned
+static bool sections_are_valid(const SerialHeader* h) {
+    for (uint32_t i = 0;i < SerialSectionCount;i++) {
+        SerialSection section = h->sections[i];
+        if (section.size == 0 && section.offset == 0) continue;
+        if (section.offset < sizeof(SerialHeader) || section.offset % SERIAL_ALIGNMENT != 0) return false;
+        if (section.offset > h->size || section.size > h->size - section.offset) return false;
+    }
+    return true;
+}
+
+// Whether the bool at `offset` in each of `count` elements of `size` bytes from `base` is
+// 0 or 1, any other byte read as a bool is undefined behavior
+static bool bools_are_valid(const void* base, size_t count, size_t size, size_t offset) {
+    const unsigned char* bytes = base;
+    for (size_t i = 0;i < count;i++) {
+        if (bytes[i * size + offset] > 1) return false;
+    }
+    return true;
+}
+
+static bool program_bools_are_valid(const Program* p) {
+    return
+        bools_are_valid(p, 1, 0, offsetof(Program, needs_backtracking)) &&
+        bools_are_valid(p, 1, 0, offsetof(Program, has_backreferences)) &&
+        bools_are_valid(p, 1, 0, offsetof(Program, all_matches)) &&
+        bools_are_valid(p, 1, 0, offsetof(Program, reverse));
+}
+
+static Program read_program(SerialReader* rd, const Program* p, SerialSectionKind first) {
+    Program copy = *p;
+    copy.instructions = read_section(rd, first, p->length, sizeof(Instruction));
+    copy.classes = read_section(rd, first + 1, p->class_count, sizeof(ProgramClass));
+    copy.ranges = read_section(rd, first + 2, p->range_count, sizeof(ClassRange));
+    return copy;
+}
+
+// Read the snapshot of a DFA written by write_dfa
+static DfaSnapshot read_dfa(SerialReader* rd, const SerialDfa* d, SerialSectionKind first) {
+    DfaSnapshot snapshot = (DfaSnapshot) {
+        .stride = d->stride,
+        .states = read_section(rd, first, d->state_count, sizeof(DfaState)),
+        .state_count = d->state_count,
+        .transitions = read_section(rd, first + 1, (size_t)d->state_count * d->stride, sizeof(uint32_t)),
+        .roots = read_section(rd, first + 2, d->roots_count, sizeof(uint32_t)),
+        .roots_count = d->roots_count,
+        .loops = read_section(rd, first + 3, d->loop_count, sizeof(DfaLoop)),
+        .loop_count = d->loop_count,
+    };
+    memcpy(snapshot.start_states, d->start_states, sizeof(snapshot.start_states));
+    return snapshot;
+}
+
+// Whether `p` is the empty reverse program of a pattern needing the backtracker,
+// every field zero like regex_compile leaves it
+static bool program_is_empty(const Program* p) {
+    for (size_t i = 0;i < 256;i++) if (p->byte_classes[i] != 0) return false;
+    return
+        p->length == 0 && p->class_count == 0 && p->range_count == 0 && p->start == 0 &&
+        p->start_unanchored == 0 && p->slot_count == 0 && p->register_count == 0 &&
+        !p->needs_backtracking && !p->has_backreferences && p->pattern_count == 0 &&
+        !p->all_matches && !p->reverse && p->byte_class_count == 0;
+}
+
+// Whether the parts of a loaded Regex agree with each other, with `group_count` and with
+// the pattern, of `pattern_length` characters
+static bool programs_are_valid(
+    const Program* program, const Program* reverse, uint32_t group_count, size_t pattern_length
+) {
+    // Every group opens with a parenthesis of the pattern
+    if (group_count > pattern_length) return false;
+    if (!program_is_valid(program) || program->all_matches || program->reverse) return false;
+    if (program->pattern_count != 1 || program->slot_count != 2 * ((size_t)group_count + 1)) return false;
+    // Only programs the backtracker runs have no reversed program
+    if (program->needs_backtracking) return program_is_empty(reverse);
+    return
+        reverse->length > 0 && program_is_valid(reverse) && reverse->reverse && !reverse->all_matches &&
+        reverse->pattern_count == 1 && reverse->slot_count == 0 && reverse->register_count == 0;
+}
+
+Regex* regex_deserialize(const void* data, size_t size) {
+    if (size < sizeof(SerialHeader) || (uintptr_t)data % SERIAL_ALIGNMENT != 0) return NULL;
+    const SerialHeader* h = data;
+    if (memcmp(h->magic, SERIAL_MAGIC, sizeof(h->magic)) != 0 || h->version != SERIAL_VERSION) return NULL;
+    if (h->layout != layout_fingerprint() || h->size != size) return NULL;
+    if (h->checksum != block_checksum(data, size) || !sections_are_valid(h)) return NULL;
+    if (!program_bools_are_valid(&h->program) || !program_bools_are_valid(&h->reverse_program)) return NULL;
+    if (!bools_are_valid(h, 1, 0, offsetof(SerialHeader, has_literals))) return NULL;
+
+    SerialReader rd = (SerialReader){.data = data, .header = h, .valid = true};
+    SerialSection pattern = h->sections[SerialPattern];
+    const char* source = read_section(&rd, SerialPattern, pattern.size, 1);
+    if (pattern.size == 0 || source[pattern.size - 1] != '\0') return NULL;
+
+    Program program = read_program(&rd, &h->program, SerialInstructions);
+    Program reverse = read_program(&rd, &h->reverse_program, SerialReverseInstructions);
+    if (!rd.valid || !programs_are_valid(&program, &reverse, h->group_count, pattern.size - 1)) return NULL;
+    if (!prefilter_is_valid(&h->prefilter)) return NULL;
+
+    LiteralMatcher literals = h->literals;
+    if (h->has_literals) {
+        if (!bools_are_valid(literals.first_bytes, 256, 1, 0)) return NULL;
+        SerialSection dense = h->sections[SerialAcDense];
+        uint32_t rows = dense.size / (256 * sizeof(uint32_t));
+        size_t byte_count = h->sections[SerialLiteralBytes].size;
+        literals.bytes = read_section(&rd, SerialLiteralBytes, byte_count, 1);
+        literals.starts = read_section(&rd, SerialLiteralStarts, literals.count, sizeof(uint32_t));
+        literals.lengths = read_section(&rd, SerialLiteralLengths, literals.count, sizeof(uint32_t));
+        literals.states = read_section(&rd, SerialAcStates, literals.state_count, sizeof(AcState));
+        literals.dense = read_section(&rd, SerialAcDense, rows, 256 * sizeof(uint32_t));
+        if (!rd.valid || !literal_matcher_is_valid(&literals, byte_count, rows)) return NULL;
+    }
+
+    OnePass one_pass = h->one_pass;
+    one_pass.program = &program;
+    if (!bools_are_valid(&one_pass, 1, 0, offsetof(OnePass, is_one_pass))) return NULL;
+    if (!bools_are_valid(&one_pass, 1, 0, offsetof(OnePass, anchored))) return NULL;
+    if (one_pass.is_one_pass) {
+        size_t actions = (size_t)one_pass.node_count * one_pass.stride;
+        one_pass.actions = read_section(&rd, SerialOnePassActions, actions, sizeof(OnePassAction));
+        one_pass.matches = read_section(&rd, SerialOnePassMatches, one_pass.node_count, sizeof(OnePassAction));
+        one_pass.loops = read_section(&rd, SerialOnePassLoops, one_pass.node_count, sizeof(uint32_t));
+        one_pass.loop_sets = read_section(&rd, SerialOnePassLoopSets, one_pass.loop_set_count, sizeof(CharSet));
+        if (!rd.valid) return NULL;
+        size_t match_wins = offsetof(OnePassAction, match_wins);
+        if (!bools_are_valid(one_pass.actions, actions, sizeof(OnePassAction), match_wins)) return NULL;
+        if (!bools_are_valid(one_pass.matches, one_pass.node_count, sizeof(OnePassAction), match_wins)) return NULL;
+        if (!one_pass_is_valid(&one_pass)) return NULL;
+    }
+
+    DfaSnapshot dfa = read_dfa(&rd, &h->dfa, SerialDfaStates);
+    DfaSnapshot reverse_dfa = read_dfa(&rd, &h->reverse_dfa, SerialReverseDfaStates);
+    if (!rd.valid) return NULL;
+
+    // Engines keep pointers to the program, so a Regex never moves
+    Regex* r = malloc(sizeof(Regex));
+    *r = (Regex) {
+        .arena = new_arena(0),
+        .pattern = source,
+        .pattern_length = pattern.size - 1,
+        .flags = h->flags,
+        .ast = (Ast){.group_count = h->group_count, .source = source, .source_length = pattern.size - 1},
+        .program = program,
+        .prefilter = h->prefilter,
+        .literals = NULL,
+        .one_pass = one_pass,
+        .backtrack_budget = h->backtrack_budget,
+        .reverse_program = reverse,
+        .mapping = NULL,
+        .mapping_size = 0,
+    };
+    r->one_pass.program = &r->program;
+    if (h->has_literals) {
+        r->literals = arena_alloc(&r->arena, sizeof(LiteralMatcher));
+        *r->literals = literals;
+    }
+    PrefilterKind kind = r->prefilter.kind;
+    bool starts = kind == PrefixPrefilter || kind == LiteralSetPrefilter || kind == ClassPrefilter;
+    r->dfa = new_dfa_cache(&r->program, starts ? &r->prefilter : NULL, 0);
+    r->reverse_dfa = new_dfa_cache(&r->reverse_program, NULL, 0);
+    pthread_mutex_init(&r->dfa_lock, NULL);
+
+    bool restored = true;
+    if (dfa.state_count > 0) restored = dfa_cache_restore(&r->dfa, &dfa);
+    if (restored && reverse_dfa.state_count > 0) restored = dfa_cache_restore(&r->reverse_dfa, &reverse_dfa);
+    if (!restored) {
+        free_regex(r);
+        return NULL;
+    }
+    return r;
+}
+
+bool regex_save_file(Regex* r, const char* path, bool with_dfa) {
+    size_t size;
+    char* data = regex_serialize(r, with_dfa, &size);
+    FILE* file = fopen(path, "wb");
+    bool written = file != NULL && fwrite(data, 1, size, file) == size;
+    if (file != NULL && fclose(file) != 0) written = false;
+    free(data);
+    return written;
+}
+
+Regex* regex_load_file(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SerialHeader)) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = info.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+
+    Regex* r = regex_deserialize(mapping, size);
+    if (r == NULL) {
+        munmap(mapping, size);
+        return NULL;
+    }
+    r->mapping = mapping;
+    r->mapping_size = size;
+    return r;
+}
@@ -0,0 +1,132 @@
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+
+#include <stdint.h>
+#include "../regex/regex.h"
+
+// Serialized regex: a compiled pattern saved as one block of bytes and loaded back without
+// scanning, parsing or compiling
+// The block is a SerialHeader followed by sections: the arrays of the programs, of the
+// literal matcher, of the one-pass DFA and optionally of the lazy DFAs, each in its
+// in-memory layout and found by its offset from the start of the block, so the block means
+// the same wherever it is loaded
+// A loaded Regex points into the block, a file mapped with mmap is used in place
+// Everything is checked before use: a block that was cut, corrupted or written by a build
+// with other structure layouts is rejected
+
+// First bytes of every block, with the terminating 0
+#define SERIAL_MAGIC "CREGEXP"
+// Incremented whenever the meaning of a field or a section changes
+#define SERIAL_VERSION 1
+// Sections start at multiples of this many bytes, a block must be loaded at such an address
+#define SERIAL_ALIGNMENT 8
+
+enum _SerialSectionKind {
+    // Pattern with a terminating 0
+    SerialPattern,
+    // Instructions, classes and ranges of the program, then of the reversed program
+    SerialInstructions,
+    SerialClasses,
+    SerialRanges,
+    SerialReverseInstructions,
+    SerialReverseClasses,
+    SerialReverseRanges,
+    // Arrays of the literal matcher, empty when there is none
+    SerialLiteralBytes,
+    SerialLiteralStarts,
+    SerialLiteralLengths,
+    SerialAcStates,
+    SerialAcDense,
+    // Arrays of the one-pass DFA, empty when the program is not one-pass
+    SerialOnePassActions,
+    SerialOnePassMatches,
+    SerialOnePassLoops,
+    SerialOnePassLoopSets,
+    // States, transitions, roots and loops of the lazy DFA, then of the reversed one,
+    // empty when they were not saved
+    SerialDfaStates,
+    SerialDfaTransitions,
+    SerialDfaRoots,
+    SerialDfaLoops,
+    SerialReverseDfaStates,
+    SerialReverseDfaTransitions,
+    SerialReverseDfaRoots,
+    SerialReverseDfaLoops,
+    SerialSectionCount,
+};
+
+typedef enum _SerialSectionKind SerialSectionKind;
+
+// Bytes [offset, offset + size) of the block
+struct _SerialSection {
+    uint64_t offset;
+    uint64_t size;
+};
+
+typedef struct _SerialSection SerialSection;
+
+// Counts of a DfaSnapshot, its arrays are sections
+struct _SerialDfa {
+    uint32_t stride;
+    uint32_t state_count;
+    uint32_t roots_count;
+    uint32_t loop_count;
+    uint32_t start_states[8];
+};
+
+typedef struct _SerialDfa SerialDfa;
+
+struct _SerialHeader {
+    char magic[8];
+    uint32_t version;
+    // Fingerprint of the sizes and byte order of the structures stored as they are in memory
+    uint32_t layout;
+    // Size of the whole block, and its checksum computed with this field 0
+    uint64_t size;
+    uint64_t checksum;
+    SerialSection sections[SerialSectionCount];
+
+    uint32_t flags;
+    uint32_t group_count;
+    uint64_t backtrack_budget;
+    // Parts of the Regex with their pointers cleared, their arrays are in the sections
+    Program program;
+    Program reverse_program;
+    Prefilter prefilter;
+    bool has_literals;
+    LiteralMatcher literals;
+    OnePass one_pass;
+    SerialDfa dfa;
+    SerialDfa reverse_dfa;
+};
+
+typedef struct _SerialHeader SerialHeader;
+
+// Growing block being written
+struct _SerialWriter {
+    char* data;
+    size_t size;
+    size_t capacity;
+};
+
+typedef struct _SerialWriter SerialWriter;
+
+// Serialize `r` into a block of `*size` bytes allocated with malloc
+// With `with_dfa` the lazy DFAs of `r` are first built in full, as far as their caches hold,
+// and saved too, so searches of the loaded Regex find every state ready
+char* regex_serialize(Regex* r, bool with_dfa, size_t* size);
+
+// Load a Regex from a block written by regex_serialize
+// `data` must be aligned on SERIAL_ALIGNMENT bytes, unchanged and allocated until the Regex is freed
+// Returns NULL when the block is not valid
+// The loaded Regex has no syntax tree, field 'group_count' is all field 'ast' holds
+Regex* regex_deserialize(const void* data, size_t size);
+
+// Write the block of `r` to file `path`, returns false when the file can not be written
+bool regex_save_file(Regex* r, const char* path, bool with_dfa);
+
+// Map file `path` in memory and load the Regex of its block, the Regex owns the mapping
+// Returns NULL when the file can not be read or is not valid
+Regex* regex_load_file(const char* path);
+
+#endif
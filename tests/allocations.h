@@ -0,0 +1,22 @@
+#ifndef ALLOCATIONS_H
+#define ALLOCATIONS_H
+
+#include "../common.h"
+
+// Heap allocations counter of the tests
+// Tests are linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc (see make test),
+// every call of the library to malloc, calloc or realloc goes through the wrappers counting it
+
+// Number of malloc, calloc and realloc calls since the start of the program
+extern size_t allocation_count;
+
+// Fail the test with `message` unless `condition` holds
+#define CHECK(condition, message) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: %s" "\n", __FILE__, __LINE__, message); \
+            exit(1); \
+        } \
+    } while (0)
+
+#endif
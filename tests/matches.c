@@ -0,0 +1,197 @@
+// Spans and capture groups of matches, the same under every flag and every way of searching
+// Each case is searched with regex_captures, regex_find, regex_find_end and regex_is_match,
+// through a Scratch, and as a stream fed whole and one character at a time
+// Patterns needing the backtracker must be refused by streams instead
+
+#include "../lib.h"
+#include "./allocations.h"
+
+// Group 0 and capture groups a case checks at most
+#define GROUPS_MAX 4
+
+// Span of a group that did not take part in the match
+#define UNSET {NO_POSITION, NO_POSITION}
+
+// Fields of a case whose pattern does not match
+#define NO_MATCH false, {UNSET}
+
+struct _MatchCase {
+    const char* pattern;
+    const char* input;
+    bool matches;
+    // Whole match then each capture group of the pattern, when it matches
+    Match groups[GROUPS_MAX];
+};
+
+typedef struct _MatchCase MatchCase;
+
+static const MatchCase CASES[] = {
+    // Escapes
+    {"\\d+\\.\\d+", "v1.25x", true, {{1, 5}}},
+    {"\\.a?", "x.a", true, {{1, 3}}},
+    {"\\.a?", "xyz", NO_MATCH},
+    {"([ab]).\\.\\dc", "zax.1c", true, {{1, 6}, {1, 2}}},
+    {"([ab]).\\.\\dc", "zax", NO_MATCH},
+    {"(\\s|\\.\\d|c)+?", "z.1c", true, {{1, 3}, {1, 3}}},
+    {"\\(a\\)", "f(a)", true, {{1, 4}}},
+    {"\\\\", "a\\b", true, {{1, 2}}},
+    {"a\\*", "aa*", true, {{1, 3}}},
+    {"[\\]a]+", "x]a]", true, {{1, 4}}},
+    {"\\D\\S\\W", "1a b-", true, {{2, 5}}},
+    {"\\w+@\\w+\\.com", "mail bob@example.com now", true, {{5, 20}}},
+    {"ERROR|WARN", "level=WARN", true, {{6, 10}}},
+
+    // Anchors
+    {"\\Aab", "abab", true, {{0, 2}}},
+    {"\\Aab", "cab", NO_MATCH},
+    {"ab\\Z", "abab", true, {{2, 4}}},
+    {"\\A\\Z", "", true, {{0, 0}}},
+    {"\\A\\Z", "a", NO_MATCH},
+    {"\\A(\\w+)@(\\w+)\\.com\\Z", "bob@example.com", true, {{0, 15}, {0, 3}, {4, 11}}},
+    {"\\A(\\w+)@(\\w+)\\.com\\Z", "bob@example.com ", NO_MATCH},
+
+    // Word boundaries
+    {"\\bcat\\b", "concat cat", true, {{7, 10}}},
+    {"\\bcat\\b", "concatenate", NO_MATCH},
+    {"\\Bcat\\B", "cat scatter", true, {{5, 8}}},
+    {"\\b", "  a", true, {{2, 2}}},
+    {"[a-z]+ing\\b", "singing kings", true, {{0, 7}}},
+
+    // Lazy quantifiers
+    {"a+?", "aaa", true, {{0, 1}}},
+    {"a*?b", "aab", true, {{0, 3}}},
+    {"(a+?)(a*)", "aaa", true, {{0, 3}, {0, 1}, {1, 3}}},
+    {"<.+?>", "<a><b>", true, {{0, 3}}},
+    {"(a|b)??c", "bc", true, {{0, 2}, {0, 1}}},
+    {"x{2,}?", "xxxx", true, {{0, 2}}},
+
+    // Possessive quantifiers
+    {"a++b", "aaab", true, {{0, 4}}},
+    {"a*+a", "aaa", NO_MATCH},
+    {"x?+x", "x", NO_MATCH},
+    {"x?+x", "xx", true, {{0, 2}}},
+    {"\"[^\"]*+\"", "say \"hi\" now", true, {{4, 8}}},
+    {"(a+)++b", "aaab", true, {{0, 4}, {0, 3}}},
+
+    // Backreferences
+    {"(\\w+) \\1", "hello hello world", true, {{0, 11}, {0, 5}}},
+    {"(a|b)\\1", "abba", true, {{1, 3}, {1, 2}}},
+    {"(a)(b)\\2\\1", "xabba", true, {{1, 5}, {1, 2}, {2, 3}}},
+    {"(a)\\g<1>", "baa", true, {{1, 3}, {1, 2}}},
+    {"(a*)b\\1", "aabaa", true, {{0, 5}, {0, 2}}},
+    {"(x)?y\\1", "y", NO_MATCH},
+
+    // Groups not taking part in the match
+    {"(a)|b", "b", true, {{0, 1}, UNSET}},
+    {"(a)|(b)", "b", true, {{0, 1}, UNSET, {0, 1}}},
+};
+
+#define CASES_COUNT (sizeof(CASES) / sizeof(CASES[0]))
+
+static const uint32_t FLAGS[] = {0, RegexNoOnePass, RegexNoOptimize, RegexNoPrefilter, RegexNoLiteralMatcher};
+
+static const char* FLAG_NAMES[] = {
+    "no flag", "RegexNoOnePass", "RegexNoOptimize", "RegexNoPrefilter", "RegexNoLiteralMatcher"
+};
+
+#define FLAGS_COUNT (sizeof(FLAGS) / sizeof(FLAGS[0]))
+
+// Fail the test unless `condition` holds, telling which case and search failed
+static void check_case(bool condition, const MatchCase* c, size_t flag, const char* search) {
+    if (condition) return;
+    fprintf(stderr, "pattern `%s` on `%s` with %s: %s is wrong" "\n", c->pattern, c->input, FLAG_NAMES[flag], search);
+    exit(1);
+}
+
+static bool same_match(Match a, Match b) {
+    return a.start == b.start && a.end == b.end;
+}
+
+// Whether the groups found are those of the case, `groups_count` of them
+static bool same_groups(const MatchCase* c, RegexResult result, const Match* groups, size_t groups_count) {
+    if (result != (c->matches ? RegexMatch : RegexNoMatch)) return false;
+    for (size_t i = 0;c->matches && i < groups_count;i++) {
+        if (!same_match(groups[i], c->groups[i])) return false;
+    }
+    return true;
+}
+
+// Feed the input of the case to a stream `chunk` characters at a time, the whole input at once when 0
+static bool stream_matches(Regex* r, const MatchCase* c, size_t chunk, size_t* end) {
+    RegexStream s;
+    new_regex_stream(r, false, &s, NULL);
+    size_t length = strlen(c->input);
+    if (chunk == 0) chunk = length;
+    for (size_t i = 0;i < length;i += chunk) {
+        size_t n = length - i < chunk ? length - i : chunk;
+        if (regex_stream_feed(&s, c->input + i, n)) break;
+    }
+    bool found = regex_stream_finish(&s, end);
+    free_regex_stream(&s);
+    return found;
+}
+
+// Returns whether the pattern could be streamed
+static bool check_stream(Regex* r, const MatchCase* c, size_t flag) {
+    RegexStream s;
+    PatternError error = NO_PATTERN_ERROR;
+    if (!new_regex_stream(r, false, &s, &error)) {
+        check_case(error.code == BacktrackingInStreamError, c, flag, "refusing the stream");
+        return false;
+    }
+    free_regex_stream(&s);
+    for (size_t chunk = 0;chunk <= 1;chunk++) {
+        size_t end = NO_POSITION;
+        bool found = stream_matches(r, c, chunk, &end);
+        check_case(found == c->matches, c, flag, chunk == 0 ? "stream" : "stream by character");
+        if (found) check_case(end == c->groups[0].end, c, flag, "end of the stream match");
+    }
+    return true;
+}
+
+// Returns whether the pattern could be streamed
+static bool check(const MatchCase* c, size_t flag) {
+    PatternError error;
+    Regex* r = regex_compile(c->pattern, strlen(c->pattern), FLAGS[flag], &error);
+    check_case(r != NULL, c, flag, "compiling");
+    size_t groups_count = regex_group_count(r) + 1;
+    check_case(groups_count <= GROUPS_MAX, c, flag, "group count");
+
+    size_t length = strlen(c->input);
+    RegexResult expected = c->matches ? RegexMatch : RegexNoMatch;
+    Match groups[GROUPS_MAX];
+    size_t end;
+
+    RegexResult result = regex_captures(r, c->input, length, groups, groups_count);
+    check_case(same_groups(c, result, groups, groups_count), c, flag, "regex_captures");
+    result = regex_find(r, c->input, length, groups);
+    check_case(same_groups(c, result, groups, 1), c, flag, "regex_find");
+    result = regex_find_end(r, c->input, length, &end);
+    check_case(result == expected && (!c->matches || end == c->groups[0].end), c, flag, "regex_find_end");
+    check_case(regex_is_match(r, c->input, length) == expected, c, flag, "regex_is_match");
+
+    Scratch s = new_scratch(r);
+    result = scratch_captures(&s, c->input, length, groups, groups_count);
+    check_case(same_groups(c, result, groups, groups_count), c, flag, "scratch_captures");
+    result = scratch_find_end(&s, c->input, length, &end);
+    check_case(result == expected && (!c->matches || end == c->groups[0].end), c, flag, "scratch_find_end");
+    check_case(scratch_is_match(&s, c->input, length) == expected, c, flag, "scratch_is_match");
+    free_scratch(&s);
+
+    bool streamed = check_stream(r, c, flag);
+    free_regex(r);
+    return streamed;
+}
+
+int main(void) {
+    size_t streamed = 0;
+    for (size_t i = 0;i < CASES_COUNT;i++) {
+        for (size_t flag = 0;flag < FLAGS_COUNT;flag++) streamed += check(&CASES[i], flag);
+    }
+    CHECK(streamed > 0 && streamed < CASES_COUNT * FLAGS_COUNT, "only patterns without backtracking should stream");
+    printf(
+        "matches: %zu cases under %zu flags found the same spans and groups, %zu streamed" "\n",
+        CASES_COUNT, FLAGS_COUNT, streamed
+    );
+    return 0;
+}
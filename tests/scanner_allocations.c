@@ -0,0 +1,45 @@
+// Scanning a pattern performs no heap allocation: tokens are views into the source
+// and decode_token writes into a buffer of the caller
+// Only new_scanner allocates, copying the source into the arena
+
+#include "../lib.h"
+#include "./allocations.h"
+
+// Patterns using every token type
+static const char* PATTERNS[] = {
+    "abc\\.def|ghi",
+    "\\A\\bword\\B\\Z",
+    "\\d\\D\\s\\S\\w\\W",
+    "[a-z0-9_\\]]+[^A-Z]*?",
+    "(a|b)??c+?d*?e?+f++g*+",
+    "x{2}y{2,}z{,3}w{1,4}+",
+    "(a)(b)\\2\\g<1>",
+    "(|a||b|)()",
+    "h.t",
+};
+
+#define PATTERNS_COUNT (sizeof(PATTERNS) / sizeof(PATTERNS[0]))
+
+int main(void) {
+    size_t tokens = 0;
+    for (size_t i = 0;i < PATTERNS_COUNT;i++) {
+        Arena arena = new_arena(0);
+        Scanner s = new_scanner(&arena, PATTERNS[i], strlen(PATTERNS[i]));
+
+        size_t before = allocation_count;
+        while (true) {
+            Token t = get_next_token(&s);
+            char buffer[64];
+            decode_token(&s, t, buffer, sizeof(buffer));
+            tokens++;
+            if (t.type == EndMarker) break;
+        }
+        CHECK(s.error.code == NoError, "pattern should scan without error");
+        CHECK(allocation_count == before, "scanning should not allocate");
+        free_arena(&arena);
+    }
+    // The arena of each scanner allocated its chunk, the wrappers did count
+    CHECK(allocation_count >= PATTERNS_COUNT, "allocations should be counted, build with make test");
+    printf("scanner_allocations: %zu tokens of %zu patterns scanned without allocating" "\n", tokens, PATTERNS_COUNT);
+    return 0;
+}
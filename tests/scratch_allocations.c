@@ -0,0 +1,74 @@
+// Searches through a Scratch perform no heap allocation once it is warm
+// The scratch is sized from the program when made, only the backtracker grows it to
+// an input longer than any before, so the first round of searches warms it up
+
+#include "../lib.h"
+#include "./allocations.h"
+
+// Patterns running on every engine: prefilter, literal matcher, DFA, one-pass, Pike VM and backtracker
+static const char* PATTERNS[] = {
+    "\\d+\\.\\d+",
+    "ERROR|WARN|INFO",
+    "user=(\\w+)",
+    "\\A(\\w+)@(\\w+)\\.com\\Z",
+    "(a|b)*c(d+)",
+    "[a-z]+ing\\b",
+    "(\\w+) \\1",
+    "(a+)++b",
+};
+
+#define PATTERNS_COUNT (sizeof(PATTERNS) / sizeof(PATTERNS[0]))
+
+static const char* INPUTS[] = {
+    "version 1.25 released",
+    "2024-01-01 WARN disk almost full",
+    "login user=alice from 10.0.0.1",
+    "bob@example.com",
+    "ababbacddd",
+    "nothing is matching here, or running",
+    "hello hello world",
+    "aaaaaaaaaaaaaaaaaaaab",
+    "",
+};
+
+#define INPUTS_COUNT (sizeof(INPUTS) / sizeof(INPUTS[0]))
+
+// Searches of each kind per pattern and input after the warm-up
+#define SEARCH_ROUNDS 10
+
+static size_t search(Scratch* s, const char* input) {
+    size_t length = strlen(input);
+    size_t end;
+    Match groups[4];
+    size_t found = scratch_is_match(s, input, length) == RegexMatch;
+    found += scratch_find_end(s, input, length, &end) == RegexMatch;
+    found += scratch_captures(s, input, length, groups, 4) == RegexMatch;
+    return found;
+}
+
+int main(void) {
+    size_t searches = 0;
+    for (size_t i = 0;i < PATTERNS_COUNT;i++) {
+        Regex* r = new_regex(PATTERNS[i], strlen(PATTERNS[i]), 0);
+        Scratch s = new_scratch(r);
+        size_t expected = 0;
+        for (size_t k = 0;k < INPUTS_COUNT;k++) expected += search(&s, INPUTS[k]);
+        CHECK(expected > 0, "every pattern should match one of the inputs");
+
+        size_t before = allocation_count;
+        for (size_t round = 0;round < SEARCH_ROUNDS;round++) {
+            size_t found = 0;
+            for (size_t k = 0;k < INPUTS_COUNT;k++) found += search(&s, INPUTS[k]);
+            CHECK(found == expected, "searches should find the same matches every round");
+            searches += 3 * INPUTS_COUNT;
+        }
+        CHECK(allocation_count == before, "warm searches should not allocate");
+
+        free_scratch(&s);
+        free_regex(r);
+    }
+    // Compiling allocated, the wrappers did count
+    CHECK(allocation_count >= PATTERNS_COUNT, "allocations should be counted, build with make test");
+    printf("scratch_allocations: %zu searches of %zu patterns without allocating" "\n", searches, PATTERNS_COUNT);
+    return 0;
+}
@@ -0,0 +1,515 @@
+// Measure compile times, search throughput of each engine and match latency
+//
+//     bench [-c] [-s MB] [-r REPEATS] [-S SEED] > RESULTS.json
+//
+// With -c only compile times are measured, the scanner micro-benchmarks among them:
+// a whole scan, and a keystroke in the middle of the pattern rescanned by an IncrementalScanner
+//
+// Corpora are generated from SEED, so runs of different versions search the same text:
+// synthetic log lines, random printable ASCII and runs of 'a' for pathological patterns
+// Every search is over one line of a corpus, the count of matching lines is printed with
+// each result to check engines agree
+// Results are printed as one JSON object, times are the best of REPEATS runs
+
+#include <inttypes.h>
+#include <time.h>
+#include "../lib.h"
+
+// Revision of the library measured, set by make bench
+#ifndef BENCH_REVISION
+#define BENCH_REVISION "unknown"
+#endif
+
+// Least time a compile measurement runs, compiles are repeated until it is reached
+#define BENCH_COMPILE_NS 50000000ull
+
+// Lines of the latency measurement of a pattern
+#define BENCH_LATENCY_SAMPLES 100000
+
+// Hostnames of the alternation measuring compile time of large patterns
+#define BENCH_HOSTNAMES 2000
+
+// Length of the plain text pattern measuring compile time of long literals
+#define BENCH_TEXT_LENGTH (64 << 10)
+
+// Engines a search can run on
+enum _Engine {
+    // regex_is_match, with its prefilter, literal matcher and engine choice
+    EngineRegex,
+    // regex_is_match compiled with RegexNoPrefilter and RegexNoLiteralMatcher,
+    // against EngineRegex it tells what the prefilter saves
+    EngineRegexNoPrefilter,
+    // Lazy DFA alone, without prefilter
+    EngineDfa,
+    EnginePikeVm,
+    EngineBacktrack,
+    ENGINE_COUNT,
+};
+
+typedef enum _Engine Engine;
+
+static const char* ENGINE_NAMES[ENGINE_COUNT] = {"regex", "regex_no_prefilter", "dfa", "pikevm", "backtrack"};
+
+enum _CorpusKind {
+    // Lines of web server logs with addresses, times, requests and statuses
+    LogCorpus,
+    // Lines of random printable characters
+    AsciiCorpus,
+    // Long lines of 'a'
+    PathologicalCorpus,
+    CORPUS_COUNT,
+};
+
+typedef enum _CorpusKind CorpusKind;
+
+static const char* CORPUS_NAMES[CORPUS_COUNT] = {"log", "ascii", "pathological"};
+
+// Text cut into lines, data[starts[i], ends[i]) is line i
+struct _Corpus {
+    char* data;
+    size_t length;
+    size_t* starts;
+    size_t* ends;
+    size_t lines_count;
+};
+
+typedef struct _Corpus Corpus;
+
+struct _BenchPattern {
+    CorpusKind corpus;
+    const char* pattern;
+};
+
+typedef struct _BenchPattern BenchPattern;
+
+static const BenchPattern PATTERNS[] = {
+    {LogCorpus, "\\d+\\.\\d+\\.\\d+\\.\\d+"},
+    {LogCorpus, "ERROR|WARN"},
+    {LogCorpus, "user=(\\w+)"},
+    {LogCorpus, "\\bGET\\b.*HTTP/1\\.[01]\" 5\\d\\d"},
+    {AsciiCorpus, "[a-z]+ing"},
+    {AsciiCorpus, "Sherlock Holmes"},
+    {AsciiCorpus, "\\w+@\\w+\\.com"},
+    {PathologicalCorpus, "(a|a)*b"},
+    {PathologicalCorpus, "(a*)*b"},
+    {PathologicalCorpus, "(a+)+b"},
+};
+
+#define PATTERNS_COUNT (sizeof(PATTERNS) / sizeof(PATTERNS[0]))
+
+struct _Options {
+    // Measure compile times only
+    bool compile_only;
+    // Size of each corpus
+    size_t size;
+    size_t repeats;
+    uint64_t seed;
+};
+
+typedef struct _Options Options;
+
+static void usage(void) {
+    fprintf(stderr, "Usage: bench [-c] [-s MB] [-r REPEATS] [-S SEED]\n");
+    exit(2);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+// xorshift64, the same sequence on every machine
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static size_t random_below(uint64_t* state, size_t bound) {
+    return next_random(state) % bound;
+}
+
+static void append(Corpus* c, const char* text, size_t length) {
+    memcpy(c->data + c->length, text, length);
+    c->length += length;
+}
+
+static void append_log_line(Corpus* c, uint64_t* state) {
+    static const char* LEVELS[] = {"INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR"};
+    static const char* METHODS[] = {"GET", "GET", "POST", "PUT", "DELETE"};
+    static const char* PATHS[] = {"/", "/index.html", "/api/v1/users", "/api/v1/orders", "/static/app.js", "/login"};
+    static const int STATUSES[] = {200, 200, 200, 201, 304, 404, 500, 503};
+    char line[256];
+    int length = snprintf(
+        line, sizeof(line), "%zu.%zu.%zu.%zu - [2024-03-%02zu %02zu:%02zu:%02zu] %s user=u%zu \"%s %s HTTP/1.%zu\" %d %zu\n",
+        random_below(state, 256), random_below(state, 256), random_below(state, 256), random_below(state, 256),
+        1 + random_below(state, 28), random_below(state, 24), random_below(state, 60), random_below(state, 60),
+        LEVELS[random_below(state, 6)], random_below(state, 100000),
+        METHODS[random_below(state, 5)], PATHS[random_below(state, 6)], random_below(state, 2),
+        STATUSES[random_below(state, 8)], random_below(state, 100000)
+    );
+    append(c, line, length);
+}
+
+// Printable characters, spaces and lowercase letters more often so there are words
+static void append_ascii_line(Corpus* c, uint64_t* state) {
+    size_t length = 64 + random_below(state, 4096);
+    for (size_t i = 0;i < length;i++) {
+        size_t kind = random_below(state, 8);
+        if (kind == 0) c->data[c->length++] = ' ';
+        else if (kind < 5) c->data[c->length++] = 'a' + random_below(state, 26);
+        else c->data[c->length++] = 0x21 + random_below(state, 0x7E - 0x21);
+    }
+    c->data[c->length++] = '\n';
+}
+
+static void append_pathological_line(Corpus* c, uint64_t* state) {
+    (void)state;
+    size_t length = 1 << 16;
+    memset(c->data + c->length, 'a', length);
+    c->length += length;
+    c->data[c->length++] = '\n';
+}
+
+static Corpus new_corpus(CorpusKind kind, size_t size, uint64_t seed) {
+    // Longest line a generator appends
+    size_t margin = (1 << 16) + 1;
+    Corpus c = (Corpus){.data = malloc(size + margin), .length = 0};
+    uint64_t state = seed + kind;
+    while (c.length < size) {
+        if (kind == LogCorpus) append_log_line(&c, &state);
+        else if (kind == AsciiCorpus) append_ascii_line(&c, &state);
+        else append_pathological_line(&c, &state);
+    }
+
+    size_t capacity = 0;
+    for (size_t i = 0;i < c.length;i++) capacity += c.data[i] == '\n';
+    c.starts = malloc(capacity * sizeof(size_t));
+    c.ends = malloc(capacity * sizeof(size_t));
+    c.lines_count = 0;
+    size_t start = 0;
+    for (size_t i = 0;i < c.length;i++) {
+        if (c.data[i] != '\n') continue;
+        c.starts[c.lines_count] = start;
+        c.ends[c.lines_count++] = i;
+        start = i + 1;
+    }
+    return c;
+}
+
+static void free_corpus(Corpus* c) {
+    free(c->data);
+    free(c->starts);
+    free(c->ends);
+}
+
+// Alternation of BENCH_HOSTNAMES escaped hostnames, like the allow lists patterns are made of
+static char* hostnames_pattern(uint64_t seed) {
+    static const char* DOMAINS[] = {"example\\.com", "example\\.org", "internal\\.net", "cdn\\.io"};
+    uint64_t state = seed;
+    size_t capacity = BENCH_HOSTNAMES * 48;
+    char* pattern = malloc(capacity);
+    size_t length = 0;
+    for (size_t i = 0;i < BENCH_HOSTNAMES;i++) {
+        length += snprintf(
+            pattern + length, capacity - length, "%shost%zu-%zu\\.%s", i == 0 ? "" : "|",
+            i, random_below(&state, 1000), DOMAINS[random_below(&state, 4)]
+        );
+    }
+    return pattern;
+}
+
+// BENCH_TEXT_LENGTH characters of lowercase words, one long literal without metacharacters
+static char* text_pattern(uint64_t seed) {
+    uint64_t state = seed;
+    char* pattern = malloc(BENCH_TEXT_LENGTH + 1);
+    for (size_t i = 0;i < BENCH_TEXT_LENGTH;i++) {
+        pattern[i] = random_below(&state, 6) == 0 ? ' ' : 'a' + random_below(&state, 26);
+    }
+    pattern[BENCH_TEXT_LENGTH] = '\0';
+    return pattern;
+}
+
+static void print_json_string(const char* s, size_t length) {
+    putchar('"');
+    for (size_t i = 0;i < length;i++) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') printf("\\%c", c);
+        else if (c < 0x20) printf("\\u%04x", c);
+        else putchar(c);
+    }
+    putchar('"');
+}
+
+// Scan `pattern` to its end marker, the tokens are dropped
+static void scan(const char* pattern, size_t length) {
+    Arena arena = new_arena(0);
+    Scanner s = new_scanner(&arena, pattern, length);
+    while (get_next_token(&s).type != EndMarker) {}
+    free_arena(&arena);
+}
+
+// Refuse to measure `pattern` unless it compiles and its tokens follow one another without a gap
+// from its first character to its end, so the program searched is the whole pattern and not
+// a part a scanner or parser bug stopped at
+static void check_whole_pattern(const char* pattern, size_t length) {
+    PatternError error;
+    Regex* r = regex_compile(pattern, length, 0, &error);
+    if (r == NULL) {
+        print_pattern_error(stderr, &error, pattern, length);
+        exit(2);
+    }
+    free_regex(r);
+
+    Arena arena = new_arena(0);
+    Scanner s = new_scanner(&arena, pattern, length);
+    size_t end = 0;
+    Token t = get_next_token(&s);
+    while (t.type != EndMarker && t.position == end) {
+        end = t.position + t.length;
+        t = get_next_token(&s);
+    }
+    bool whole = t.type == EndMarker && t.position == length && end == length && s.error.code == NoError;
+    free_arena(&arena);
+    if (!whole) {
+        fprintf(stderr, "Pattern %.*s is only compiled up to position %zu of %zu\n", (int)length, pattern, end, length);
+        exit(2);
+    }
+}
+
+// Time of one compile, scanner alone when `scanner_only`, otherwise new_regex
+static double compile_ns(const char* pattern, size_t length, bool scanner_only, size_t repeats) {
+    double best = 0;
+    for (size_t k = 0;k < repeats;k++) {
+        uint64_t start = now_ns();
+        uint64_t elapsed = 0;
+        size_t count = 0;
+        while (elapsed < BENCH_COMPILE_NS) {
+            if (scanner_only) scan(pattern, length);
+            else free_regex(new_regex(pattern, length, 0));
+            count++;
+            elapsed = now_ns() - start;
+        }
+        double time = (double)elapsed / count;
+        if (k == 0 || time < best) best = time;
+    }
+    return best;
+}
+
+// Time of one keystroke in the middle of `pattern` kept scanned by an IncrementalScanner,
+// a character typed and deleted again counts as two
+static double keystroke_ns(const char* pattern, size_t length, size_t repeats) {
+    IncrementalScanner s = new_incremental_scanner(pattern, length);
+    double best = 0;
+    for (size_t k = 0;k < repeats;k++) {
+        uint64_t start = now_ns();
+        uint64_t elapsed = 0;
+        size_t count = 0;
+        while (elapsed < BENCH_COMPILE_NS) {
+            incremental_scanner_edit(&s, length / 2, 0, "x", 1);
+            incremental_scanner_edit(&s, length / 2, 1, "", 0);
+            count += 2;
+            elapsed = now_ns() - start;
+        }
+        double time = (double)elapsed / count;
+        if (k == 0 || time < best) best = time;
+    }
+    free_incremental_scanner(&s);
+    return best;
+}
+
+static void print_compile(const char* pattern, size_t length, const Options* o, bool* first) {
+    double scanner = compile_ns(pattern, length, true, o->repeats);
+    double pipeline = compile_ns(pattern, length, false, o->repeats);
+    double keystroke = keystroke_ns(pattern, length, o->repeats);
+    printf("%s\n    {\"pattern\": ", *first ? "" : ",");
+    *first = false;
+    // Very long patterns are shown by their start
+    print_json_string(pattern, length < 80 ? length : 80);
+    printf(
+        ", \"pattern_length\": %zu, \"scanner_ns\": %.0f, \"pipeline_ns\": %.0f, \"scanner_mb_s\": %.1f"
+        ", \"keystroke_ns\": %.0f}",
+        length, scanner, pipeline, length / scanner * 1e9 / (1 << 20), keystroke
+    );
+}
+
+// Search state of one engine
+struct _Searcher {
+    Engine engine;
+    Regex* regex;
+    DfaCache dfa;
+    PikeScratch pike;
+    BacktrackScratch backtrack;
+    // Searches the engine gave up on, only the DFA and the backtracker give up
+    size_t gave_up;
+};
+
+typedef struct _Searcher Searcher;
+
+static bool engine_runs(Engine e, const Regex* r) {
+    bool any_program = e == EngineRegex || e == EngineRegexNoPrefilter || e == EngineBacktrack;
+    return any_program || !r->program.needs_backtracking;
+}
+
+static Searcher new_searcher(Engine e, Regex* r) {
+    Searcher s = (Searcher){.engine = e, .regex = r, .gave_up = 0};
+    if (e == EngineRegexNoPrefilter) {
+        s.regex = new_regex(r->pattern, r->pattern_length, RegexNoPrefilter | RegexNoLiteralMatcher);
+    }
+    if (e == EngineDfa) s.dfa = new_dfa_cache(&r->program, NULL, 0);
+    if (e == EnginePikeVm) s.pike = new_pike_scratch(&r->program);
+    if (e == EngineBacktrack) s.backtrack = new_backtrack_scratch(&r->program);
+    return s;
+}
+
+static void free_searcher(Searcher* s) {
+    if (s->engine == EngineRegexNoPrefilter) free_regex(s->regex);
+    if (s->engine == EngineDfa) free_dfa_cache(&s->dfa);
+    if (s->engine == EnginePikeVm) free_pike_scratch(&s->pike);
+    if (s->engine == EngineBacktrack) free_backtrack_scratch(&s->backtrack);
+}
+
+static bool search(Searcher* s, const char* input, size_t length) {
+    size_t end;
+    switch (s->engine) {
+        case EngineRegex:
+        case EngineRegexNoPrefilter: {
+            RegexResult result = regex_is_match(s->regex, input, length);
+            s->gave_up += result == RegexGaveUp;
+            return result == RegexMatch;
+        }
+        case EngineDfa: {
+            DfaResult result = dfa_search(&s->dfa, input, length, 0, false, true, &end);
+            s->gave_up += result == DfaGaveUp;
+            return result == DfaMatch;
+        }
+        case EnginePikeVm:
+            return pikevm_search(&s->pike, input, length, 0, false, NULL, s->pike.slots);
+        case EngineBacktrack: {
+            BacktrackResult result = backtrack_search(
+                &s->backtrack, input, length, 0, false, NULL, 0, s->backtrack.match_slots
+            );
+            s->gave_up += result == BacktrackGaveUp;
+            return result == BacktrackMatch;
+        }
+        default:
+            return false;
+    }
+}
+
+static void print_throughput(const BenchPattern* b, Regex* r, const Corpus* c, const Options* o, bool* first) {
+    for (Engine e = 0;e < ENGINE_COUNT;e++) {
+        if (!engine_runs(e, r)) continue;
+        Searcher s = new_searcher(e, r);
+        uint64_t best = 0;
+        size_t matched = 0;
+        for (size_t k = 0;k < o->repeats;k++) {
+            matched = 0;
+            s.gave_up = 0;
+            uint64_t start = now_ns();
+            for (size_t i = 0;i < c->lines_count;i++) {
+                matched += search(&s, c->data + c->starts[i], c->ends[i] - c->starts[i]);
+            }
+            uint64_t elapsed = now_ns() - start;
+            if (k == 0 || elapsed < best) best = elapsed;
+        }
+        printf("%s\n    {\"corpus\": \"%s\", \"pattern\": ", *first ? "" : ",", CORPUS_NAMES[b->corpus]);
+        *first = false;
+        print_json_string(b->pattern, strlen(b->pattern));
+        printf(
+            ", \"engine\": \"%s\", \"mb_s\": %.1f, \"matched_lines\": %zu, \"gave_up\": %zu}",
+            ENGINE_NAMES[e], (double)c->length / best * 1e9 / (1 << 20), matched, s.gave_up
+        );
+        free_searcher(&s);
+    }
+}
+
+static int compare_times(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Time of regex_is_match on each line, the first BENCH_LATENCY_SAMPLES lines
+// Each time includes reading the clock, some tens of nanoseconds
+static void print_latency(const BenchPattern* b, Regex* r, const Corpus* c, bool* first) {
+    size_t count = c->lines_count < BENCH_LATENCY_SAMPLES ? c->lines_count : BENCH_LATENCY_SAMPLES;
+    uint64_t* times = malloc(count * sizeof(uint64_t));
+    for (size_t i = 0;i < count;i++) {
+        uint64_t start = now_ns();
+        regex_is_match(r, c->data + c->starts[i], c->ends[i] - c->starts[i]);
+        times[i] = now_ns() - start;
+    }
+    qsort(times, count, sizeof(uint64_t), compare_times);
+
+    printf("%s\n    {\"corpus\": \"%s\", \"pattern\": ", *first ? "" : ",", CORPUS_NAMES[b->corpus]);
+    *first = false;
+    print_json_string(b->pattern, strlen(b->pattern));
+    printf(
+        ", \"samples\": %zu, \"p50_ns\": %" PRIu64 ", \"p90_ns\": %" PRIu64 ", \"p99_ns\": %" PRIu64
+        ", \"p999_ns\": %" PRIu64 ", \"max_ns\": %" PRIu64 "}",
+        count, times[count / 2], times[count * 9 / 10], times[count * 99 / 100], times[count * 999 / 1000],
+        times[count - 1]
+    );
+    free(times);
+}
+
+int main(int argc, char** argv) {
+    Options o = (Options){.compile_only = false, .size = 4 << 20, .repeats = 3, .seed = 0x9E3779B97F4A7C15ull};
+    for (int i = 1;i < argc;i++) {
+        if (strcmp(argv[i], "-c") == 0) o.compile_only = true;
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) o.size = strtoull(argv[++i], NULL, 10) << 20;
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) o.repeats = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) o.seed = strtoull(argv[++i], NULL, 0);
+        else usage();
+    }
+    if (o.size == 0 || o.repeats == 0 || o.seed == 0) usage();
+    for (size_t i = 0;i < PATTERNS_COUNT;i++) check_whole_pattern(PATTERNS[i].pattern, strlen(PATTERNS[i].pattern));
+
+    printf("{\n  \"revision\": \"%s\",\n", BENCH_REVISION);
+    printf("  \"corpus_size\": %zu,\n  \"repeats\": %zu,\n  \"seed\": %" PRIu64 ",\n", o.size, o.repeats, o.seed);
+
+    printf("  \"compile\": [");
+    bool first = true;
+    for (size_t i = 0;i < PATTERNS_COUNT;i++) {
+        print_compile(PATTERNS[i].pattern, strlen(PATTERNS[i].pattern), &o, &first);
+    }
+    char* hostnames = hostnames_pattern(o.seed);
+    check_whole_pattern(hostnames, strlen(hostnames));
+    print_compile(hostnames, strlen(hostnames), &o, &first);
+    free(hostnames);
+    char* text = text_pattern(o.seed);
+    check_whole_pattern(text, strlen(text));
+    print_compile(text, strlen(text), &o, &first);
+    free(text);
+    if (o.compile_only) {
+        printf("\n  ]\n}\n");
+        return 0;
+    }
+    printf("\n  ],\n");
+
+    Corpus corpora[CORPUS_COUNT];
+    for (CorpusKind k = 0;k < CORPUS_COUNT;k++) corpora[k] = new_corpus(k, o.size, o.seed);
+    Regex* regexes[PATTERNS_COUNT];
+    for (size_t i = 0;i < PATTERNS_COUNT;i++) regexes[i] = new_regex(PATTERNS[i].pattern, strlen(PATTERNS[i].pattern), 0);
+
+    printf("  \"throughput\": [");
+    first = true;
+    for (size_t i = 0;i < PATTERNS_COUNT;i++) {
+        print_throughput(&PATTERNS[i], regexes[i], &corpora[PATTERNS[i].corpus], &o, &first);
+    }
+    printf("\n  ],\n");
+
+    printf("  \"latency\": [");
+    first = true;
+    for (size_t i = 0;i < PATTERNS_COUNT;i++) {
+        print_latency(&PATTERNS[i], regexes[i], &corpora[PATTERNS[i].corpus], &first);
+    }
+    printf("\n  ]\n}\n");
+
+    for (size_t i = 0;i < PATTERNS_COUNT;i++) free_regex(regexes[i]);
+    for (CorpusKind k = 0;k < CORPUS_COUNT;k++) free_corpus(&corpora[k]);
+    return 0;
+}
@@ -0,0 +1,176 @@
+// Compile a pattern ahead of time into a C function running its DFA as code
+//
+//     codegen [-n NAME] PATTERN > FILE.c
+//
+// Prints a standalone C file defining bool NAME(const char* input, size_t length), which
+// returns whether the pattern matches anywhere in the input like regex_is_match
+// The DFA is built in full, each state becomes a label and its transitions comparisons of
+// the character against byte ranges with a goto each, so there is no table to look up
+// and every branch has its own prediction
+
+#include "../lib.h"
+
+// Memory the DFA is determinized in, patterns with more states are refused
+#define CODEGEN_CACHE_SIZE (256 << 20)
+
+// Ranges of a state tested one after the other, more are split in two halves
+#define CODEGEN_LINEAR_RANGES 4
+
+// Targets of a range that are not states
+#define CODEGEN_MATCH UINT32_MAX
+#define CODEGEN_FAIL (UINT32_MAX - 1)
+
+// Characters [low, high] going to the same target
+struct _ByteRange {
+    int low;
+    int high;
+    // Number of the state in the generated code, CODEGEN_MATCH or CODEGEN_FAIL
+    uint32_t target;
+};
+
+typedef struct _ByteRange ByteRange;
+
+static void usage(void) {
+    fprintf(stderr, "Usage: codegen [-n NAME] PATTERN\n");
+    exit(2);
+}
+
+static bool is_identifier(const char* name) {
+    if (name[0] == '\0' || (name[0] >= '0' && name[0] <= '9')) return false;
+    for (const char* c = name;*c != '\0';c++) {
+        bool letter = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z');
+        if (!letter && !(*c >= '0' && *c <= '9') && *c != '_') return false;
+    }
+    return true;
+}
+
+// Print `pattern` as a C string literal
+static void print_string(const char* pattern, size_t length) {
+    printf("\"");
+    for (size_t i = 0;i < length;i++) {
+        unsigned char c = pattern[i];
+        if (c == '\\' || c == '"') printf("\\%c", c);
+        else if (c >= 0x20 && c < 0x7F) printf("%c", c);
+        else printf("\\%03o", c);
+    }
+    printf("\"");
+}
+
+// Target in the generated code of transition `t`
+static uint32_t target(const uint32_t* numbers, uint32_t t) {
+    if (t & DFA_MATCH_FLAG) return CODEGEN_MATCH;
+    if (t == DFA_DEAD) return CODEGEN_FAIL;
+    return numbers[t];
+}
+
+static void print_target(uint32_t target) {
+    if (target == CODEGEN_MATCH) printf("return true;\n");
+    else if (target == CODEGEN_FAIL) printf("return false;\n");
+    else printf("goto s%u;\n", target);
+}
+
+// Print the comparisons sending character c to the target of its range, `ranges` cover
+// every character from ranges[0].low to ranges[count - 1].high
+static void print_ranges(const ByteRange* ranges, size_t count, int depth) {
+    if (count <= CODEGEN_LINEAR_RANGES) {
+        for (size_t k = 0;k + 1 < count;k++) {
+            printf("%*sif (c <= 0x%02X) ", 4 * depth, "", ranges[k].high);
+            print_target(ranges[k].target);
+        }
+        printf("%*s", 4 * depth, "");
+        print_target(ranges[count - 1].target);
+        return;
+    }
+    size_t half = count / 2;
+    printf("%*sif (c <= 0x%02X) {\n", 4 * depth, "", ranges[half - 1].high);
+    print_ranges(ranges, half, depth + 1);
+    printf("%*s}\n", 4 * depth, "");
+    print_ranges(ranges + half, count - half, depth);
+}
+
+int main(int argc, char** argv) {
+    const char* name = "regex_match";
+    int i = 1;
+    for (;i < argc && argv[i][0] == '-';i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) name = argv[++i];
+        else usage();
+    }
+    if (argc - i != 1 || !is_identifier(name)) usage();
+    const char* pattern = argv[i];
+    size_t length = strlen(pattern);
+
+    Regex* r = new_regex(pattern, length, 0);
+    if (r->program.needs_backtracking) {
+        fprintf(stderr, "Backreferences and possessive quantifiers have no DFA\n");
+        return 1;
+    }
+    DfaCache c = new_dfa_cache(&r->program, NULL, CODEGEN_CACHE_SIZE);
+    if (!dfa_cache_fill(&c)) {
+        fprintf(stderr, "The DFA has more states than fit in %d MB\n", CODEGEN_CACHE_SIZE >> 20);
+        return 1;
+    }
+
+    // Number the states reachable from the start of the input, the start first
+    uint32_t start = c.start_states[DFA_AT_START & c.flags_mask];
+    uint32_t* numbers = malloc(c.state_count * sizeof(uint32_t));
+    uint32_t* order = malloc(c.state_count * sizeof(uint32_t));
+    for (uint32_t s = 0;s < c.state_count;s++) numbers[s] = CODEGEN_FAIL;
+    uint32_t count = 0;
+    numbers[start] = 0;
+    order[count++] = start;
+    for (uint32_t k = 0;k < count;k++) {
+        const uint32_t* row = c.transitions + (size_t)order[k] * c.stride;
+        for (uint32_t column = 0;column + 1 < c.stride;column++) {
+            uint32_t t = row[column];
+            if ((t & DFA_MATCH_FLAG) || t == DFA_DEAD || numbers[t] != CODEGEN_FAIL) continue;
+            numbers[t] = count;
+            order[count++] = t;
+        }
+    }
+
+    printf("// Generated by tools/codegen.c, do not edit\n");
+    printf("// Pattern ");
+    print_string(pattern, length);
+    printf(", %u states\n\n", count);
+    printf("#include <stdbool.h>\n#include <stddef.h>\n\n");
+    printf("// Whether the pattern matches anywhere in `input`\n");
+    printf("bool %s(const char* input, size_t length) {\n", name);
+    printf("    const unsigned char* text = (const unsigned char*)input;\n");
+    printf("    size_t i = 0;\n");
+    printf("    unsigned char c;\n");
+
+    // Labels only go to states some transition leads to, the start is reached by falling in
+    bool* labeled = calloc(count, sizeof(bool));
+    for (uint32_t k = 0;k < count;k++) {
+        const uint32_t* row = c.transitions + (size_t)order[k] * c.stride;
+        for (uint32_t column = 0;column + 1 < c.stride;column++) {
+            uint32_t to = target(numbers, row[column]);
+            if (to != CODEGEN_MATCH && to != CODEGEN_FAIL) labeled[to] = true;
+        }
+    }
+
+    ByteRange ranges[256];
+    for (uint32_t k = 0;k < count;k++) {
+        const uint32_t* row = c.transitions + (size_t)order[k] * c.stride;
+        size_t range_count = 0;
+        for (int next = 0;next < 256;next++) {
+            uint32_t to = target(numbers, row[r->program.byte_classes[next]]);
+            if (range_count > 0 && ranges[range_count - 1].target == to) ranges[range_count - 1].high = next;
+            else ranges[range_count++] = (ByteRange){.low = next, .high = next, .target = to};
+        }
+
+        if (labeled[k]) printf("s%u:\n", k);
+        // A match ending at the end of the input is decided by the last column
+        printf("    if (i == length) return %s;\n", row[c.stride - 1] & DFA_MATCH_FLAG ? "true" : "false");
+        printf(range_count == 1 ? "    i++;\n" : "    c = text[i++];\n");
+        print_ranges(ranges, range_count, 1);
+    }
+    printf("}\n");
+
+    free(labeled);
+    free(numbers);
+    free(order);
+    free_dfa_cache(&c);
+    free_regex(r);
+    return 0;
+}
@@ -0,0 +1,41 @@
+// Print how a pattern compiles, before and after the optimizer
+//
+//     explain [-v] PATTERN
+//
+// Prints the number of instructions of the program without and with optimize_ast,
+// with -v also the syntax trees and the programs
+
+#include "../lib.h"
+
+static void usage(void) {
+    fprintf(stderr, "Usage: explain [-v] PATTERN\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    bool verbose = argc == 3 && strcmp(argv[1], "-v") == 0;
+    if (argc != 2 && !verbose) usage();
+    const char* pattern = argv[argc - 1];
+    size_t length = strlen(pattern);
+
+    Regex* plain = new_regex(pattern, length, RegexNoOptimize);
+    Regex* optimized = new_regex(pattern, length, 0);
+    if (verbose) {
+        printf("Parsed:\n");
+        print_ast(&plain->ast);
+        print_program(&plain->program);
+        printf("\nOptimized:\n");
+        print_ast(&optimized->ast);
+        print_program(&optimized->program);
+        printf("\n");
+    }
+    uint32_t before = plain->program.length;
+    uint32_t after = optimized->program.length;
+    printf("Instructions: %u parsed, %u optimized (%+d)\n", before, after, (int)after - (int)before);
+    printf("One-pass: %s parsed, %s optimized\n",
+           plain->one_pass.is_one_pass ? "yes" : "no", optimized->one_pass.is_one_pass ? "yes" : "no");
+
+    free_regex(plain);
+    free_regex(optimized);
+    return 0;
+}
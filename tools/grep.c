@@ -0,0 +1,303 @@
+// Command line search of files, one line per match, like grep
+//
+//     grep [-c] [-n] [-j threads] PATTERN FILE...
+//
+// Files are mapped in memory and cut into chunks at line ends, worker threads search the
+// chunks and lines are printed in the order of the files
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../lib.h"
+
+// Characters of a chunk before its cut is moved to the next line end
+#define CHUNK_SIZE (1 << 20)
+
+struct _Options {
+    const char* pattern;
+    size_t pattern_length;
+    // Print the number of matching lines of each file instead of the lines
+    bool count;
+    // Print line numbers
+    bool line_numbers;
+    size_t threads;
+};
+
+typedef struct _Options Options;
+
+struct _File {
+    const char* name;
+    const char* data;
+    size_t length;
+};
+
+typedef struct _File File;
+
+// Matching line, data[start, end) of its file
+struct _Line {
+    size_t start;
+    size_t end;
+    // Number of the line counting from 0 at the start of its chunk
+    size_t number;
+};
+
+typedef struct _Line Line;
+
+// Lines of a file searched by one worker
+struct _Chunk {
+    size_t file;
+    size_t start;
+    size_t end;
+    // Lines of the chunk, to know the line number of the next chunk
+    size_t line_count;
+    Line* lines;
+    size_t lines_count;
+    size_t lines_capacity;
+    // Set by the worker once field 'lines' is complete
+    bool done;
+};
+
+typedef struct _Chunk Chunk;
+
+struct _Search {
+    const Options* options;
+    // Compiled pattern shared by the workers, each searches it with its own Scratch
+    const Regex* regex;
+    File* files;
+    size_t files_count;
+    Chunk* chunks;
+    size_t chunks_count;
+    // Next chunk a worker takes
+    atomic_size_t next_chunk;
+    // Whether a match lies inside one line, otherwise each line is searched on its own
+    bool matches_inside_lines;
+    // Guards field 'done' of chunks
+    pthread_mutex_t lock;
+    pthread_cond_t chunk_done;
+};
+
+typedef struct _Search Search;
+
+static void usage(void) {
+    fprintf(stderr, "Usage: grep [-c] [-n] [-j threads] PATTERN FILE...\n");
+    exit(2);
+}
+
+// Whether every match of program `p` lies inside one line of a bigger input:
+// no instruction consumes \n and no \A or \Z sees the ends of the whole input
+static bool matches_inside_lines(const Program* p) {
+    for (uint32_t pc = p->start;pc < p->length;pc++) {
+        Instruction inst = p->instructions[pc];
+        if (inst.op == OpByte && inst.x == '\n') return false;
+        if (inst.op == OpClass && program_class_contains(p, inst.x, '\n')) return false;
+        if (inst.op == OpAssert && (inst.x == AssertStartText || inst.x == AssertEndText)) return false;
+    }
+    return true;
+}
+
+static void push_line(Chunk* c, size_t start, size_t end, size_t number) {
+    if (c->lines_count == c->lines_capacity) {
+        c->lines_capacity = c->lines_capacity == 0 ? 64 : 2 * c->lines_capacity;
+        c->lines = realloc(c->lines, c->lines_capacity * sizeof(Line));
+    }
+    c->lines[c->lines_count++] = (Line){.start = start, .end = end, .number = number};
+}
+
+static size_t count_lines(const char* data, size_t start, size_t end) {
+    size_t count = 0;
+    for (const char* p = data + start;(p = memchr(p, '\n', data + end - p)) != NULL;p++) count++;
+    return count;
+}
+
+// End of the line `position` is in, the position of its \n or `end`
+static size_t line_end(const char* data, size_t position, size_t end) {
+    const char* newline = memchr(data + position, '\n', end - position);
+    return newline == NULL ? end : (size_t)(newline - data);
+}
+
+// Whether a search found a match
+// A search giving up ends grep with status 2 like a file it can not read, the line can not be
+// told matching or not
+static bool found(const Search* s, RegexResult result) {
+    if (result == RegexGaveUp) {
+        const Regex* r = s->regex;
+        PatternError e = (PatternError) {
+            .code = BacktrackBudgetError, .position = 0, .span = r->pattern_length, .pattern = 0
+        };
+        print_pattern_error(stderr, &e, r->pattern, r->pattern_length);
+        exit(2);
+    }
+    return result == RegexMatch;
+}
+
+static void search_chunk(Search* s, Scratch* scratch, Chunk* c) {
+    const char* data = s->files[c->file].data;
+    bool numbers = s->options->line_numbers;
+    size_t position = c->start;
+    size_t number = 0;
+
+    while (position < c->end) {
+        size_t start = position;
+        if (s->matches_inside_lines) {
+            // The leftmost match of the rest of the chunk is in the first matching line
+            size_t match_end;
+            if (!found(s, scratch_find_end(scratch, data + position, c->end - position, &match_end))) break;
+            match_end += position;
+            const char* newline = memrchr(data + position, '\n', match_end - position);
+            if (newline != NULL) start = newline - data + 1;
+            // A match at the end of the chunk is past its last line, assertions there saw
+            // the chunk end as the end of the text
+            if (start >= c->end) break;
+            if (numbers) number += count_lines(data, position, start);
+        }
+        size_t end = line_end(data, start, c->end);
+        if (s->matches_inside_lines || found(s, scratch_is_match(scratch, data + start, end - start))) {
+            push_line(c, start, end, number);
+        }
+        position = end + 1;
+        number++;
+    }
+    c->line_count = numbers ? count_lines(data, c->start, c->end) : 0;
+}
+
+static void* worker(void* argument) {
+    Search* s = argument;
+    Scratch scratch = new_scratch(s->regex);
+    while (true) {
+        size_t i = atomic_fetch_add(&s->next_chunk, 1);
+        if (i >= s->chunks_count) break;
+        search_chunk(s, &scratch, &s->chunks[i]);
+        pthread_mutex_lock(&s->lock);
+        s->chunks[i].done = true;
+        pthread_cond_broadcast(&s->chunk_done);
+        pthread_mutex_unlock(&s->lock);
+    }
+    free_scratch(&scratch);
+    return NULL;
+}
+
+static File map_file(const char* name) {
+    int fd = open(name, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(name);
+        exit(2);
+    }
+    File f = (File){.name = name, .data = NULL, .length = st.st_size};
+    if (f.length > 0) {
+        void* data = mmap(NULL, f.length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror(name);
+            exit(2);
+        }
+        madvise(data, f.length, MADV_SEQUENTIAL);
+        f.data = data;
+    }
+    close(fd);
+    return f;
+}
+
+// Cut every file into chunks ending at line ends
+static void make_chunks(Search* s) {
+    size_t capacity = 0;
+    for (size_t i = 0;i < s->files_count;i++) capacity += s->files[i].length / CHUNK_SIZE + 1;
+    s->chunks = calloc(capacity, sizeof(Chunk));
+    s->chunks_count = 0;
+    for (size_t i = 0;i < s->files_count;i++) {
+        const File* f = &s->files[i];
+        size_t start = 0;
+        while (start < f->length) {
+            size_t end = start + CHUNK_SIZE < f->length ? line_end(f->data, start + CHUNK_SIZE, f->length) : f->length;
+            if (end < f->length) end++;
+            s->chunks[s->chunks_count++] = (Chunk){.file = i, .start = start, .end = end};
+            start = end;
+        }
+    }
+}
+
+// Print the chunks in order as workers finish them
+static void print_results(Search* s) {
+    const Options* o = s->options;
+    bool names = s->files_count > 1;
+    size_t chunk = 0;
+    for (size_t file = 0;file < s->files_count;file++) {
+        const File* f = &s->files[file];
+        size_t matches = 0;
+        size_t line_base = 1;
+        for (;chunk < s->chunks_count && s->chunks[chunk].file == file;chunk++) {
+            Chunk* c = &s->chunks[chunk];
+            pthread_mutex_lock(&s->lock);
+            while (!c->done) pthread_cond_wait(&s->chunk_done, &s->lock);
+            pthread_mutex_unlock(&s->lock);
+
+            matches += c->lines_count;
+            for (size_t i = 0;i < c->lines_count && !o->count;i++) {
+                const Line* l = &c->lines[i];
+                if (names) printf("%s:", f->name);
+                if (o->line_numbers) printf("%zu:", line_base + l->number);
+                fwrite(f->data + l->start, 1, l->end - l->start, stdout);
+                putchar('\n');
+            }
+            line_base += c->line_count;
+            free(c->lines);
+        }
+        if (o->count) {
+            if (names) printf("%s:", f->name);
+            printf("%zu\n", matches);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    Options o = (Options) {
+        .count = false,
+        .line_numbers = false,
+        .threads = sysconf(_SC_NPROCESSORS_ONLN),
+    };
+    int i = 1;
+    for (;i < argc && argv[i][0] == '-';i++) {
+        if (strcmp(argv[i], "-c") == 0) o.count = true;
+        else if (strcmp(argv[i], "-n") == 0) o.line_numbers = true;
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) o.threads = strtoul(argv[++i], NULL, 10);
+        else usage();
+    }
+    if (argc - i < 2 || o.threads == 0) usage();
+    o.pattern = argv[i++];
+    o.pattern_length = strlen(o.pattern);
+
+    Search s = (Search) {
+        .options = &o,
+        .files = malloc((argc - i) * sizeof(File)),
+        .files_count = argc - i,
+    };
+    for (size_t k = 0;k < s.files_count;k++) s.files[k] = map_file(argv[i + k]);
+    make_chunks(&s);
+    atomic_init(&s.next_chunk, 0);
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.chunk_done, NULL);
+
+    Regex* r = new_regex(o.pattern, o.pattern_length, 0);
+    s.regex = r;
+    // The backtracker is bounded by the input length, it searches short lines rather than chunks
+    s.matches_inside_lines = !r->program.needs_backtracking && matches_inside_lines(&r->program);
+
+    pthread_t* threads = malloc(o.threads * sizeof(pthread_t));
+    for (size_t k = 0;k < o.threads;k++) pthread_create(&threads[k], NULL, worker, &s);
+    print_results(&s);
+    for (size_t k = 0;k < o.threads;k++) pthread_join(threads[k], NULL);
+
+    bool found = false;
+    for (size_t k = 0;k < s.chunks_count;k++) found = found || s.chunks[k].lines_count > 0;
+    for (size_t k = 0;k < s.files_count;k++) {
+        if (s.files[k].data != NULL) munmap((void*)s.files[k].data, s.files[k].length);
+    }
+    free_regex(r);
+    free(threads);
+    free(s.chunks);
+    free(s.files);
+    return found ? 0 : 1;
+}